@@ -1,4 +1,5 @@
 local has_pqxx = os.findheader("pqxx/pqxx")
+local has_libdeflate = os.findheader("libdeflate.h")
 
 
 function set_cpp_dialect()
@@ -25,6 +26,16 @@ function include_pqxx()
     end
 end
 
+function include_libdeflate()
+    -- libdeflate is optional too.  Without it, `Inflater` uses zlib.
+    if has_libdeflate then
+        defines { "HAS_LIBDEFLATE=1" }
+        links { "deflate" }
+    else
+        defines { "HAS_LIBDEFLATE=0" }
+    end
+end
+
 function include_spdlog()
     includedirs {
         "vendor/spdlog/include",
@@ -129,6 +140,8 @@ project "lib_sqlite"
     }
     buildoptions {
         "-DSQLITE_OMIT_LOAD_EXTENSION",
+        -- Default cap is 2 GiB, far smaller than large worlds (--mmap_size).
+        "-DSQLITE_MAX_MMAP_SIZE=0x10000000000",
     }
 
 project "hashmap_lib"
@@ -146,12 +159,14 @@ project "hashmap_lib"
 project "map_reader_lib"
     hide_project_makefile()
     cpp_library()
+    include_libdeflate()
     include_sqlite()
     files {
         "src/lib/map_reader/**.cc",
     }
     removefiles {
         "src/lib/map_reader/**_test.cc",
+        "src/lib/map_reader/**_bench.cc",
     }
     filter {"action:gmake or action:gmake2"}
         enablewarnings{"all"}
@@ -273,6 +288,36 @@ project "hashmap_demo"
     filter {}  -- reset filter
 
 
+project "inflate_bench"
+    hide_project_makefile()
+    kind "ConsoleApp"
+    language "C++"
+    set_cpp_dialect()
+    includedirs {
+        ".",
+    }
+    files {
+       "src/lib/map_reader/inflate_bench.cc",
+    }
+    systemversion "latest"
+    links {
+        "database_lib",
+        "map_reader_lib",
+    }
+    include_libdeflate()
+    include_spdlog()
+    include_sqlite()
+
+    filter { "system:linux" }
+        links { "pthread", "z", "zstd" }
+
+    filter { "action:gmake or action:gmake2" }
+        disablewarnings { "sign-compare" }
+        enablewarnings { "all" }
+
+    filter {}  -- reset filter
+
+
 project "unit_tests"
     hide_project_makefile()
     kind "ConsoleApp"
@@ -294,6 +339,7 @@ project "unit_tests"
         "util_lib",
     }
     include_gtest()
+    include_libdeflate()
     include_pqxx()
     include_spdlog()
     include_sqlite()
@@ -321,6 +367,7 @@ project "map_analyzer"
     removefiles {
         "src/app/**_test.cc",
     }
+    include_libdeflate()
     include_pqxx()
     include_spdlog()
     include_sqlite()
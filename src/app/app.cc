@@ -1,4 +1,5 @@
 #include <chrono>
+#include <csignal>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -8,16 +9,30 @@
 #include <vector>
 
 #include "src/app/app.h"
+#include "src/lib/database/db-map-limiter.h"
+#include "src/lib/database/db-sqlite3-vfs.h"
 #include "src/lib/util/memory_stats.h"
 
 static constexpr size_t kMegabyte = 1024 * 1024;
 static constexpr auto kProgressInterval = std::chrono::milliseconds(100);
+static constexpr auto kReadSampleInterval = std::chrono::seconds(1);
+static constexpr auto kLoadSampleInterval = std::chrono::seconds(1);
+
+// `SCAN_PARTITION`: initial count of key ranges per consumer.  More ranges
+// make for cheaper steals, fewer for longer sequential scans.
+static constexpr size_t kRangesPerConsumer = 16;
 static constexpr std::string_view kColorReset = "\x1b[0m";
 static constexpr std::string_view kColorLabel = "\x1b[0m"; // default
 static constexpr std::string_view kColorData = "\x1b[32m"; // green
 static constexpr std::string_view kClearEOL = "\x1b[0K";
 static constexpr std::string_view kCursorLeft = "\x1b[0G";
 
+// Set by SIGHUP, to make `PollRateControl()` re-read the control file even if
+// its mtime did not change.
+static volatile std::sig_atomic_t rate_control_hup = 0;
+
+static void OnSighup(int) { rate_control_hup = 1; }
+
 void App::DisplayProgress() {
   // Warning.. Linux/xterm specific escape codes.
   // TODO: Maybe port to using ncurses?
@@ -39,7 +54,7 @@ void App::DisplayProgress() {
       100.0 * static_cast<double>(sofar) / stats_.queued_map_blocks;
   const double blocks_per_second = sofar / time_diff.count();
   const double eta = remaining / blocks_per_second;
-  const size_t matrix = block_data_.size();
+  const uint64_t blocks_written = map_block_writer_.rows_written();
 
   std::stringstream ss;
 
@@ -54,7 +69,47 @@ void App::DisplayProgress() {
      << kColorLabel << " eta: " << kColorData << eta << kColorLabel
      << " vsz: " << kColorData << (ms.vsize / kMegabyte);
 
-  ss << kColorLabel << " # " << kColorData << matrix << " " << kColorLabel;
+  ss << kColorLabel << " # " << kColorData << blocks_written << " "
+     << kColorLabel;
+  ss << "thr: " << kColorData << consumer_gate_.limit() << kColorLabel << "/"
+     << kColorData << ConsumerThreads(config_) << " " << kColorLabel;
+  ss << "out MiB: " << kColorData << (data_writer_.queued_bytes() / kMegabyte)
+     << " " << kColorLabel;
+
+  // Pipeline stage occupancy: items waiting in front of each stage.
+  if (decode_queue_ && analyze_queue_) {
+    if (config_.scan_mode != ScanMode::SCAN_PARTITION) {
+      ss << "fetch: " << kColorData << map_block_queue_.size() << kColorLabel
+         << " ";
+    }
+    ss << "decode: " << kColorData << decode_queue_->size() << kColorLabel
+       << "/" << decode_queue_->capacity() << " analyze: " << kColorData
+       << analyze_queue_->size() << kColorLabel << "/"
+       << analyze_queue_->capacity() << " ";
+  }
+
+  const MapReadLimiter *limiter = config_.map_options.limiter.get();
+  if (limiter) {
+    if (now - read_sample_time_ >= kReadSampleInterval) {
+      const std::chrono::duration<double> sample_diff =
+          now - read_sample_time_;
+      const uint64_t bytes = limiter->bytes_read();
+      read_bytes_per_sec_ = (bytes - read_sample_bytes_) / sample_diff.count();
+      read_sample_time_ = now;
+      read_sample_bytes_ = bytes;
+    }
+
+    ss << "read MiB/s: " << kColorData << (read_bytes_per_sec_ / kMegabyte);
+    if (limiter->bytes_per_sec()) {
+      ss << kColorLabel << " of " << kColorData
+         << (limiter->bytes_per_sec() / kMegabyte);
+    }
+    if (limiter->blocks_per_sec()) {
+      ss << kColorLabel << " max b/s: " << kColorData
+         << limiter->blocks_per_sec();
+    }
+    ss << " ";
+  }
 
   // Reset color.
   ss << kColorReset << kClearEOL;
@@ -69,42 +124,103 @@ void App::DisplayProgress() {
 
 void App::RunSerially() {
   try {
-    RunProducer();
-    RunConsumer();
+    if (config_.scan_mode == ScanMode::SCAN_PARTITION) {
+      PartitionMap(1);
+      RunPartitionConsumer(0);
+    } else {
+      RunProducer();
+      RunConsumer(0);
+    }
     data_writer_.FlushActorIdMap();
     data_writer_.FlushNodeIdMap();
     data_writer_.FlushNodeQueue();
+    map_block_writer_.SetTombstone();
+    map_block_writer_.WriterThread(0);
+    data_writer_.MergeShards();
+    map_block_writer_.MergeShards();
     preserve_queue_.SetTombstone();
     preserve_queue_.MergeThread();
     ApplyPreserveFlags();
-    map_block_writer_.FlushBlockQueue();
   } catch (const Sqlite3Error &err) {
     spdlog::error("Sqlite3Error: {0}", err.what());
   }
 }
 
 void App::RunThreaded() {
-  std::thread producer_thread(&App::RunProducer, this);
+  const bool partitioned = (config_.scan_mode == ScanMode::SCAN_PARTITION);
+  const bool pipelined = (config_.analyze_threads > 0);
+
+  if (config_.pin_threads) {
+    topology_ = GetCpuTopology(GetAllowedCpus());
+    spdlog::info("Pinning threads to {0} NUMA nodes.", topology_.nodes.size());
+    for (size_t i = 0; i < topology_.nodes.size(); ++i) {
+      spdlog::debug("NUMA node {0}: {1} CPUs.", i, topology_.nodes[i].size());
+    }
+  }
+
+  // Partitioned consumers (or fetchers) do not need a producer; they scan the
+  // map directly.
+  std::thread producer_thread;
+  if (partitioned) {
+    PartitionMap(pipelined ? config_.fetch_threads : config_.threads);
+  } else {
+    producer_thread = std::thread(&App::RunProducer, this);
+  }
 
   std::thread preserve_thread(&PreserveQueue::MergeThread, &preserve_queue_);
+  std::vector<std::thread> writer_threads;
+  for (size_t i = 0; i < data_writer_.writers(); ++i) {
+    writer_threads.push_back(data_writer_.StartWriter(i));
+  }
+  std::vector<std::thread> block_writer_threads;
+  for (size_t i = 0; i < map_block_writer_.writers(); ++i) {
+    block_writer_threads.push_back(
+        std::thread(&MapBlockWriter::WriterThread, &map_block_writer_, i));
+  }
 
   std::vector<std::thread> consumer_threads;
-  consumer_threads.reserve(config_.threads);
-  for (int i = 0; i < config_.threads; ++i) {
-    consumer_threads.push_back(std::thread(&App::RunConsumer, this));
+  size_t consumers = 0;
+  if (pipelined) {
+    consumers = RunPipeline(&consumer_threads);
+  } else if (partitioned) {
+    for (int i = 0; i < config_.threads; ++i) {
+      consumer_threads.push_back(
+          std::thread(&App::RunPartitionConsumer, this, i));
+    }
+    consumers = consumer_threads.size();
+  } else {
+    for (int i = 0; i < config_.threads; ++i) {
+      consumer_threads.push_back(std::thread(&App::RunConsumer, this, i));
+    }
   }
 
   spdlog::trace("Threads started.");
 
   // Ultra cheesy progress bar.
-  while (map_block_queue_.idle_wait(kProgressInterval)) {
-    DisplayProgress();
-    stats_.SetPeakVSize(GetMemoryStats().vsize);
+  if (consumers) {
+    // Nobody tombstones `map_block_queue_` (partitioned), or the consumers
+    // are further down the pipeline, so just poll for them to finish.
+    while (stats_.finished_consumers < consumers) {
+      std::this_thread::sleep_for(kProgressInterval);
+      PollRateControl();
+      PollSystemLoad();
+      DisplayProgress();
+      stats_.SetPeakVSize(GetMemoryStats().vsize);
+    }
+  } else {
+    while (map_block_queue_.idle_wait(kProgressInterval)) {
+      PollRateControl();
+      PollSystemLoad();
+      DisplayProgress();
+      stats_.SetPeakVSize(GetMemoryStats().vsize);
+    }
   }
 
   spdlog::trace("Main thread waiting for worker to finish.");
 
-  producer_thread.join();
+  if (producer_thread.joinable()) {
+    producer_thread.join();
+  }
   for (auto &t : consumer_threads) {
     t.join();
   }
@@ -114,24 +230,123 @@ void App::RunThreaded() {
 
   stats_.flush_time = std::chrono::steady_clock::now();
   spdlog::info("Flushing output data...");
-  // TODO: Run the datawriter flushers in threads.
+  data_writer_.SetTombstone();
+  for (auto &t : writer_threads) {
+    t.join();
+  }
+  spdlog::info("Output writer: {0} transactions, peak queue {1} MiB.",
+               data_writer_.transactions(),
+               data_writer_.peak_queued_bytes() / kMegabyte);
   data_writer_.FlushActorIdMap();
   data_writer_.FlushNodeIdMap();
   data_writer_.FlushNodeQueue();
 
   stats_.SetPeakVSize(GetMemoryStats().vsize);
+  map_block_writer_.SetTombstone();
+  for (auto &t : block_writer_threads) {
+    t.join();
+  }
+  data_writer_.MergeShards();
+  map_block_writer_.MergeShards();
   spdlog::info("preserve_thread.join()");
   preserve_thread.join();
   ApplyPreserveFlags();
 
-  spdlog::info("map_block_writer_.FlushBlockQueue()");
-  stats_.SetPeakVSize(GetMemoryStats().vsize);
-  map_block_writer_.FlushBlockQueue();
-
   stats_.SetPeakVSize(GetMemoryStats().vsize);
   spdlog::info("Peak RAM usage: {0} MiB", stats_.peak_vsize_bytes / kMegabyte);
 }
 
+void App::PartitionMap(size_t workers) {
+  std::unique_ptr<MapInterface> map =
+      MapInterface::Create(config_.driver_type, config_.map_filename,
+                           config_.map_options);
+
+  const MapInterface::KeyRange keys =
+      map->PartitionKeys(config_.min_pos, config_.max_pos);
+  spdlog::info("Partitioning keys [{0}, {1}] into {2} ranges for {3} "
+               "consumers.",
+               keys.lo, keys.hi, workers * kRangesPerConsumer, workers);
+
+  // Pinned workers steal from their own NUMA node first.
+  std::vector<size_t> groups;
+  if (config_.pin_threads) {
+    for (size_t i = 0; i < workers; ++i) {
+      groups.push_back(topology_.NodeForWorker(i, workers));
+    }
+  }
+
+  key_scheduler_ = std::make_unique<KeyRangeScheduler>(
+      keys, workers, kRangesPerConsumer, groups);
+}
+
+int App::PinThread(size_t worker, size_t workers) {
+  if (!config_.pin_threads || topology_.nodes.empty()) {
+    return -1;
+  }
+
+  const size_t node = topology_.NodeForWorker(worker, workers);
+  if (!PinCurrentThread(topology_.nodes[node])) {
+    spdlog::warn("Failed to pin thread {0} to NUMA node {1}.", worker, node);
+    return -1;
+  }
+  return node;
+}
+
+void App::PollSystemLoad() {
+  const auto now = std::chrono::steady_clock::now();
+  if (((config_.max_load_avg <= 0) && (config_.max_pressure <= 0)) ||
+      (now - load_sample_time_ < kLoadSampleInterval)) {
+    return;
+  }
+  load_sample_time_ = now;
+
+  const SystemLoad load = GetSystemLoad();
+  const size_t threads = load_controller_.Update(load, now);
+  if (threads != consumer_gate_.limit()) {
+    spdlog::debug("Load {0:.2f}, CPU pressure {1:.1f}%, I/O pressure "
+                  "{2:.1f}%: running {3} consumer threads.",
+                  load.load_avg, load.cpu_pressure, load.io_pressure, threads);
+    consumer_gate_.SetLimit(threads);
+  }
+}
+
+void App::PollRateControl() {
+  MapReadLimiter *limiter = config_.map_options.limiter.get();
+  if (!limiter || config_.rate_control_filename.empty()) {
+    return;
+  }
+
+  // A missing (or half written) file keeps the current limits.
+  std::error_code ec;
+  const std::filesystem::file_time_type mtime =
+      std::filesystem::last_write_time(config_.rate_control_filename, ec);
+  if (ec || ((mtime == rate_control_mtime_) && !rate_control_hup)) {
+    return;
+  }
+  rate_control_mtime_ = mtime;
+  rate_control_hup = 0;
+
+  std::ifstream ifs(config_.rate_control_filename);
+  double bytes_per_sec = limiter->bytes_per_sec();
+  double blocks_per_sec = limiter->blocks_per_sec();
+  std::string key;
+  double value = 0;
+  while (ifs >> key >> value) {
+    if (key == "max_bytes_per_sec") {
+      bytes_per_sec = value;
+    } else if (key == "max_blocks_per_sec") {
+      blocks_per_sec = value;
+    } else {
+      spdlog::warn("{0}: Unknown setting '{1}'",
+                   config_.rate_control_filename, key);
+    }
+  }
+
+  limiter->SetLimits(bytes_per_sec, blocks_per_sec);
+  spdlog::info("Map read limits from {0}: {1} bytes/sec, {2} blocks/sec.",
+               config_.rate_control_filename, bytes_per_sec, blocks_per_sec);
+}
+
 // TODO: Read these from a text file.
 void App::PreregisterContentIds() {
   node_ids_.Add("");       // 0 (b/c we don't allow null values).
@@ -147,9 +362,7 @@ void App::ApplyPreserveFlags() {
   spdlog::trace("App::ApplyPreserveFlags() enter {0} items", queue.size());
 
   spdlog::info("PreserveQueue final set: {0}", queue.size());
-  for (const MapBlockPos &pos : queue) {
-    block_data_.Ref(pos).preserve = true;
-  }
+  map_block_writer_.ApplyPreserveFlags(queue);
 
   spdlog::trace("App::ApplyPreserveFlags() exit");
 }
@@ -164,6 +377,11 @@ void App::Run() {
 
   PreregisterContentIds();
 
+  if (!config_.rate_control_filename.empty()) {
+    std::signal(SIGHUP, OnSighup);
+    PollRateControl();
+  }
+
   stats_.start_time = std::chrono::steady_clock::now();
   if (config_.threads) {
     RunThreaded();
@@ -183,6 +401,29 @@ void App::Run() {
                "{3:.2f} blocks/sec, {4:.2f} blocks/sec/thread.",
                stats_.queued_map_blocks, diff.count(), config_.threads, rate,
                rate / config_.threads);
+  if (config_.map_options.readahead) {
+    const SqliteReadaheadStats io = SqliteReadaheadVfs::GetStats();
+    spdlog::info("Map reads: {0} ({1} MiB), read-ahead: {2} MiB, hit rate "
+                 "{3:.1f}%, stalled {4:.2f} seconds.",
+                 io.reads, io.bytes_read / kMegabyte,
+                 io.readahead_bytes / kMegabyte, io.hit_rate() * 100,
+                 std::chrono::duration<double>(io.stall_time).count());
+  }
+  if (key_scheduler_) {
+    spdlog::info("Partition consumers stole work {0} times ({1} across NUMA "
+                 "nodes).",
+                 key_scheduler_->steals(),
+                 key_scheduler_->cross_group_steals());
+  }
+  if (config_.pin_threads) {
+    spdlog::info("Mapblocks handed across NUMA nodes: {0}.",
+                 stats_.cross_node_map_blocks.load());
+  }
+  if (config_.map_options.limiter) {
+    const MapReadLimiter &limiter = *config_.map_options.limiter;
+    spdlog::info("Map reads charged to the read limits: {0} blocks, {1} MiB.",
+                 limiter.blocks_read(), limiter.bytes_read() / kMegabyte);
+  }
   spdlog::info("Unique nodes: {0}", node_ids_.size());
   spdlog::info("Unique actors: {0}", actor_ids_.size());
 }
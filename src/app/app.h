@@ -2,6 +2,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
 #include "src/app/actor.h"
 #include "src/app/config.h"
 #include "src/app/data_writer.h"
@@ -9,9 +14,14 @@
 #include "src/app/mapblock_writer.h"
 #include "src/app/preserve_queue.h"
 #include "src/app/stats.h"
+#include "src/lib/database/db-key-range-scheduler.h"
 #include "src/lib/id_map/id_map.h"
 #include "src/lib/map_reader/mapblock.h"
 #include "src/lib/name_filter/name_filter.h"
+#include "src/lib/util/blocking_queue.h"
+#include "src/lib/util/concurrency_gate.h"
+#include "src/lib/util/cpu_topology.h"
+#include "src/lib/util/system_load.h"
 
 class App {
 public:
@@ -20,10 +30,17 @@ public:
       : config_(config), node_filter_(), actor_ids_(),
         node_ids_(
             std::bind(&App::LookupNodeExtraInfo, this, std::placeholders::_1)),
-        block_data_(), preserve_queue_(config),
-        data_writer_(config, node_ids_, actor_ids_),
-        map_block_writer_(config, block_data_), map_block_queue_(), stats_(),
-        start_time_(std::chrono::steady_clock::now()) {}
+        preserve_queue_(config), data_writer_(config, node_ids_, actor_ids_),
+        map_block_writer_(config),
+        map_block_queue_(QueueLimit(config)), stats_(),
+        start_time_(std::chrono::steady_clock::now()), rate_control_mtime_(),
+        read_sample_time_(start_time_), read_sample_bytes_(0),
+        read_bytes_per_sec_(0), consumer_gate_(ConsumerThreads(config)),
+        load_controller_(ConsumerThreads(config), config.max_load_avg,
+                         config.max_pressure, kLoadHoldTime),
+        load_sample_time_(start_time_), key_scheduler_(), decode_queue_(),
+        analyze_queue_(), running_fetchers_(0), running_decoders_(0),
+        topology_(), producer_node_(-1) {}
   ~App() {}
 
   void Run();
@@ -35,7 +52,6 @@ private:
   NameFilter node_filter_;
   IdMap<ActorIdMapExtraInfo> actor_ids_;
   IdMap<NodeIdMapExtraInfo> node_ids_;
-  MapBlockHashMap block_data_;
   PreserveQueue preserve_queue_;
   DataWriter data_writer_;
   MapBlockWriter map_block_writer_;
@@ -43,13 +59,136 @@ private:
   RuntimeStats stats_;
   std::chrono::time_point<std::chrono::steady_clock> start_time_;
 
+  // `config_.rate_control_filename` as of the last `PollRateControl()`.
+  std::filesystem::file_time_type rate_control_mtime_;
+
+  // Map read rate shown by `DisplayProgress()`, sampled over
+  // `kReadSampleInterval` (only with a `MapReadLimiter`).
+  std::chrono::time_point<std::chrono::steady_clock> read_sample_time_;
+  uint64_t read_sample_bytes_;
+  double read_bytes_per_sec_;
+
+  // Parks consumers beyond `load_controller_.threads()`.
+  ConcurrencyGate consumer_gate_;
+
+  // Picks the count of running consumers, to keep the host under
+  // `config_.max_load_avg` and `config_.max_pressure`.
+  static constexpr auto kLoadHoldTime = std::chrono::seconds(5);
+  LoadController load_controller_;
+  std::chrono::time_point<std::chrono::steady_clock> load_sample_time_;
+
+  // `SCAN_PARTITION` only.
+  std::unique_ptr<KeyRangeScheduler> key_scheduler_;
+
+  // Items passed between the stages of `RunPipeline()`.
+  // `node` is the NUMA node of the thread that made it (or -1).  A `MapBlock`
+  // holds 16 KiB of params inline, so it is passed by pointer rather than
+  // copied into and out of the queue.
+  struct FetchedBlock {
+    MapBlockPos pos;
+    MapInterface::Blob data;
+    int node;
+  };
+  struct DecodedBlock {
+    MapBlockPos pos;
+    std::unique_ptr<MapBlock> mb;
+    int node;
+  };
+
+  // `RunPipeline()` only.  Each stage tombstones the next one's queue when
+  // its last thread exits.
+  std::unique_ptr<BlockingQueue<FetchedBlock>> decode_queue_;
+  std::unique_ptr<BlockingQueue<DecodedBlock>> analyze_queue_;
+  std::atomic<size_t> running_fetchers_;
+  std::atomic<size_t> running_decoders_;
+
+  // `config_.pin_threads` only.  The node the producer is pinned to (-1 if
+  // none), as `SCAN_DATA` consumers get their blobs from it.
+  CpuTopology topology_;
+  std::atomic<int> producer_node_;
+
   // Can be called directly (on main thread), or as a thread body.
   // Exits when all mapblocks have been produced.
   void RunProducer();
 
+  // Per-thread state of a consumer.
+  struct ConsumerContext {
+    explicit ConsumerContext(App &app, int node_ = -1);
+
+    // NUMA node the consumer is pinned to, or -1.
+    const int node;
+
+    ThreadLocalIdMap<NodeIdMapExtraInfo> node_id_cache;
+    ThreadLocalIdMap<ActorIdMapExtraInfo> actor_id_cache;
+
+    // Flushed to `preserve_queue_` in batches.
+    std::vector<MapBlockPos> anthropocene_list;
+
+    // Output rows, flushed to `data_writer_` and `map_block_writer_` in
+    // batches.
+    DataWriterBatch node_batch;
+    std::vector<MapBlockRow> block_rows;
+  };
+
   // Can be called directly on main thread, or as a thread body.
-  // Will exit when tombstone is observed.
-  void RunConsumer();
+  // Will exit when tombstone is observed.  `worker` of `config_.threads`.
+  void RunConsumer(size_t worker);
+
+  // `SCAN_PARTITION` consumer.  Can be called directly on main thread, or as
+  // a thread body.  Opens its own `MapInterface` and range scans the key
+  // ranges `key_scheduler_` hands to `worker`, bypassing the producer and
+  // `map_block_queue_`.
+  void RunPartitionConsumer(size_t worker);
+
+  // Starts the `config_.analyze_threads` pipeline: fetch, decode and analyze
+  // threads, connected by bounded queues.  Appends the threads to `threads`,
+  // and returns how many of them bump `stats_.finished_consumers` (the
+  // analyze threads).
+  size_t RunPipeline(std::vector<std::thread> *threads);
+
+  // Pipeline stage thread bodies.  `worker` counts from 0 in each stage.
+  void RunFetcher(size_t worker);
+  void RunDecoder(size_t worker);
+  void RunAnalyzer(size_t worker);
+
+  // With `config_.pin_threads`, pins the calling thread to the NUMA node of
+  // `worker` (of `workers`), before it allocates anything of its own.
+  // Returns the node, or -1 if not pinned.
+  int PinThread(size_t worker, size_t workers);
+
+  // Counts a mapblock handed from a thread on NUMA node `from` to one on
+  // `to`, if those differ.
+  void CountHandoff(int from, int to) {
+    if ((from >= 0) && (to >= 0) && (from != to)) {
+      stats_.cross_node_map_blocks++;
+    }
+  }
+
+  // Sets up `key_scheduler_` over the partition key space of the map, for
+  // `workers` consumers.
+  void PartitionMap(size_t workers);
+
+  // `SCAN_DATA`: the producer read the row, but its blob was empty.  Logs it
+  // and counts a bad mapblock.
+  void CountEmptyBlob(const MapBlockPos &mapblock_pos);
+
+  // Parses and analyzes one mapblock, queueing its output data.
+  void ProcessMapBlock(ConsumerContext &ctx, const MapBlockPos &mapblock_pos,
+                       MapInterface::BlobView raw_data);
+
+  // The two halves of `ProcessMapBlock()`.  `DecodeMapBlock()` decompresses
+  // and parses `raw_data` into `mb` (only needs a node id cache, so that
+  // decode threads need no `ConsumerContext`), and returns `false` (counting
+  // a bad mapblock) if that fails.  `AnalyzeMapBlock()` classifies the nodes,
+  // and queues the output data.
+  bool DecodeMapBlock(ThreadLocalIdMap<NodeIdMapExtraInfo> &node_id_cache,
+                      const MapBlockPos &mapblock_pos,
+                      MapInterface::BlobView raw_data, MapBlock *mb);
+  void AnalyzeMapBlock(ConsumerContext &ctx, const MapBlockPos &mapblock_pos,
+                       const MapBlock &mb);
+
+  // Flushes whatever `ctx` still holds; call when the consumer is done.
+  void FlushConsumer(ConsumerContext &ctx);
 
   // Primarily for "correctness" debugging, this method runs the entire
   // pipeline serially, on the main thread (no worker threads).
@@ -58,6 +197,14 @@ private:
   // Run with worker threads.
   void RunThreaded();
 
+  // Samples the host load (at most once per `kLoadSampleInterval`), and
+  // parks/unparks consumers to follow `load_controller_`.  Main thread only.
+  void PollSystemLoad();
+
+  // Re-reads the map read limits from `config_.rate_control_filename`, if it
+  // changed (or SIGHUP was received) since the last call.  Main thread only.
+  void PollRateControl();
+
   // Preregisteres some super common nodes so that they are first in the
   // node_ids_ map.
   void PreregisterContentIds();
@@ -75,4 +222,16 @@ private:
   }
 
   void WriteStatsFile(const std::string filename);
+
+  // Count of threads that run `AnalyzeMapBlock()` (and that the load
+  // controller may park).
+  static size_t ConsumerThreads(const Config &config) {
+    return config.analyze_threads ? config.analyze_threads : config.threads;
+  }
+
+  // The queue can only be bounded when consumers run concurrently with the
+  // producer.  `RunSerially()` runs the whole producer first.
+  static size_t QueueLimit(const Config &config) {
+    return config.threads ? config.queue_limit : 0;
+  }
 };
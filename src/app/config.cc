@@ -7,6 +7,10 @@
 // to the consumer.
 static constexpr size_t kDefaultProducerBatchSize = 2048;
 
+// Default count of mapblocks (with their blobs) that `SCAN_DATA` will buffer
+// between the producer and the consumers.
+static constexpr size_t kDefaultQueueLimit = 65536;
+
 // Default mapblock radius to preserve adjacent anthropocene blocks.
 // The "mapblock removal" code will preserve (not delete) any mapblock within
 // this mapblock distance from any mapblock considered "anthropocene".
@@ -21,18 +25,40 @@ static constexpr size_t kDefaultAnthropoceneFlushThreshold = 2048;
 // to it.
 static constexpr size_t kDefaultPreserveLimit = 32768;
 
+// Default bytes of output rows the consumers may queue up ahead of the output
+// database writer.
+static constexpr size_t kDefaultNodeQueueBytes = 256 * 1024 * 1024;
+
 Config::Config()
     : min_pos(MapBlockPos::min()), max_pos(MapBlockPos::max()),
-      driver_type(MapDriverType::SQLITE), map_filename(), out_filename(),
-      pattern_filename(), stats_filename(), threads(0),
-      max_load_avg(std::thread::hardware_concurrency()),
+      driver_type(MapDriverType::SQLITE), scan_mode(ScanMode::SCAN_KEYS),
+      map_filename(), map_options(), out_filename(),
+      pattern_filename(), stats_filename(), threads(0), fetch_threads(0),
+      decode_threads(0), analyze_threads(0), pin_threads(false),
+      max_load_avg(std::thread::hardware_concurrency()), max_pressure(0),
+      max_bytes_per_sec(0), max_blocks_per_sec(0), rate_control_filename(),
       preserve_radius(kDefaultPreserveRadius),
       producer_batch_size(kDefaultProducerBatchSize),
+      queue_limit(kDefaultQueueLimit),
       anthropocene_flush_threshold(kDefaultAnthropoceneFlushThreshold),
-      preserve_limit(kDefaultPreserveLimit), track_minegeld(false) {}
+      preserve_limit(kDefaultPreserveLimit),
+      node_queue_bytes(kDefaultNodeQueueBytes), bulk_load(false),
+      out_shards(0), track_minegeld(false) {}
 
 void DebugLogConfig(const Config &config) {
   spdlog::debug("config.map_filename: {0}", config.map_filename);
+  spdlog::debug("config.map_options.read_only: {0}",
+                config.map_options.read_only);
+  spdlog::debug("config.map_options.immutable: {0}",
+                config.map_options.immutable);
+  spdlog::debug("config.map_options.mmap_size: {0}",
+                config.map_options.mmap_size);
+  spdlog::debug("config.map_options.cache_size: {0}",
+                config.map_options.cache_size);
+  spdlog::debug("config.map_options.readahead: {0}",
+                config.map_options.readahead);
+  spdlog::debug("config.map_options.connections: {0}",
+                config.map_options.connections);
   spdlog::debug("config.out_filename: {0}", config.out_filename);
   spdlog::debug("config.pattern_filename: {0}", config.pattern_filename);
   spdlog::debug("config.stats_filename: {0}", config.stats_filename);
@@ -42,10 +68,24 @@ void DebugLogConfig(const Config &config) {
                 config.max_pos.MapBlockId());
   spdlog::debug("config.preserve_radius: {0}", config.preserve_radius);
   spdlog::debug("config.threads: {0}", config.threads);
+  spdlog::debug("config.fetch_threads: {0}", config.fetch_threads);
+  spdlog::debug("config.decode_threads: {0}", config.decode_threads);
+  spdlog::debug("config.analyze_threads: {0}", config.analyze_threads);
+  spdlog::debug("config.pin_threads: {0}", config.pin_threads);
   spdlog::debug("config.max_load_avg: {0}", config.max_load_avg);
+  spdlog::debug("config.max_pressure: {0}", config.max_pressure);
+  spdlog::debug("config.max_bytes_per_sec: {0}", config.max_bytes_per_sec);
+  spdlog::debug("config.max_blocks_per_sec: {0}", config.max_blocks_per_sec);
+  spdlog::debug("config.rate_control_filename: {0}",
+                config.rate_control_filename);
+  spdlog::debug("config.scan_mode: {0}", static_cast<int>(config.scan_mode));
   spdlog::debug("config.producer_batch_size: {0}", config.producer_batch_size);
+  spdlog::debug("config.queue_limit: {0}", config.queue_limit);
   spdlog::debug("config.anthropocene_flush_threshold: {0}",
                 config.anthropocene_flush_threshold);
   spdlog::debug("config.preserve_limit: {0}", config.preserve_limit);
+  spdlog::debug("config.node_queue_bytes: {0}", config.node_queue_bytes);
+  spdlog::debug("config.bulk_load: {0}", config.bulk_load);
+  spdlog::debug("config.out_shards: {0}", config.out_shards);
   spdlog::debug("config.track_minegeld: {0}", config.track_minegeld);
 }
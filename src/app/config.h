@@ -3,6 +3,25 @@
 #include "src/lib/database/db-map-interface.h"
 #include "src/lib/map_reader/pos.h"
 
+// How the producer walks the map database.
+enum ScanMode {
+  // Producer lists keys only, each consumer loads its mapblocks by key.
+  SCAN_KEYS = 0,
+
+  // Producer reads keys and blobs in one sequential scan, and hands the blobs
+  // to the consumers.
+  SCAN_DATA = 1,
+
+  // No producer.  The key space is split into one contiguous range per
+  // consumer, and each consumer range scans its own slice of the map.
+  SCAN_PARTITION = 2,
+
+  // Like `SCAN_KEYS`, but the producer lists every key with its blob size
+  // first, and hands out the largest (slowest to process) mapblocks first,
+  // so that a few heavy ones do not hold up the end of the run.
+  SCAN_LARGEST = 3,
+};
+
 // User config, captured from command line, shared read-only between worker
 // threads.
 
@@ -15,6 +34,9 @@ struct Config {
   // How to read source data (sqlite, postgresql, etc...)
   MapDriverType driver_type;
 
+  // How the producer walks the source data.
+  ScanMode scan_mode;
+
   // SQLITE: Full path to "map.sqlite" file.
   //   Ex: "${HOME}/.minetest/worlds/myworld/map.sqlite"
   // POSTGRESQL: Connection string.
@@ -22,6 +44,9 @@ struct Config {
   //   Is passed to `PQconnectdb()` unmodified.
   std::string map_filename;
 
+  // How to open `map_filename` (read-only, mmap, cache size, etc...).
+  MapOptions map_options;
+
   // Full path to output sqlite file (created by our app, from app/schema).
   std::string out_filename;
 
@@ -39,10 +64,41 @@ struct Config {
   // thread (for easy gdb debugging).
   int threads;
 
-  // max load average.  Worker threads will intentionally slow down if the
-  // host's load average is above this value.
+  // If `analyze_threads` is set, consumers are split into a staged pipeline
+  // (see `App::RunPipeline()`) instead of running `threads` consumers that
+  // each do everything:
+  // fetch_threads: pop from the producer and load blobs (or, for
+  //   `SCAN_PARTITION`, range scan the map).
+  // decode_threads: decompress and parse blobs into `MapBlock`s.
+  // analyze_threads: classify nodes and queue the output data.
+  size_t fetch_threads;
+  size_t decode_threads;
+  size_t analyze_threads;
+
+  // Pin worker threads to the CPUs of one NUMA node each (spread evenly over
+  // the nodes), so that their memory stays node local.  See `CpuTopology`.
+  bool pin_threads;
+
+  // max load average.  While the host's load average is above this,
+  // consumer threads are parked one at a time, and unparked once it drops
+  // again (see `LoadController`).  0 = no limit.
   double max_load_avg;
 
+  // max % CPU and I/O pressure (PSI "some avg10"), parking consumers the same
+  // way.  Off (0) by default: a shared host can show stalls well above any
+  // fixed limit without being overloaded.
+  double max_pressure;
+
+  // Read budget for the input map (0 = unlimited).  Applied through
+  // `map_options.limiter`, which is only set if any of these are.
+  double max_bytes_per_sec;
+  double max_blocks_per_sec;
+
+  // If set, a file with "max_bytes_per_sec N" and/or "max_blocks_per_sec N"
+  // lines, re-read whenever it changes (or on SIGHUP) to adjust the budget
+  // while running.
+  std::string rate_control_filename;
+
   // Mapblock radius to preserve adjacent anthropocene blocks.
   // The "mapblock removal" code will preserve (not delete) any mapblock within
   // this mapblock distance from any mapblock considered "anthropocene".
@@ -53,6 +109,12 @@ struct Config {
   // system more efficient.
   size_t producer_batch_size;
 
+  // Max count of mapblocks queued between the producer and the consumers
+  // before the producer blocks (rounded up to a power of two).  Caps the
+  // producer's memory: with `SCAN_DATA`, each queued item holds an entire
+  // blob.  0 = unbounded.
+  size_t queue_limit;
+
   // Max count of items in each consumer thread's `anthropocene_list` before
   // flushing those to the `preserve_queue_`.
   size_t anthropocene_flush_threshold;
@@ -61,6 +123,21 @@ struct Config {
   // into the 3d-sparse matrix.
   size_t preserve_limit;
 
+  // Max bytes of output rows queued for `DataWriter::DataWriterThread()`
+  // before consumers block.  0 = unbounded.
+  size_t node_queue_bytes;
+
+  // Write the output database without a rollback journal or fsync, with
+  // larger pages and caches (see `OutputDatabaseOptions()`).  A crash leaves
+  // it corrupt, so only for output that is rebuilt from scratch anyway.
+  bool bulk_load;
+
+  // Count of writer threads per output table group (`nodes` and `inventory`,
+  // `blocks`), each with a shard file of its own, merged into the output
+  // database at the end (see `OutputShardCount()`).  0 = write to the output
+  // database directly, with one writer thread each.
+  size_t out_shards;
+
   // If true, track how much "minegeld" (currency) is in each node's metadata.
   // This is expensive (~17% of total CPU usage), so only enable it if needed.
   bool track_minegeld;
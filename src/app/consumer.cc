@@ -3,116 +3,239 @@
 
 #include "src/app/app.h"
 #include "src/lib/database/db-map-interface.h"
+#include "src/lib/database/db-sqlite3-btree.h"
 #include "src/lib/map_reader/blob_reader.h"
 #include "src/lib/map_reader/mapblock.h"
 #include "src/lib/map_reader/node.h"
 #include "src/lib/map_reader/pos.h"
 #include "src/lib/map_reader/utils.h"
 
-void App::RunConsumer() {
-  spdlog::trace("Consumer entry");
-  std::unique_ptr<MapInterface> map =
-      MapInterface::Create(config_.driver_type, config_.map_filename);
+// Max count of mapblocks a consumer pops from the queue (and loads from the
+// map, with `SCAN_KEYS`) at once.
+static constexpr size_t kConsumerBatchSize = 64;
+
+// Bytes of output rows a consumer collects before queueing them for the
+// `DataWriter`.
+static constexpr size_t kNodeBatchBytes = 256 * 1024;
+
+// Count of `blocks` rows a consumer collects before queueing them for the
+// `MapBlockWriter`.
+static constexpr size_t kBlockRowBatchSize = 256;
 
-  ThreadLocalIdMap node_id_cache(node_ids_);
-  ThreadLocalIdMap actor_id_cache(actor_ids_);
+App::ConsumerContext::ConsumerContext(App &app, int node_)
+    : node(node_), node_id_cache(app.node_ids_), actor_id_cache(app.actor_ids_),
+      anthropocene_list(), node_batch(app.data_writer_.NewBatch()),
+      block_rows() {
+  anthropocene_list.reserve(app.config_.anthropocene_flush_threshold);
+  block_rows.reserve(kBlockRowBatchSize);
+}
+
+void App::RunConsumer(size_t worker) {
+  spdlog::trace("Consumer {0} entry", worker);
+  const int node = PinThread(worker, config_.threads);
 
-  std::vector<MapBlockPos> anthropocene_list;
-  anthropocene_list.reserve(config_.anthropocene_flush_threshold);
+  // With `SCAN_DATA`, the producer hands us the blobs, so we don't need our
+  // own database connection.
+  std::unique_ptr<MapInterface> map;
+  if (config_.scan_mode != ScanMode::SCAN_DATA) {
+    map = MapInterface::Create(config_.driver_type, config_.map_filename,
+                               config_.map_options);
+  }
 
+  ConsumerContext ctx(*this, node);
+
+  consumer_gate_.Enter();
+  std::vector<MapBlockKey> keys;
+  std::vector<MapBlockPos> positions;
   while (true) {
-    const MapBlockKey key = map_block_queue_.Pop();
-    if (key.isTombstone()) {
-      spdlog::debug("Tombstone");
+    // Park before popping, so that a parked consumer doesn't sit on a batch
+    // that others could be processing.
+    consumer_gate_.Yield();
+    if (!map_block_queue_.PopBatch(kConsumerBatchSize, &keys)) {
       break;
     }
 
-    const MapBlockPos mapblock_pos(key.pos);
-    std::optional<MapInterface::Blob> raw_data =
-        map->LoadMapBlock(mapblock_pos);
-    if (!raw_data) {
-      spdlog::error("Failed to load mapblock {0} {1}", mapblock_pos.str(),
-                    key.pos);
-      stats_.bad_map_blocks++;
-      continue;
+    // Blobs the producer already read are processed right away, the rest are
+    // loaded together.
+    positions.clear();
+    for (MapBlockKey &key : keys) {
+      if (!key.data.empty()) {
+        CountHandoff(producer_node_, ctx.node);
+        ProcessMapBlock(ctx, MapBlockPos(key.pos), key.data);
+      } else if (!map) {
+        CountEmptyBlob(MapBlockPos(key.pos));
+      } else {
+        positions.push_back(MapBlockPos(key.pos));
+      }
     }
-
-    BlobReader blob(raw_data.value());
-    MapBlock mb;
-
-    try {
-      mb.deserialize(blob, key.pos, node_id_cache);
-    } catch (const SerializationError &err) {
-      // TODO: Log these failed blocks and error message to an output table.
-      stats_.bad_map_blocks++;
-      spdlog::error("Failed to deserialize mapblock {0} {1}. {2}",
-                    mapblock_pos.str(), key.pos, err.what());
+    if (positions.empty()) {
       continue;
     }
 
-    stats_.good_map_blocks++;
-    std::vector<std::unique_ptr<DataWriterNode>> node_queue;
-    node_queue.reserve(256);
-
-    bool anthropocene = false;
-    uint64_t uniform = 0;
-
-    for (size_t i = 0; i < MapBlock::NODES_PER_BLOCK; i++) {
-      const Node &node = mb.nodes()[i];
-      const IdMapItem<NodeIdMapExtraInfo> &node_info =
-          node_id_cache.Get(node.param0());
-      const std::string &owner = node.get_owner();
-
-      const uint64_t owner_id = owner.empty() ? 0 : actor_id_cache.Add(owner);
-      const uint64_t minegeld =
-          config_.track_minegeld ? node.inventory().total_minegeld() : 0;
-      const bool is_bones = (node_info.key == "bones::bones");
-      const bool has_inventory = !node.inventory().empty();
-
-      if (minegeld || is_bones || has_inventory || (owner_id > -0) ||
-          node_info.extra.anthropocene) {
-        auto dwn = std::make_unique<DataWriterNode>();
-        dwn->pos = NodePos(mapblock_pos, i);
-        dwn->owner_id = owner_id;
-        dwn->node_id = node.param0();
-        dwn->minegeld = minegeld;
-        dwn->inventory = node.inventory(); // deep copy.
-
-        node_queue.push_back(std::move(dwn));
+    const auto process = [&](size_t i,
+                             std::optional<MapInterface::Blob> &&blob) {
+      if (!blob) {
+        spdlog::error("Failed to load mapblock {0} {1}", positions[i].str(),
+                      positions[i].MapBlockId());
+        stats_.bad_map_blocks++;
+        return;
       }
+      ProcessMapBlock(ctx, positions[i], blob.value());
+    };
 
-      anthropocene |= node_info.extra.anthropocene;
-    }
+    // Backends that can, hand us each blob as it arrives.
+    map->LoadMapBlocks(positions, process);
+  }
+  spdlog::debug("Tombstone");
+  consumer_gate_.Leave();
+
+  FlushConsumer(ctx);
+  stats_.finished_consumers++;
+  spdlog::trace("Consumer {0} exit", worker);
+}
+
+void App::RunPartitionConsumer(size_t worker) {
+  spdlog::trace("Partition consumer {0} entry", worker);
+  const int node = PinThread(worker, key_scheduler_->workers());
+  std::unique_ptr<MapInterface> map =
+      MapInterface::Create(config_.driver_type, config_.map_filename,
+                           config_.map_options);
+
+  ConsumerContext ctx(*this, node);
 
-    if (!node_queue.empty()) {
-      data_writer_.EnqueueNodes(std::move(node_queue));
+  // The mapblock is parsed straight out of the backend's buffer.
+  const auto callback = [this, &ctx, worker](int64_t key,
+                                             const MapBlockPos &pos,
+                                             MapInterface::BlobView data) {
+    if (!key_scheduler_->Claim(worker, key)) {
+      return false;
+    }
+    stats_.queued_map_blocks++;
+    ProcessMapBlock(ctx, pos, data);
+    return true;
+  };
+
+  consumer_gate_.Enter();
+  try {
+    while (const auto range = key_scheduler_->Next(worker)) {
+      map->ProduceMapBlockData(config_.min_pos, config_.max_pos, *range,
+                               callback);
+      // Park between ranges, not mid-scan: the backend holds a connection (or
+      // read transaction) until the scan returns.  Others steal our queued
+      // ranges meanwhile.
+      consumer_gate_.Yield();
     }
+  } catch (const SqliteBtreeError &err) {
+    // A corrupt map file; give up on it, but still flush what we have.
+    spdlog::error("Partition consumer {0} stopped: {1}", worker, err.what());
+  }
+  consumer_gate_.Leave();
 
-    if (mb.unique_content_ids() == 1) {
-      uniform = mb.nodes()[0].param0();
+  FlushConsumer(ctx);
+  stats_.finished_consumers++;
+  spdlog::trace("Partition consumer exit");
+}
+
+void App::CountEmptyBlob(const MapBlockPos &mapblock_pos) {
+  spdlog::error("Empty or corrupt map.data blob for mapblock {0} {1}",
+                mapblock_pos.str(), mapblock_pos.MapBlockId());
+  stats_.bad_map_blocks++;
+}
+
+void App::ProcessMapBlock(ConsumerContext &ctx, const MapBlockPos &mapblock_pos,
+                          MapInterface::BlobView raw_data) {
+  MapBlock mb;
+  if (DecodeMapBlock(ctx.node_id_cache, mapblock_pos, raw_data, &mb)) {
+    AnalyzeMapBlock(ctx, mapblock_pos, mb);
+  }
+}
+
+bool App::DecodeMapBlock(ThreadLocalIdMap<NodeIdMapExtraInfo> &node_id_cache,
+                         const MapBlockPos &mapblock_pos,
+                         MapInterface::BlobView raw_data, MapBlock *mb) {
+  BlobReader blob(raw_data);
+
+  try {
+    mb->deserialize(blob, mapblock_pos.MapBlockId(), node_id_cache);
+  } catch (const SerializationError &err) {
+    // TODO: Log these failed blocks and error message to an output table.
+    stats_.bad_map_blocks++;
+    spdlog::error("Failed to deserialize mapblock {0} {1}. {2}",
+                  mapblock_pos.str(), mapblock_pos.MapBlockId(), err.what());
+    return false;
+  }
+
+  return true;
+}
+
+void App::AnalyzeMapBlock(ConsumerContext &ctx, const MapBlockPos &mapblock_pos,
+                          const MapBlock &mb) {
+  stats_.good_map_blocks++;
+
+  bool anthropocene = false;
+  uint16_t uniform = 0;
+
+  for (size_t i = 0; i < MapBlock::NODES_PER_BLOCK; i++) {
+    const Node node = mb.node(i);
+    const IdMapItem<NodeIdMapExtraInfo> &node_info =
+        ctx.node_id_cache.Get(node.param0());
+    const std::string_view owner = node.get_owner();
+
+    const uint64_t owner_id =
+        owner.empty() ? 0 : ctx.actor_id_cache.Add(owner);
+    const uint64_t minegeld =
+        config_.track_minegeld ? node.inventory().total_minegeld() : 0;
+    const bool is_bones = (node_info.key == "bones::bones");
+    const bool has_inventory = !node.inventory().empty();
+
+    if (minegeld || is_bones || has_inventory || (owner_id > -0) ||
+        node_info.extra.anthropocene) {
+      ctx.node_batch.Add(NodePos(mapblock_pos, i), owner_id, node.param0(),
+                         minegeld, node.inventory());
     }
 
-    MapBlockData &data = block_data_.Ref(mapblock_pos);
-    data.uniform = uniform;
-    data.anthropocene = anthropocene;
+    anthropocene |= node_info.extra.anthropocene;
+  }
 
-    map_block_writer_.EnqueueMapBlockPos(mapblock_pos);
+  if (ctx.node_batch.bytes() >= kNodeBatchBytes) {
+    data_writer_.EnqueueNodes(std::move(ctx.node_batch));
+    ctx.node_batch = data_writer_.NewBatch();
+  }
 
-    if (anthropocene) {
-      anthropocene_list.push_back(mapblock_pos);
+  if (mb.unique_content_ids() == 1) {
+    uniform = mb.param0()[0];
+  }
 
-      if (anthropocene_list.size() > config_.anthropocene_flush_threshold) {
-        preserve_queue_.Enqueue(std::move(anthropocene_list));
-        anthropocene_list.clear();
-        anthropocene_list.reserve(config_.anthropocene_flush_threshold);
-      }
+  ctx.block_rows.push_back(MapBlockRow{mapblock_pos, uniform, anthropocene});
+  if (ctx.block_rows.size() >= kBlockRowBatchSize) {
+    map_block_writer_.EnqueueRows(std::move(ctx.block_rows));
+    ctx.block_rows.clear();
+    ctx.block_rows.reserve(kBlockRowBatchSize);
+  }
+
+  if (anthropocene) {
+    ctx.anthropocene_list.push_back(mapblock_pos);
+
+    if (ctx.anthropocene_list.size() > config_.anthropocene_flush_threshold) {
+      preserve_queue_.Enqueue(std::move(ctx.anthropocene_list));
+      ctx.anthropocene_list.clear();
+      ctx.anthropocene_list.reserve(config_.anthropocene_flush_threshold);
     }
   }
+}
 
-  if (!anthropocene_list.empty()) {
-    preserve_queue_.Enqueue(std::move(anthropocene_list));
-    anthropocene_list.clear();
+void App::FlushConsumer(ConsumerContext &ctx) {
+  data_writer_.EnqueueNodes(std::move(ctx.node_batch));
+  ctx.node_batch = data_writer_.NewBatch();
+
+  if (!ctx.block_rows.empty()) {
+    map_block_writer_.EnqueueRows(std::move(ctx.block_rows));
+    ctx.block_rows.clear();
+    ctx.block_rows.reserve(kBlockRowBatchSize);
   }
 
-  spdlog::trace("Consumer exit");
+  if (!ctx.anthropocene_list.empty()) {
+    preserve_queue_.Enqueue(std::move(ctx.anthropocene_list));
+    ctx.anthropocene_list.clear();
+  }
 }
@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <iterator>
+#include <spdlog/spdlog.h>
+
 #include "src/app/data_writer.h"
+#include "src/app/output_shards.h"
 #include "src/app/schema/schema.h"
 
 static constexpr char kSqlWriteActor[] = R"sql(
@@ -9,31 +14,54 @@ static constexpr char kSqlWriteNode[] = R"sql(
   insert into node (node_id, name, special) values (:id, :name, :special)
 )sql";
 
+// Followed by `values` (see `SqliteMultiInsert`).
 static constexpr char kSqlWriteNodes[] = R"sql(
   insert into nodes (pos_id, node_x, node_y, node_z, owner_id, node_id,
                      minegeld)
-  values (:pos_id, :node_x, :node_y, :node_z, :owner_id, :node_id, :minegeld)
 )sql";
+static constexpr int kNodesColumns = 7;
 
 static constexpr char kSqlWriteInventory[] = R"sql(
   insert into inventory (pos_id, type, item_string)
-  values (:pos_id, :type, :item_string)
 )sql";
+static constexpr int kInventoryColumns = 3;
 
 DataWriter::DataWriter(const Config &config,
                        IdMap<NodeIdMapExtraInfo> &node_id_map,
                        IdMap<ActorIdMapExtraInfo> &actor_id_map)
     : config_(config), actor_id_map_(actor_id_map), node_id_map_(node_id_map),
-      database_(), stmt_actor_(), stmt_node_(), stmt_nodes_(),
-      stmt_inventory_(), node_queue_(), node_mutex_(), node_cv_() {
-  VerifySchema(config_.out_filename);
+      database_(), stmt_actor_(), stmt_node_(), shards_(), shard_filenames_(),
+      node_queue_(), pool_(), queued_bytes_(0), peak_queued_bytes_(0),
+      transactions_(0), tombstone_(false), running_writers_(0), node_mutex_(),
+      node_cv_(), space_cv_() {
+  const SqliteOptions options = OutputDatabaseOptions(config.bulk_load);
+  VerifySchema(config.out_filename, options);
 
-  database_ = std::make_unique<SqliteDb>(config.out_filename);
+  database_ = std::make_unique<SqliteDb>(config.out_filename, options);
   stmt_actor_ = std::make_unique<SqliteStmt>(*database_.get(), kSqlWriteActor);
   stmt_node_ = std::make_unique<SqliteStmt>(*database_.get(), kSqlWriteNode);
-  stmt_nodes_ = std::make_unique<SqliteStmt>(*database_.get(), kSqlWriteNodes);
-  stmt_inventory_ =
-      std::make_unique<SqliteStmt>(*database_.get(), kSqlWriteInventory);
+
+  for (size_t i = 0; i < OutputShardCount(config); ++i) {
+    shard_filenames_.push_back(
+        OutputShardFilename(config.out_filename, "nodes", i));
+    CreateOutputShard(shard_filenames_.back());
+    shards_.push_back(OpenShard(shard_filenames_.back(), OutputShardOptions()));
+  }
+  if (shards_.empty()) {
+    shards_.push_back(OpenShard(config.out_filename, options));
+  }
+}
+
+DataWriter::Shard DataWriter::OpenShard(const std::string &filename,
+                                        const SqliteOptions &options) {
+  Shard shard;
+  shard.database = std::make_unique<SqliteDb>(filename, options);
+  shard.insert_nodes = std::make_unique<SqliteMultiInsert>(
+      *shard.database.get(), kSqlWriteNodes, kNodesColumns, kRowsPerInsert);
+  shard.insert_inventory = std::make_unique<SqliteMultiInsert>(
+      *shard.database.get(), kSqlWriteInventory, kInventoryColumns,
+      kRowsPerInsert);
+  return shard;
 }
 
 void DataWriter::FlushActorIdMap() {
@@ -69,39 +97,196 @@ void DataWriter::FlushNodeIdMap() {
   database_->Commit();
 }
 
+void DataWriterBatch::Add(const NodePos &pos, uint64_t owner_id,
+                          uint64_t node_id, uint64_t minegeld,
+                          const Inventory &inventory) {
+  const uint32_t first_item = items_.size();
+  for (const auto &list : inventory.lists()) {
+    // Each list's name is stored once, for all of its items.
+    uint32_t type = 0;
+    bool have_type = false;
+    for (const auto &item : list.second.items()) {
+      if (item.empty()) {
+        continue;
+      }
+      if (!have_type) {
+        type = text_.size();
+        text_ += list.first;
+        have_type = true;
+      }
+      items_.push_back(Item{type, static_cast<uint32_t>(list.first.size()),
+                            static_cast<uint32_t>(text_.size()),
+                            static_cast<uint32_t>(item.size())});
+      text_ += item;
+    }
+  }
+
+  nodes_.push_back(Node{pos, owner_id, node_id, minegeld, first_item,
+                        static_cast<uint32_t>(items_.size() - first_item)});
+}
+
+DataWriterBatch DataWriter::NewBatch() {
+  std::unique_lock<std::mutex> lock(node_mutex_);
+  if (pool_.empty()) {
+    return DataWriterBatch();
+  }
+  DataWriterBatch batch = std::move(pool_.back());
+  pool_.pop_back();
+  return batch;
+}
+
+void DataWriter::EnqueueNodes(DataWriterBatch &&batch) {
+  if (batch.empty()) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(node_mutex_);
+  space_cv_.wait(lock, [this]() {
+    return !running_writers_ || !config_.node_queue_bytes ||
+           (queued_bytes_ < config_.node_queue_bytes);
+  });
+
+  queued_bytes_ += batch.bytes();
+  peak_queued_bytes_ = std::max(peak_queued_bytes_, queued_bytes_);
+  node_queue_.push_back(std::move(batch));
+  node_cv_.notify_one();
+}
+
+void DataWriter::Recycle(std::vector<DataWriterBatch> *batches) {
+  for (DataWriterBatch &batch : *batches) {
+    if (pool_.size() < kMaxPooledBatches) {
+      batch.clear();
+      pool_.push_back(std::move(batch));
+    }
+  }
+  batches->clear();
+}
+
+void DataWriter::WriteBatches(Shard &shard,
+                              const std::vector<DataWriterBatch> &batches) {
+  // A row of one of `batches`, by index.
+  struct RowRef {
+    int64_t pos_id;
+    uint32_t batch;
+    uint32_t row;
+  };
+
+  std::vector<RowRef> nodes;
+  for (uint32_t b = 0; b < batches.size(); ++b) {
+    const std::vector<DataWriterBatch::Node> &batch_nodes = batches[b].nodes();
+    for (uint32_t i = 0; i < batch_nodes.size(); ++i) {
+      nodes.push_back(RowRef{
+          static_cast<int64_t>(batch_nodes[i].pos.NodePosId()), b, i});
+    }
+  }
+  std::sort(nodes.begin(), nodes.end(), [](const RowRef &a, const RowRef &b) {
+    return a.pos_id < b.pos_id;
+  });
+
+  // `inventory` is a rowid table, any order appends; this one keeps each
+  // node's items together.
+  std::vector<RowRef> items;
+  for (const RowRef &ref : nodes) {
+    const DataWriterBatch::Node &node = batches[ref.batch].nodes()[ref.row];
+    for (uint32_t i = 0; i < node.item_count; ++i) {
+      items.push_back(RowRef{ref.pos_id, ref.batch, node.first_item + i});
+    }
+  }
+
+  shard.database->Begin();
+  shard.insert_nodes->Insert(
+      nodes.size(), [&](SqliteStmt &stmt, size_t row, int first) {
+        const RowRef &ref = nodes[row];
+        const DataWriterBatch::Node &node = batches[ref.batch].nodes()[ref.row];
+        stmt.BindInt(first, ref.pos_id);
+        stmt.BindInt(first + 1, node.pos.x);
+        stmt.BindInt(first + 2, node.pos.y);
+        stmt.BindInt(first + 3, node.pos.z);
+        stmt.BindInt(first + 4, node.owner_id);
+        stmt.BindInt(first + 5, node.node_id);
+        stmt.BindInt(first + 6, node.minegeld);
+      });
+
+  shard.insert_inventory->Insert(
+      items.size(), [&](SqliteStmt &stmt, size_t row, int first) {
+        const RowRef &ref = items[row];
+        const DataWriterBatch &batch = batches[ref.batch];
+        const DataWriterBatch::Item &item = batch.items()[ref.row];
+        stmt.BindInt(first, ref.pos_id);
+        stmt.BindText(first + 1, batch.text(item.type, item.type_size));
+        stmt.BindText(first + 2, batch.text(item.item, item.item_size));
+      });
+  shard.database->Commit();
+}
+
 void DataWriter::FlushNodeQueue() {
+  std::unique_lock<std::mutex> lock(node_mutex_);
   if (node_queue_.empty())
     return;
 
-  database_->Begin();
-  while (!node_queue_.empty()) {
-    std::unique_ptr<DataWriterNode> node = std::move(node_queue_.front());
-    node_queue_.pop();
-
-    const uint64_t pos_id = node->pos.NodePosId();
-    stmt_nodes_->BindInt(1, pos_id);
-    stmt_nodes_->BindInt(2, node->pos.x);
-    stmt_nodes_->BindInt(3, node->pos.y);
-    stmt_nodes_->BindInt(4, node->pos.z);
-    stmt_nodes_->BindInt(5, node->owner_id);
-    stmt_nodes_->BindInt(6, node->node_id);
-    stmt_nodes_->BindInt(7, node->minegeld);
-    stmt_nodes_->Step();
-    stmt_nodes_->Reset();
-
-    if (!node->inventory.empty()) {
-      for (const auto &list : node->inventory.lists()) {
-        for (const auto &item : list.second.items()) {
-          if (!item.empty()) {
-            stmt_inventory_->BindInt(1, pos_id);
-            stmt_inventory_->BindText(2, list.first);
-            stmt_inventory_->BindText(3, item);
-            stmt_inventory_->Step();
-            stmt_inventory_->Reset();
-          }
-        }
-      }
+  std::vector<DataWriterBatch> batches(
+      std::make_move_iterator(node_queue_.begin()),
+      std::make_move_iterator(node_queue_.end()));
+  node_queue_.clear();
+
+  WriteBatches(shards_.front(), batches);
+  queued_bytes_ = 0;
+}
+
+std::thread DataWriter::StartWriter(size_t shard) {
+  {
+    std::unique_lock<std::mutex> lock(node_mutex_);
+    running_writers_++;
+  }
+  return std::thread(&DataWriter::DataWriterThread, this, shard);
+}
+
+void DataWriter::DataWriterThread(size_t shard) {
+  spdlog::trace("DataWriter::DataWriterThread({0}) entry", shard);
+
+  std::vector<DataWriterBatch> batches;
+  std::unique_lock<std::mutex> lock(node_mutex_);
+  while (true) {
+    node_cv_.wait(lock,
+                  [this]() { return tombstone_ || !node_queue_.empty(); });
+
+    // Tombstone, and everything before it is written?
+    if (node_queue_.empty()) {
+      break;
     }
+
+    // Whatever is queued, up to the transaction size (but at least one).
+    size_t bytes = 0;
+    while (!node_queue_.empty() &&
+           (batches.empty() || (bytes < kMaxTransactionBytes))) {
+      bytes += node_queue_.front().bytes();
+      batches.push_back(std::move(node_queue_.front()));
+      node_queue_.pop_front();
+    }
+
+    lock.unlock();
+    WriteBatches(shards_[shard], batches);
+    lock.lock();
+
+    queued_bytes_ -= bytes;
+    transactions_++;
+    Recycle(&batches);
+    space_cv_.notify_all();
   }
-  database_->Commit();
+  running_writers_--;
+  space_cv_.notify_all();
+
+  spdlog::trace("DataWriter::DataWriterThread({0}) exit", shard);
+}
+
+void DataWriter::MergeShards() {
+  if (shard_filenames_.empty()) {
+    return;
+  }
+
+  // Closes the shards first.
+  shards_.clear();
+  MergeOutputShards(*database_, shard_filenames_, "nodes", "pos_id");
+  MergeOutputShards(*database_, shard_filenames_, "inventory", "");
+  RemoveOutputShards(shard_filenames_);
 }
@@ -4,8 +4,12 @@
 #pragma once
 
 #include <condition_variable>
+#include <deque>
 #include <mutex>
-#include <queue>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include "src/app/actor.h"
 #include "src/app/config.h"
@@ -16,15 +20,61 @@
 #include "src/lib/map_reader/node.h"
 #include "src/lib/map_reader/pos.h"
 
-// Used by consumer to queue up writes to the `nodes` table in the output
-// database.
-struct DataWriterNode {
-  DataWriterNode() : pos(), owner_id(0), node_id(0), minegeld(0) {}
-  NodePos pos;
-  size_t owner_id;
-  size_t node_id;
-  size_t minegeld;
-  Inventory inventory;
+// Used by consumers to queue up writes to the `nodes` table (and the
+// `inventory` rows of each node) in the output database.  Flat: one buffer
+// per kind of row, reused across batches (see `DataWriter::NewBatch()`),
+// instead of one allocation (and deep copied `Inventory`) per node.
+class DataWriterBatch {
+public:
+  struct Node {
+    NodePos pos;
+    uint64_t owner_id;
+    uint64_t node_id;
+    uint64_t minegeld;
+
+    // This node's rows in `items()`.
+    uint32_t first_item;
+    uint32_t item_count;
+  };
+
+  // Offsets and sizes into the batch's text buffer; see `text()`.
+  struct Item {
+    uint32_t type;
+    uint32_t type_size;
+    uint32_t item;
+    uint32_t item_size;
+  };
+
+  DataWriterBatch() : nodes_(), items_(), text_() {}
+
+  void Add(const NodePos &pos, uint64_t owner_id, uint64_t node_id,
+           uint64_t minegeld, const Inventory &inventory);
+
+  const std::vector<Node> &nodes() const { return nodes_; }
+  const std::vector<Item> &items() const { return items_; }
+  std::string_view text(uint32_t offset, uint32_t size) const {
+    return std::string_view(text_).substr(offset, size);
+  }
+
+  bool empty() const { return nodes_.empty(); }
+
+  // Bytes of row data held.
+  size_t bytes() const {
+    return nodes_.size() * sizeof(Node) + items_.size() * sizeof(Item) +
+           text_.size();
+  }
+
+  // Empties the batch, keeping its buffers.
+  void clear() {
+    nodes_.clear();
+    items_.clear();
+    text_.clear();
+  }
+
+private:
+  std::vector<Node> nodes_;
+  std::vector<Item> items_;
+  std::string text_;
 };
 
 class DataWriter {
@@ -34,34 +84,111 @@ public:
              IdMap<ActorIdMapExtraInfo> &actor_id_map);
   ~DataWriter() {}
 
-  void EnqueueNodes(std::vector<std::unique_ptr<DataWriterNode>> &&nodes) {
-    std::unique_lock<std::mutex> lock(node_mutex_);
-    for (auto &i : nodes) {
-      node_queue_.push(std::move(i));
-    }
-    node_cv_.notify_one();
-  }
+  // Returns an empty batch, with recycled buffers if there are any.
+  DataWriterBatch NewBatch();
+
+  // Queues `batch` for writing.  While `DataWriterThread()` runs, blocks as
+  // long as `config_.node_queue_bytes` or more are queued already.
+  void EnqueueNodes(DataWriterBatch &&batch);
 
   void FlushActorIdMap();
 
   void FlushNodeIdMap();
 
+  // Writes whatever is queued, on the calling thread (to the first shard).
   void FlushNodeQueue();
 
-  void DataWriterThread();
+  // Count of `DataWriterThread()`s to run: one per shard (see
+  // `OutputShardCount()`), or one without shards.
+  size_t writers() const { return shards_.size(); }
+
+  // Starts a `DataWriterThread()` for `shard` (which of `writers()` this
+  // is).  It counts as running from here on, so that `EnqueueNodes()` blocks
+  // on a full queue even before the thread gets going.
+  std::thread StartWriter(size_t shard);
+
+  // Merges the shards into the output database, once all writers are done.
+  // Does nothing without shards.
+  void MergeShards();
+
+  void SetTombstone() {
+    std::unique_lock<std::mutex> lock(node_mutex_);
+    tombstone_ = true;
+    node_cv_.notify_all();
+  }
+
+  // Bytes queued (or being written) right now.
+  size_t queued_bytes() const {
+    std::unique_lock<std::mutex> lock(node_mutex_);
+    return queued_bytes_;
+  }
+
+  // Peak of `queued_bytes()`, and count of transactions committed by
+  // `DataWriterThread()`.
+  size_t peak_queued_bytes() const {
+    std::unique_lock<std::mutex> lock(node_mutex_);
+    return peak_queued_bytes_;
+  }
+  uint64_t transactions() const {
+    std::unique_lock<std::mutex> lock(node_mutex_);
+    return transactions_;
+  }
 
 private:
   const Config &config_;
   IdMap<ActorIdMapExtraInfo> &actor_id_map_;
   IdMap<NodeIdMapExtraInfo> &node_id_map_;
 
+  // Where `nodes` and `inventory` rows go: a connection to the output
+  // database, or to one shard file.
+  struct Shard {
+    std::unique_ptr<SqliteDb> database;
+    std::unique_ptr<SqliteMultiInsert> insert_nodes;
+    std::unique_ptr<SqliteMultiInsert> insert_inventory;
+  };
+
   std::unique_ptr<SqliteDb> database_;
   std::unique_ptr<SqliteStmt> stmt_actor_;
   std::unique_ptr<SqliteStmt> stmt_node_;
-  std::unique_ptr<SqliteStmt> stmt_nodes_;
-  std::unique_ptr<SqliteStmt> stmt_inventory_;
+  std::vector<Shard> shards_;
+  std::vector<std::string> shard_filenames_;
+
+  // Max bytes of batches written per transaction by `DataWriterThread()`.
+  static constexpr size_t kMaxTransactionBytes = 32 * 1024 * 1024;
+
+  // Max count of emptied batches kept for reuse.
+  static constexpr size_t kMaxPooledBatches = 64;
+
+  // Rows per multi-row insert statement.
+  static constexpr size_t kRowsPerInsert = 64;
+
+  Shard OpenShard(const std::string &filename, const SqliteOptions &options);
+
+  // Writes the rows of `batches` to `shard` in one transaction, sorted by
+  // `pos_id` so that they land in the `nodes` b-tree in order.
+  void WriteBatches(Shard &shard, const std::vector<DataWriterBatch> &batches);
+
+  // Writes queued batches as they come in, a bounded transaction at a time,
+  // while the consumers run.  Exits once the tombstone is set, and everything
+  // queued before it is written.
+  void DataWriterThread(size_t shard);
+
+  // Returns emptied batches to `pool_`.  Caller holds `node_mutex_`.
+  void Recycle(std::vector<DataWriterBatch> *batches);
+
+  std::deque<DataWriterBatch> node_queue_;
+  std::vector<DataWriterBatch> pool_;
+  size_t queued_bytes_;
+  size_t peak_queued_bytes_;
+  uint64_t transactions_;
+  bool tombstone_;
+
+  // Count of `DataWriterThread()`s there to drain `node_queue_` (counted
+  // from `StartWriter()` until they exit); nobody waits for space without
+  // one.
+  size_t running_writers_;
 
-  std::queue<std::unique_ptr<DataWriterNode>> node_queue_;
   mutable std::mutex node_mutex_;
   std::condition_variable node_cv_;
+  std::condition_variable space_cv_;
 };
@@ -4,7 +4,9 @@
 // Only supports mapblock version 28 and 29.
 // https://github.com/minetest/minetest/blob/master/doc/world_format.txt
 
+#include <errno.h>
 #include <getopt.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <iostream>
@@ -13,6 +15,7 @@
 
 #include "src/app/app.h"
 #include "src/app/config.h"
+#include "src/lib/database/db-map-limiter.h"
 
 static constexpr int OPT_MIN = 257;
 static constexpr int OPT_MAX = 258;
@@ -25,6 +28,24 @@ static constexpr int OPT_PATTERN = 264;
 static constexpr int OPT_RADIUS = 265;
 static constexpr int OPT_STATS = 266;
 static constexpr int OPT_MINEGELD = 267;
+static constexpr int OPT_SCAN = 268;
+static constexpr int OPT_QUEUE_LIMIT = 269;
+static constexpr int OPT_IMMUTABLE = 270;
+static constexpr int OPT_MMAP_SIZE = 271;
+static constexpr int OPT_CACHE_SIZE = 272;
+static constexpr int OPT_READAHEAD = 273;
+static constexpr int OPT_CONNECTIONS = 274;
+static constexpr int OPT_MAX_BYTES_PER_SEC = 275;
+static constexpr int OPT_MAX_BLOCKS_PER_SEC = 276;
+static constexpr int OPT_RATE_CONTROL = 277;
+static constexpr int OPT_PIPELINE = 278;
+static constexpr int OPT_PIN = 279;
+static constexpr int OPT_BULK_LOAD = 280;
+static constexpr int OPT_OUT_SHARDS = 281;
+static constexpr int OPT_MAX_PRESSURE = 282;
+
+// Each output shard is a file and a writer thread (per table group).
+static constexpr unsigned long kMaxOutShards = 256;
 
 static struct option long_options[] = {
     {"help", no_argument, NULL, OPT_HELP},
@@ -38,8 +59,23 @@ static struct option long_options[] = {
     {"radius", required_argument, NULL, OPT_RADIUS},
     {"threads", required_argument, NULL, 't'},
     {"max_load_avg", required_argument, NULL, 'l'},
+    {"max_pressure", required_argument, NULL, OPT_MAX_PRESSURE},
     {"stats", required_argument, NULL, OPT_STATS},
     {"minegeld", no_argument, NULL, OPT_MINEGELD},
+    {"scan", required_argument, NULL, OPT_SCAN},
+    {"queue_limit", required_argument, NULL, OPT_QUEUE_LIMIT},
+    {"immutable", no_argument, NULL, OPT_IMMUTABLE},
+    {"mmap_size", required_argument, NULL, OPT_MMAP_SIZE},
+    {"cache_size", required_argument, NULL, OPT_CACHE_SIZE},
+    {"readahead", required_argument, NULL, OPT_READAHEAD},
+    {"connections", required_argument, NULL, OPT_CONNECTIONS},
+    {"max_bytes_per_sec", required_argument, NULL, OPT_MAX_BYTES_PER_SEC},
+    {"max_blocks_per_sec", required_argument, NULL, OPT_MAX_BLOCKS_PER_SEC},
+    {"rate_control", required_argument, NULL, OPT_RATE_CONTROL},
+    {"pipeline", required_argument, NULL, OPT_PIPELINE},
+    {"pin", no_argument, NULL, OPT_PIN},
+    {"bulk_load", no_argument, NULL, OPT_BULK_LOAD},
+    {"out_shards", required_argument, NULL, OPT_OUT_SHARDS},
     {NULL, 0, NULL, 0}};
 
 void Usage(const char *prog) {
@@ -51,14 +87,31 @@ void Usage(const char *prog) {
       << "  --max   x,y,z    - Max mapblock to examine.\n"
       << "  --pos   x,y,z    - Only mapblock to examine.\n"
       << "  --threads n      - Max count of consumer threads.\n"
-      << "  --max_load_avg n - Max load average to allow.\n"
-      << "  --driver type    - Map reader driver (sqlite or postgresql).\n"
+      << "  --pipeline f,d,a - Fetch, decode and analyze threads, instead.\n"
+      << "  --pin            - Pin threads to NUMA nodes.\n"
+      << "  --max_load_avg n - Max load average to allow (0 = no limit).\n"
+      << "  --max_pressure n - Max % CPU and I/O pressure (0 = no limit).\n"
+      << "  --driver type    - Map reader driver (sqlite, sqlite-direct or\n"
+      << "                     postgresql).\n"
       << "  --map   filename - Path to map.sqlite file (REQUIRED).\n"
       << "  --out   filename - Path to output sqlite file (REQUIRED).\n"
       << "  --pattern filename - Path to node name regex list (optional).\n"
+      << "  --bulk_load      - Fast, crash unsafe writes to the output file.\n"
+      << "  --out_shards n   - Output writer threads, each with a shard file.\n"
       << "  --stats filename - Path to append runtime stats to.\n"
       << "  --radius n       - Mapblock radius to preserve. See README file.\n"
       << "  --minegeld       - Track per-node minegeld amounts.\n"
+      << "  --scan mode      - keys, data, partition or largest.  See README\n"
+      << "                     file.\n"
+      << "  --queue_limit n  - Max mapblocks buffered by the producer.\n"
+      << "  --immutable      - sqlite: Map is not in use, skip all locking.\n"
+      << "  --mmap_size n    - sqlite: Bytes of map to mmap per connection.\n"
+      << "  --cache_size n   - sqlite: Page cache per connection (pragma).\n"
+      << "  --readahead n    - sqlite: Max bytes to read ahead of scans.\n"
+      << "  --connections n  - postgresql: Connections shared by all threads.\n"
+      << "  --max_bytes_per_sec n  - Max mapblock bytes read per second.\n"
+      << "  --max_blocks_per_sec n - Max mapblocks read per second.\n"
+      << "  --rate_control filename - File to re-read the above two from.\n"
       << "";
 }
 
@@ -91,6 +144,10 @@ int main(int argc, char *argv[]) {
         config.max_load_avg = strtod(optarg, NULL);
         break;
 
+      case OPT_MAX_PRESSURE:
+        config.max_pressure = strtod(optarg, NULL);
+        break;
+
       case 't':
         config.threads = strtol(optarg, NULL, 10);
         break;
@@ -126,6 +183,8 @@ int main(int argc, char *argv[]) {
       case OPT_DRIVER:
         if (!strcmp(optarg, "sqlite")) {
           config.driver_type = MapDriverType::SQLITE;
+        } else if (!strcmp(optarg, "sqlite-direct")) {
+          config.driver_type = MapDriverType::SQLITE_DIRECT;
         } else if (!strcmp(optarg, "postgresql") || !strcmp(optarg, "pgsql")) {
           config.driver_type = MapDriverType::POSTGRESQL;
         } else {
@@ -134,6 +193,89 @@ int main(int argc, char *argv[]) {
         }
         break;
 
+      case OPT_SCAN:
+        if (!strcmp(optarg, "keys")) {
+          config.scan_mode = ScanMode::SCAN_KEYS;
+        } else if (!strcmp(optarg, "data")) {
+          config.scan_mode = ScanMode::SCAN_DATA;
+        } else if (!strcmp(optarg, "partition")) {
+          config.scan_mode = ScanMode::SCAN_PARTITION;
+        } else if (!strcmp(optarg, "largest")) {
+          config.scan_mode = ScanMode::SCAN_LARGEST;
+        } else {
+          std::cerr << "ERROR: Invalid scan value: " << optarg << "\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_QUEUE_LIMIT:
+        config.queue_limit = strtoul(optarg, NULL, 10);
+        break;
+
+      case OPT_IMMUTABLE:
+        config.map_options.immutable = true;
+        break;
+
+      case OPT_MMAP_SIZE:
+        config.map_options.mmap_size = strtoll(optarg, NULL, 10);
+        break;
+
+      case OPT_CACHE_SIZE:
+        config.map_options.cache_size = strtoll(optarg, NULL, 10);
+        break;
+
+      case OPT_READAHEAD:
+        config.map_options.readahead = strtoll(optarg, NULL, 10);
+        break;
+
+      case OPT_CONNECTIONS:
+        config.map_options.connections = strtoul(optarg, NULL, 10);
+        break;
+
+      case OPT_PIPELINE:
+        if ((sscanf(optarg, "%zu,%zu,%zu", &config.fetch_threads,
+                    &config.decode_threads, &config.analyze_threads) != 3) ||
+            !config.fetch_threads || !config.decode_threads ||
+            !config.analyze_threads) {
+          std::cerr << "ERROR: Invalid pipeline value: " << optarg << "\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_PIN:
+        config.pin_threads = true;
+        break;
+
+      case OPT_BULK_LOAD:
+        config.bulk_load = true;
+        break;
+
+      case OPT_OUT_SHARDS: {
+        char *end = NULL;
+        errno = 0;
+        const unsigned long shards = strtoul(optarg, &end, 10);
+        if ((end == optarg) || *end || errno || (optarg[0] == '-') ||
+            (shards > kMaxOutShards)) {
+          std::cerr << "ERROR: Invalid out_shards value: " << optarg
+                    << " (0 to " << kMaxOutShards << ")\n";
+          exit(EXIT_FAILURE);
+        }
+        config.out_shards = shards;
+        break;
+      }
+
+      case OPT_MAX_BYTES_PER_SEC:
+        config.max_bytes_per_sec = strtod(optarg, NULL);
+        break;
+
+      case OPT_MAX_BLOCKS_PER_SEC:
+        config.max_blocks_per_sec = strtod(optarg, NULL);
+        break;
+
+      case OPT_RATE_CONTROL:
+        config.rate_control_filename = optarg;
+        break;
+
       case OPT_MAP:
         config.map_filename = optarg;
         break;
@@ -171,6 +313,14 @@ int main(int argc, char *argv[]) {
   }
 
   config.min_pos.sort(&config.max_pos);
+
+  if (config.max_bytes_per_sec || config.max_blocks_per_sec ||
+      !config.rate_control_filename.empty()) {
+    config.map_options.limiter = std::make_shared<MapReadLimiter>();
+    config.map_options.limiter->SetLimits(config.max_bytes_per_sec,
+                                          config.max_blocks_per_sec);
+  }
+
   DebugLogConfig(config);
 
   if (config.map_filename.empty()) {
@@ -185,6 +335,13 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  // Serial runs have no stages to split the work into.
+  if (config.analyze_threads && !config.threads) {
+    std::cerr << "Error: '--pipeline' needs '--threads' of 1 or more.\n";
+    Usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
   // If the output database already exists, we must clear it out.  Currently,
   // we do not support "resuming an aborted analysis", so running twice with
   // the same output database will result in primary key violations.
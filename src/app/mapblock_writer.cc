@@ -1,57 +1,145 @@
+#include <algorithm>
 #include <spdlog/spdlog.h>
-#include <unordered_set>
 
 #include "src/app/mapblock_writer.h"
+#include "src/app/output_shards.h"
 #include "src/app/schema/schema.h"
 
+// Followed by `values` (see `SqliteMultiInsert`).
 static constexpr char kSqlWriteBlock[] = R"sql(
   insert into blocks
     (mapblock_id, mapblock_x, mapblock_y, mapblock_z, uniform, anthropocene,
      preserve)
-  values
-    (:mapblock_id, :mapblock_x, :mapblock_y, :mapblock_z, :uniform,
-     :anthropocene, :preserve)
 )sql";
+static constexpr int kBlockColumns = 7;
 
-struct Hash {
-  size_t operator()(const MapBlockPos &pos) const {
-    return static_cast<size_t>(pos.MapBlockId());
+// Rows per multi-row insert statement.
+static constexpr size_t kRowsPerInsert = 64;
+
+static constexpr char kSqlCreatePreserve[] = R"sql(
+  create temp table preserve (mapblock_id integer primary key)
+)sql";
+
+static constexpr char kSqlWritePreserve[] = R"sql(
+  insert or ignore into temp.preserve (mapblock_id) values (:mapblock_id)
+)sql";
+
+static constexpr char kSqlApplyPreserve[] = R"sql(
+  update blocks set preserve = 1
+  where mapblock_id in (select mapblock_id from temp.preserve)
+)sql";
+
+static constexpr char kSqlDropPreserve[] = R"sql(
+  drop table temp.preserve
+)sql";
+
+// Rows queued between the consumers and `WriterThread()`.
+static constexpr size_t kBlockQueueLimit = 256 * 1024;
+
+MapBlockWriter::MapBlockWriter(const Config &config)
+    : database_(), shards_(), shard_filenames_(),
+      block_queue_(config.threads ? kBlockQueueLimit : 0), rows_written_(0) {
+  const SqliteOptions options = OutputDatabaseOptions(config.bulk_load);
+  VerifySchema(config.out_filename, options);
+
+  database_ = std::make_unique<SqliteDb>(config.out_filename, options);
+
+  for (size_t i = 0; i < OutputShardCount(config); ++i) {
+    shard_filenames_.push_back(
+        OutputShardFilename(config.out_filename, "blocks", i));
+    CreateOutputShard(shard_filenames_.back());
+    shards_.push_back(OpenShard(shard_filenames_.back(), OutputShardOptions()));
   }
-};
+  if (shards_.empty()) {
+    shards_.push_back(OpenShard(config.out_filename, options));
+  }
+}
+
+MapBlockWriter::Shard
+MapBlockWriter::OpenShard(const std::string &filename,
+                          const SqliteOptions &options) {
+  Shard shard;
+  shard.database = std::make_unique<SqliteDb>(filename, options);
+  shard.insert_blocks = std::make_unique<SqliteMultiInsert>(
+      *shard.database.get(), kSqlWriteBlock, kBlockColumns, kRowsPerInsert);
+  return shard;
+}
+
+void MapBlockWriter::WriterThread(size_t shard) {
+  spdlog::trace("MapBlockWriter::WriterThread({0}) enter", shard);
+
+  // Commits are costly (fsync), so batches smaller than a transaction are
+  // collected first.  No transaction is open while waiting for rows.
+  std::vector<MapBlockRow> rows;
+  std::vector<MapBlockRow> popped;
+  rows.reserve(kRowsPerTransaction);
+  while (block_queue_.PopBatch(kRowsPerTransaction, &popped)) {
+    rows.insert(rows.end(), popped.begin(), popped.end());
+    if (rows.size() >= kRowsPerTransaction) {
+      WriteRows(shards_[shard], &rows);
+      rows.clear();
+    }
+  }
+  WriteRows(shards_[shard], &rows);
+
+  spdlog::trace("MapBlockWriter::WriterThread({0}) exit", shard);
+}
 
-MapBlockWriter::MapBlockWriter(const Config &config,
-                               MapBlockHashMap &block_data)
-    : config_(config), block_data_(block_data), stmt_blocks_(), block_queue_(),
-      block_mutex_(), block_cv_() {
-  VerifySchema(config_.out_filename);
+void MapBlockWriter::MergeShards() {
+  if (shard_filenames_.empty()) {
+    return;
+  }
 
-  database_ = std::make_unique<SqliteDb>(config.out_filename);
-  stmt_blocks_ = std::make_unique<SqliteStmt>(*database_.get(), kSqlWriteBlock);
+  // Closes the shards first.
+  shards_.clear();
+  MergeOutputShards(*database_, shard_filenames_, "blocks", "mapblock_id");
+  RemoveOutputShards(shard_filenames_);
 }
 
-void MapBlockWriter::FlushBlockQueue() {
-  spdlog::trace("FlushBlockQueue enter");
+void MapBlockWriter::WriteRows(Shard &shard, std::vector<MapBlockRow> *rows) {
+  if (rows->empty()) {
+    return;
+  }
 
-  std::unique_lock<std::mutex> lock(block_mutex_);
+  // In `mapblock_id` order, so that rows land in the b-tree in order.
+  std::sort(rows->begin(), rows->end(),
+            [](const MapBlockRow &a, const MapBlockRow &b) {
+              return a.pos.MapBlockId() < b.pos.MapBlockId();
+            });
 
-  database_->Begin();
-  while (!block_queue_.empty()) {
-    const MapBlockPos pos = block_queue_.front();
-    block_queue_.pop_front();
+  shard.database->Begin();
+  shard.insert_blocks->Insert(
+      rows->size(), [rows](SqliteStmt &stmt, size_t i, int first) {
+        const MapBlockRow &row = (*rows)[i];
+        stmt.BindInt(first, row.pos.MapBlockId());
+        stmt.BindInt(first + 1, row.pos.x);
+        stmt.BindInt(first + 2, row.pos.y);
+        stmt.BindInt(first + 3, row.pos.z);
+        stmt.BindInt(first + 4, row.uniform);
+        stmt.BindBool(first + 5, row.anthropocene);
+        stmt.BindBool(first + 6, false);
+      });
+  shard.database->Commit();
+  rows_written_ += rows->size();
+}
 
-    const MapBlockData &block = block_data_.Ref(pos);
+void MapBlockWriter::ApplyPreserveFlags(
+    const PreserveQueue::MapBlockPosSet &positions) {
+  spdlog::trace("MapBlockWriter::ApplyPreserveFlags enter");
 
-    stmt_blocks_->BindInt(1, pos.MapBlockId());
-    stmt_blocks_->BindInt(2, pos.x);
-    stmt_blocks_->BindInt(3, pos.y);
-    stmt_blocks_->BindInt(4, pos.z);
-    stmt_blocks_->BindInt(5, block.uniform);
-    stmt_blocks_->BindBool(6, block.anthropocene);
-    stmt_blocks_->BindBool(7, block.preserve);
-    stmt_blocks_->Step();
-    stmt_blocks_->Reset();
+  database_->Exec(kSqlCreatePreserve);
+  {
+    SqliteStmt stmt_preserve(*database_.get(), kSqlWritePreserve);
+    database_->Begin();
+    for (const MapBlockPos &pos : positions) {
+      stmt_preserve.BindInt(1, pos.MapBlockId());
+      stmt_preserve.Step();
+      stmt_preserve.Reset();
+    }
+    database_->Exec(kSqlApplyPreserve);
+    database_->Commit();
   }
-  database_->Commit();
+  database_->Exec(kSqlDropPreserve);
 
-  spdlog::trace("FlushBlockQueue exit");
+  spdlog::trace("MapBlockWriter::ApplyPreserveFlags exit");
 }
@@ -3,45 +3,86 @@
 
 #pragma once
 
-#include <condition_variable>
-#include <mutex>
-#include <queue>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 
-#include "src/app/actor.h"
 #include "src/app/config.h"
-#include "src/app/mapblock_data.h"
+#include "src/app/preserve_queue.h"
 #include "src/lib/database/db-sqlite3.h"
-#include "src/lib/hashmap/hashmap.h"
-#include "src/lib/id_map/id_map.h"
-#include "src/lib/map_reader/inventory.h"
-#include "src/lib/map_reader/mapblock.h"
-#include "src/lib/map_reader/node.h"
 #include "src/lib/map_reader/pos.h"
+#include "src/lib/util/blocking_queue.h"
+
+// One row of the `blocks` table, minus the `preserve` flag (see
+// `MapBlockWriter::ApplyPreserveFlags()`).
+struct MapBlockRow {
+  MapBlockPos pos;
+
+  // If the mapblock is 100% the same content_id, then place that here.
+  // 0 otherwise.
+  uint16_t uniform;
+
+  // Mapblock contains atleast 1 node that is highly likely to have been placed
+  // by a player (and not mapgen).
+  bool anthropocene;
+};
 
 class MapBlockWriter {
 public:
   MapBlockWriter() = delete;
-  MapBlockWriter(const Config &config, MapBlockHashMap &block_data);
+  MapBlockWriter(const Config &config);
   ~MapBlockWriter() {}
 
-  void EnqueueMapBlockPos(const MapBlockPos &pos) {
-    std::unique_lock<std::mutex> lock(block_mutex_);
-    block_queue_.push_back(pos);
-    block_cv_.notify_one();
+  // Blocks while the queue is full (threaded runs only).
+  void EnqueueRows(std::vector<MapBlockRow> &&rows) {
+    block_queue_.Enqueue(std::move(rows));
   }
 
-  // Should only be called AFTER all analysis is done.
-  // Because analyzing one mapblock might update data on its neighbors.
-  void FlushBlockQueue();
+  // Count of `WriterThread()`s to run: one per shard (see
+  // `OutputShardCount()`), or one without shards.
+  size_t writers() const { return shards_.size(); }
+
+  // Writes queued rows to `blocks` as they come in, in transactions of up to
+  // `kRowsPerTransaction` rows, until `SetTombstone()`.  Can be called as a
+  // thread body, or on the main thread once the queue is tombstoned.
+  // `shard` is which of `writers()` this is.
+  void WriterThread(size_t shard);
+
+  // Merges the shards into the output database, once all writers are done.
+  // Does nothing without shards.
+  void MergeShards();
+
+  // No more rows will be enqueued.
+  void SetTombstone() { block_queue_.SetTombstone(); }
+
+  // Sets `preserve` on the written rows in `positions` (others are ignored),
+  // in one set based update.  Only call once `MergeShards()` is done.
+  void ApplyPreserveFlags(const PreserveQueue::MapBlockPosSet &positions);
+
+  uint64_t rows_written() const { return rows_written_; }
 
 private:
-  const Config &config_;
-  MapBlockHashMap &block_data_;
+  static constexpr size_t kRowsPerTransaction = 64 * 1024;
+
+  // Where rows go: a connection to the output database, or to one shard
+  // file.
+  struct Shard {
+    std::unique_ptr<SqliteDb> database;
+    std::unique_ptr<SqliteMultiInsert> insert_blocks;
+  };
+
+  Shard OpenShard(const std::string &filename, const SqliteOptions &options);
+
+  // Sorts `rows` by `mapblock_id`, and writes them to `shard` in one
+  // transaction.
+  void WriteRows(Shard &shard, std::vector<MapBlockRow> *rows);
 
   std::unique_ptr<SqliteDb> database_;
-  std::unique_ptr<SqliteStmt> stmt_blocks_;
+  std::vector<Shard> shards_;
+  std::vector<std::string> shard_filenames_;
 
-  std::deque<MapBlockPos> block_queue_;
-  mutable std::mutex block_mutex_;
-  std::condition_variable block_cv_;
+  BlockingQueue<MapBlockRow> block_queue_;
+  std::atomic<uint64_t> rows_written_;
 };
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+#include "src/app/output_shards.h"
+#include "src/app/schema/schema.h"
+
+// `SQLITE_MAX_ATTACHED` defaults to 10.
+static constexpr size_t kMaxAttached = 8;
+
+size_t OutputShardCount(const Config &config) {
+  return config.threads ? config.out_shards
+                        : std::min<size_t>(config.out_shards, 1);
+}
+
+std::string OutputShardFilename(const std::string &out_filename,
+                                std::string_view kind, size_t shard) {
+  return out_filename + "." + std::string(kind) + "-" + std::to_string(shard);
+}
+
+SqliteOptions OutputShardOptions() {
+  static constexpr int kShardPageSize = 64 * 1024;
+
+  SqliteOptions options;
+  options.bulk_load = true;
+  options.page_size = kShardPageSize;
+  return options;
+}
+
+void CreateOutputShard(const std::string &filename) {
+  std::filesystem::remove(filename);
+  VerifySchema(filename, OutputShardOptions());
+}
+
+void MergeOutputShards(SqliteDb &db, const std::vector<std::string> &shards,
+                       std::string_view table, std::string_view order_by) {
+  const auto start = std::chrono::steady_clock::now();
+
+  for (size_t first = 0; first < shards.size(); first += kMaxAttached) {
+    const size_t count = std::min(kMaxAttached, shards.size() - first);
+
+    std::string select;
+    for (size_t i = 0; i < count; ++i) {
+      const std::string schema = "shard" + std::to_string(i);
+      SqliteStmt attach(db, "attach database ? as " + schema);
+      attach.BindText(1, shards[first + i]);
+      attach.Step();
+
+      if (i) {
+        select += " union all ";
+      }
+      select += "select * from " + schema + "." + std::string(table);
+    }
+    if (!order_by.empty()) {
+      select += " order by " + std::string(order_by);
+    }
+
+    db.Begin();
+    db.Exec("insert into " + std::string(table) + " " + select);
+    db.Commit();
+
+    for (size_t i = 0; i < count; ++i) {
+      db.Exec("detach database shard" + std::to_string(i));
+    }
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  spdlog::info("Merged {0} shards of `{1}` in {2:.2f} seconds.", shards.size(),
+               table, elapsed.count());
+}
+
+void RemoveOutputShards(const std::vector<std::string> &shards) {
+  for (const std::string &filename : shards) {
+    std::filesystem::remove(filename);
+  }
+}
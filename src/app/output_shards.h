@@ -0,0 +1,39 @@
+// Shard files of the output database.  With `Config::out_shards`, each output
+// writer thread writes its rows to a scratch database of its own (so that the
+// writers do not queue up on one file's write lock), and the shards are
+// merged into the output database once the scan is done.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "src/app/config.h"
+#include "src/lib/database/db-sqlite3.h"
+
+// Count of shard files (and writer threads) per output writer, or 0 to write
+// to the output database directly.  Runs without threads use a single shard.
+size_t OutputShardCount(const Config &config);
+
+// `<out_filename>.<kind>-<shard>`, ex: "out.sqlite.nodes-3".
+std::string OutputShardFilename(const std::string &out_filename,
+                                std::string_view kind, size_t shard);
+
+// Options for shard connections.  Shards are rebuilt on every run, so they
+// never need a journal or `fsync()`.
+SqliteOptions OutputShardOptions();
+
+// Creates an empty shard at `filename` (deleting any leftover of an earlier
+// run), with the output database's schema.
+void CreateOutputShard(const std::string &filename);
+
+// Copies `table` from every file in `shards` into `db`.  Each shard's rows are
+// in `order_by` order already (their primary key), so with `order_by` set,
+// sqlite merges the shards (a k-way merge, up to `kMaxAttached` at a time)
+// instead of sorting, and rows are appended to `db`'s b-tree in order.
+void MergeOutputShards(SqliteDb &db, const std::vector<std::string> &shards,
+                       std::string_view table, std::string_view order_by);
+
+// Deletes the files in `shards`.
+void RemoveOutputShards(const std::vector<std::string> &shards);
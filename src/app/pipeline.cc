@@ -0,0 +1,181 @@
+#include <spdlog/spdlog.h>
+
+#include "src/app/app.h"
+#include "src/lib/database/db-map-interface.h"
+#include "src/lib/database/db-sqlite3-btree.h"
+
+// Capacity of the queue in front of each stage.  Parsed mapblocks are larger
+// than their blobs (16 KiB of params each), so the decode -> analyze queue is
+// kept short.
+static constexpr size_t kDecodeQueueLimit = 1024;
+static constexpr size_t kAnalyzeQueueLimit = 64;
+
+// Max count of items each stage takes (and hands on) at once.
+static constexpr size_t kFetchBatchSize = 64;
+static constexpr size_t kDecodeBatchSize = 16;
+static constexpr size_t kAnalyzeBatchSize = 4;
+
+size_t App::RunPipeline(std::vector<std::thread> *threads) {
+  decode_queue_ =
+      std::make_unique<BlockingQueue<FetchedBlock>>(kDecodeQueueLimit);
+  analyze_queue_ =
+      std::make_unique<BlockingQueue<DecodedBlock>>(kAnalyzeQueueLimit);
+  running_fetchers_ = config_.fetch_threads;
+  running_decoders_ = config_.decode_threads;
+
+  spdlog::info("Pipeline: {0} fetch, {1} decode and {2} analyze threads.",
+               config_.fetch_threads, config_.decode_threads,
+               config_.analyze_threads);
+
+  for (size_t i = 0; i < config_.fetch_threads; ++i) {
+    threads->push_back(std::thread(&App::RunFetcher, this, i));
+  }
+  for (size_t i = 0; i < config_.decode_threads; ++i) {
+    threads->push_back(std::thread(&App::RunDecoder, this, i));
+  }
+  for (size_t i = 0; i < config_.analyze_threads; ++i) {
+    threads->push_back(std::thread(&App::RunAnalyzer, this, i));
+  }
+
+  return config_.analyze_threads;
+}
+
+void App::RunFetcher(size_t worker) {
+  spdlog::trace("Fetcher {0} entry", worker);
+  const int node = PinThread(worker, config_.fetch_threads);
+
+  // Only `SCAN_DATA` gets its blobs from the producer.
+  std::unique_ptr<MapInterface> map;
+  if (config_.scan_mode != ScanMode::SCAN_DATA) {
+    map = MapInterface::Create(config_.driver_type, config_.map_filename,
+                               config_.map_options);
+  }
+
+  std::vector<FetchedBlock> fetched;
+  fetched.reserve(kFetchBatchSize);
+  const auto forward = [this, node, &fetched](const MapBlockPos &pos,
+                                              MapInterface::Blob &&data) {
+    fetched.push_back(FetchedBlock{pos, std::move(data), node});
+    if (fetched.size() >= kFetchBatchSize) {
+      decode_queue_->Enqueue(std::move(fetched));
+      fetched.clear();
+      fetched.reserve(kFetchBatchSize);
+    }
+  };
+
+  if (config_.scan_mode == ScanMode::SCAN_PARTITION) {
+    const auto callback = [this, worker, &forward](
+                              int64_t key, const MapBlockPos &pos,
+                              MapInterface::BlobView data) {
+      if (!key_scheduler_->Claim(worker, key)) {
+        return false;
+      }
+      stats_.queued_map_blocks++;
+      forward(pos, MapInterface::Blob(data.begin(), data.end()));
+      return true;
+    };
+
+    try {
+      while (const auto range = key_scheduler_->Next(worker)) {
+        map->ProduceMapBlockData(config_.min_pos, config_.max_pos, *range,
+                                 callback);
+      }
+    } catch (const SqliteBtreeError &err) {
+      // A corrupt map file; still hand on what we have, and tombstone.
+      spdlog::error("Fetcher {0} stopped: {1}", worker, err.what());
+    }
+  } else {
+    std::vector<MapBlockKey> keys;
+    std::vector<MapBlockPos> positions;
+    while (map_block_queue_.PopBatch(kFetchBatchSize, &keys)) {
+      positions.clear();
+      for (MapBlockKey &key : keys) {
+        if (!map) {
+          CountHandoff(producer_node_, node);
+          if (key.data.empty()) {
+            CountEmptyBlob(MapBlockPos(key.pos));
+          } else {
+            forward(MapBlockPos(key.pos), std::move(key.data));
+          }
+        } else {
+          positions.push_back(MapBlockPos(key.pos));
+        }
+      }
+      if (positions.empty()) {
+        continue;
+      }
+
+      const auto loaded = [&](size_t i,
+                              std::optional<MapInterface::Blob> &&blob) {
+        if (!blob) {
+          spdlog::error("Failed to load mapblock {0} {1}", positions[i].str(),
+                        positions[i].MapBlockId());
+          stats_.bad_map_blocks++;
+          return;
+        }
+        forward(positions[i], std::move(blob.value()));
+      };
+      map->LoadMapBlocks(positions, loaded);
+    }
+  }
+
+  if (!fetched.empty()) {
+    decode_queue_->Enqueue(std::move(fetched));
+  }
+  if (!--running_fetchers_) {
+    decode_queue_->SetTombstone();
+  }
+  spdlog::trace("Fetcher {0} exit", worker);
+}
+
+void App::RunDecoder(size_t worker) {
+  spdlog::trace("Decoder {0} entry", worker);
+  const int node = PinThread(worker, config_.decode_threads);
+  ThreadLocalIdMap<NodeIdMapExtraInfo> node_id_cache(node_ids_);
+
+  std::vector<FetchedBlock> fetched;
+  std::vector<DecodedBlock> decoded;
+  decoded.reserve(kDecodeBatchSize);
+  while (decode_queue_->PopBatch(kDecodeBatchSize, &fetched)) {
+    for (FetchedBlock &block : fetched) {
+      CountHandoff(block.node, node);
+      auto mb = std::make_unique<MapBlock>();
+      if (DecodeMapBlock(node_id_cache, block.pos, block.data, mb.get())) {
+        decoded.push_back(DecodedBlock{block.pos, std::move(mb), node});
+      }
+    }
+    if (!decoded.empty()) {
+      analyze_queue_->Enqueue(std::move(decoded));
+      decoded.clear();
+      decoded.reserve(kDecodeBatchSize);
+    }
+  }
+
+  if (!--running_decoders_) {
+    analyze_queue_->SetTombstone();
+  }
+  spdlog::trace("Decoder {0} exit", worker);
+}
+
+void App::RunAnalyzer(size_t worker) {
+  spdlog::trace("Analyzer {0} entry", worker);
+  ConsumerContext ctx(*this, PinThread(worker, config_.analyze_threads));
+
+  consumer_gate_.Enter();
+  std::vector<DecodedBlock> decoded;
+  while (true) {
+    consumer_gate_.Yield();
+    if (!analyze_queue_->PopBatch(kAnalyzeBatchSize, &decoded)) {
+      break;
+    }
+    for (const DecodedBlock &block : decoded) {
+      CountHandoff(block.node, ctx.node);
+      AnalyzeMapBlock(ctx, block.pos, *block.mb);
+    }
+  }
+  consumer_gate_.Leave();
+
+  FlushConsumer(ctx);
+  stats_.finished_consumers++;
+  spdlog::trace("Analyzer {0} exit", worker);
+}
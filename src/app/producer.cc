@@ -1,33 +1,94 @@
+#include <algorithm>
 #include <spdlog/spdlog.h>
 
 #include "src/app/app.h"
 #include "src/lib/database/db-map-interface.h"
+#include "src/lib/database/db-sqlite3-btree.h"
 
 void App::RunProducer() {
   spdlog::trace("Producer entry");
+  producer_node_ = PinThread(0, 1);
   std::unique_ptr<MapInterface> map =
-      MapInterface::Create(config_.driver_type, config_.map_filename);
+      MapInterface::Create(config_.driver_type, config_.map_filename,
+                           config_.map_options);
 
   int64_t count = 0;
   std::vector<MapBlockKey> keys;
   keys.reserve(config_.producer_batch_size);
 
-  const auto callback = [this, &count, &keys](const MapBlockPos &pos) -> bool {
+  const auto enqueue = [this, &count, &keys](MapBlockKey &&key) {
     count++;
     stats_.queued_map_blocks++;
 
-    keys.push_back(MapBlockKey(pos.MapBlockId()));
+    keys.push_back(std::move(key));
     if (keys.size() >= config_.producer_batch_size) {
       map_block_queue_.Enqueue(std::move(keys));
 
       keys.clear();
       keys.reserve(config_.producer_batch_size);
     }
-
-    return true;
   };
 
-  map->ProduceMapBlocks(config_.min_pos, config_.max_pos, callback);
+  // A corrupt map file ends the scan early, but the queue is still
+  // tombstoned, so that consumers finish.
+  try {
+    switch (config_.scan_mode) {
+      case ScanMode::SCAN_KEYS:
+        map->ProduceMapBlocks(config_.min_pos, config_.max_pos,
+                              [&enqueue](const MapBlockPos &pos) -> bool {
+                                enqueue(MapBlockKey(pos.MapBlockId()));
+                                return true;
+                              });
+        break;
+
+      case ScanMode::SCAN_DATA:
+        map->ProduceMapBlockData(
+            config_.min_pos, config_.max_pos,
+            [&enqueue](const MapBlockPos &pos, MapInterface::BlobView data) {
+              // Queued, so it has to be copied out of the backend's buffer.
+              enqueue(MapBlockKey(
+                  pos.MapBlockId(),
+                  MapInterface::Blob(data.begin(), data.end())));
+              return true;
+            });
+        break;
+
+      case ScanMode::SCAN_PARTITION:
+        // Consumers scan the map themselves, see `App::RunPartitionConsumer()`.
+        break;
+
+      case ScanMode::SCAN_LARGEST: {
+        // Longest processing time first: blob size is the cost estimate.
+        // Consumers start on the heaviest mapblocks, and the end of the run is
+        // made of cheap ones that spread evenly over the threads.
+        struct SizedKey {
+          size_t size;
+          int64_t id;
+        };
+        std::vector<SizedKey> sized;
+        map->ProduceMapBlockSizes(
+            config_.min_pos, config_.max_pos,
+            [&sized](const MapBlockPos &pos, size_t size) {
+              sized.push_back(SizedKey{size, pos.MapBlockId()});
+              return true;
+            });
+        spdlog::info("Producer listed {0} mapblocks, largest first.",
+                     sized.size());
+
+        // Ties in map order, so that runs are repeatable.
+        std::stable_sort(sized.begin(), sized.end(),
+                         [](const SizedKey &a, const SizedKey &b) {
+                           return a.size > b.size;
+                         });
+        for (const SizedKey &key : sized) {
+          enqueue(MapBlockKey(key.id));
+        }
+        break;
+      }
+    }
+  } catch (const SqliteBtreeError &err) {
+    spdlog::error("Producer stopped: {0}", err.what());
+  }
 
   if (!keys.empty()) {
     map_block_queue_.Enqueue(std::move(keys));
@@ -9,8 +9,8 @@ from sqlite_schema
 where type='table' and name='actor';
 )sql";
 
-void VerifySchema(const std::string &filename) {
-  SqliteDb db(filename);
+void VerifySchema(const std::string &filename, const SqliteOptions &options) {
+  SqliteDb db(filename, options);
 
   SqliteStmt stmt(db, kSqlCheckSchema);
   stmt.Step();
@@ -26,3 +26,21 @@ void VerifySchema(const std::string &filename) {
   db.Exec(std::string(GetSqlSchema()));
   db.Commit();
 }
+
+SqliteOptions OutputDatabaseOptions(bool bulk_load) {
+  // Long enough to outlast any one transaction of the other writer.
+  static constexpr int kBusyTimeoutMs = 10 * 60 * 1000;
+
+  // Fewer, fuller b-tree pages (and levels) for the large tables.
+  static constexpr int kBulkPageSize = 64 * 1024;
+  static constexpr int64_t kBulkCacheKiB = 256 * 1024;
+
+  SqliteOptions options;
+  options.busy_timeout_ms = kBusyTimeoutMs;
+  if (bulk_load) {
+    options.bulk_load = true;
+    options.page_size = kBulkPageSize;
+    options.cache_size = -kBulkCacheKiB;
+  }
+  return options;
+}
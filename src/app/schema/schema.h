@@ -1,7 +1,10 @@
 #pragma once
 
+#include <string>
 #include <string_view>
 
+#include "src/lib/database/db-sqlite3.h"
+
 extern "C" {
 extern const char _binary____src_app_schema_schema_data_sql_start;
 extern const char _binary____src_app_schema_schema_data_sql_end;
@@ -15,5 +18,13 @@ static inline const std::string_view GetSqlSchema() {
 
 // Attempt to open/create filename as sqlite database.
 // Check if an expected table exists, and if not, run the entire schema
-// script on it.  Dies on exception if this fails.
-void VerifySchema(const std::string &filename);
+// script on it (on a connection opened with `options`, which sets the page
+// size).  Dies on exception if this fails.
+void VerifySchema(const std::string &filename,
+                  const SqliteOptions &options = SqliteOptions());
+
+// Options for the writer connections to the output database.  The
+// `DataWriter` and the `MapBlockWriter` write to it at the same time, so they
+// wait for each other's locks.  `bulk_load` trades crash safety for speed
+// (see `SqliteOptions::bulk_load`), and uses larger pages and caches.
+SqliteOptions OutputDatabaseOptions(bool bulk_load);
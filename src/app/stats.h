@@ -9,7 +9,8 @@
 struct RuntimeStats {
   RuntimeStats()
       : start_time(), flush_time(), end_time(), queued_map_blocks(0),
-        good_map_blocks(0), bad_map_blocks(0), peak_vsize_bytes(0) {}
+        good_map_blocks(0), bad_map_blocks(0), finished_consumers(0),
+        cross_node_map_blocks(0), peak_vsize_bytes(0) {}
 
   // Start of the entire process.
   std::chrono::time_point<std::chrono::steady_clock> start_time;
@@ -29,6 +30,13 @@ struct RuntimeStats {
   // Count of map blocks that failed to parse.
   std::atomic<uint64_t> bad_map_blocks;
 
+  // Count of consumer threads that have exited.
+  std::atomic<size_t> finished_consumers;
+
+  // Count of mapblocks (blobs, or parsed) handed from a thread pinned to one
+  // NUMA node to a thread pinned to another (`Config::pin_threads`).
+  std::atomic<uint64_t> cross_node_map_blocks;
+
   // Peak VSIZE (bytes).
   std::atomic<size_t> peak_vsize_bytes;
 
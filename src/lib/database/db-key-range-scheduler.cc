@@ -0,0 +1,141 @@
+#include <algorithm>
+
+#include "src/lib/database/db-key-range-scheduler.h"
+
+static uint64_t Width(int64_t lo, int64_t hi) {
+  return (lo > hi) ? 0 : static_cast<uint64_t>(hi - lo) + 1;
+}
+
+uint64_t KeyRangeScheduler::Worker::Stealable() const {
+  // A single key left in the range being scanned is not worth splitting; its
+  // owner is on it.
+  const uint64_t active = Width(cursor, hi);
+  if (ranges.empty()) {
+    return (active >= 2) ? active : 0;
+  }
+
+  uint64_t total = active;
+  for (const KeyRange &range : ranges) {
+    total += Width(range.lo, range.hi);
+  }
+  return total;
+}
+
+KeyRangeScheduler::KeyRangeScheduler(const KeyRange &keys, size_t workers,
+                                     size_t ranges_per_worker,
+                                     const std::vector<size_t> &groups)
+    : workers_(), steals_(0), cross_group_steals_(0) {
+  workers = std::max<size_t>(workers, 1);
+  ranges_per_worker = std::max<size_t>(ranges_per_worker, 1);
+
+  workers_.reserve(workers);
+  for (size_t i = 0; i < workers; ++i) {
+    workers_.push_back(
+        std::make_unique<Worker>((i < groups.size()) ? groups[i] : 0));
+  }
+
+  // Deal out neighbouring ranges to the same worker.  With fewer keys than
+  // ranges, some workers start empty (and steal).
+  const std::vector<KeyRange> ranges =
+      MapInterface::SplitKeyRange(keys, workers * ranges_per_worker);
+  const size_t per_worker = (ranges.size() + workers - 1) / workers;
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    workers_[i / per_worker]->ranges.push_back(ranges[i]);
+  }
+}
+
+std::optional<KeyRangeScheduler::KeyRange>
+KeyRangeScheduler::Next(size_t worker) {
+  Worker &self = *workers_.at(worker);
+  {
+    std::unique_lock<std::mutex> lock(self.mutex);
+    self.cursor = 1;
+    self.hi = 0;
+    if (!self.ranges.empty()) {
+      const KeyRange range = self.ranges.front();
+      self.ranges.pop_front();
+      self.cursor = range.lo;
+      self.hi = range.hi;
+      return range;
+    }
+  }
+
+  // Never hold two workers' locks at once: take the work first, then adopt
+  // it.  Nobody steals from us in between, as we have nothing.
+  std::vector<KeyRange> stolen;
+  if (!Steal(worker, &stolen)) {
+    return std::nullopt;
+  }
+
+  std::unique_lock<std::mutex> lock(self.mutex);
+  const KeyRange range = stolen.front();
+  self.cursor = range.lo;
+  self.hi = range.hi;
+  self.ranges.insert(self.ranges.end(), stolen.begin() + 1, stolen.end());
+  return range;
+}
+
+bool KeyRangeScheduler::Claim(size_t worker, int64_t key) {
+  Worker &self = *workers_[worker];
+  std::unique_lock<std::mutex> lock(self.mutex);
+  if (key > self.hi) {
+    return false;
+  }
+  self.cursor = key + 1;
+  return true;
+}
+
+bool KeyRangeScheduler::Steal(size_t thief, std::vector<KeyRange> *ranges) {
+  while (true) {
+    // Pick the worker with the most keys left, from our own group if anyone
+    // there has anything.  It may change before we lock it again, in which
+    // case we just look again.
+    const size_t group = workers_[thief]->group;
+    size_t victim = thief;
+    uint64_t most = 0;
+    bool local = false;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      if (i == thief) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(workers_[i]->mutex);
+      const uint64_t remaining = workers_[i]->Stealable();
+      const bool same = (workers_[i]->group == group);
+      if (!remaining || (local && !same)) {
+        continue;
+      }
+      if ((same && !local) || (remaining > most)) {
+        most = remaining;
+        victim = i;
+        local = same;
+      }
+    }
+
+    if (!most) {
+      return false;
+    }
+
+    Worker &w = *workers_[victim];
+    std::unique_lock<std::mutex> lock(w.mutex);
+    if (!w.ranges.empty()) {
+      // Half of its queue (rounded up), from the far end.
+      const size_t count = (w.ranges.size() + 1) / 2;
+      ranges->assign(w.ranges.end() - count, w.ranges.end());
+      w.ranges.erase(w.ranges.end() - count, w.ranges.end());
+      steals_++;
+      cross_group_steals_ += !local;
+      return true;
+    }
+
+    const uint64_t width = Width(w.cursor, w.hi);
+    if (width >= 2) {
+      // The upper half of what it has not reached yet.
+      const int64_t mid = w.cursor + static_cast<int64_t>(width / 2);
+      ranges->assign(1, KeyRange{mid, w.hi});
+      w.hi = mid - 1;
+      steals_++;
+      cross_group_steals_ += !local;
+      return true;
+    }
+  }
+}
@@ -0,0 +1,86 @@
+// Work stealing scheduler over a `MapInterface` partition key range.
+//
+// The key range is split into `workers * ranges_per_worker` ranges, and each
+// worker gets a deque of `ranges_per_worker` neighbouring ones, so that each
+// thread scans one contiguous slice of the map (warm page cache, mapblocks
+// close together).  A worker that runs out steals from whoever has the most
+// work left: half of its queued ranges, or if it has none, the upper half of
+// the range it is scanning.  Workers report each key as they reach it
+// (`Claim()`), and stop scanning once their range has been cut short.
+//
+// Workers can be put in groups (ex: one per NUMA node), and then steal from
+// their own group while it has anything worth stealing.
+//
+// Requires the scan to visit keys in ascending order (as
+// `MapInterface::ProduceMapBlockData()` does).
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "src/lib/database/db-map-interface.h"
+
+class KeyRangeScheduler {
+public:
+  using KeyRange = MapInterface::KeyRange;
+
+  KeyRangeScheduler() = delete;
+  KeyRangeScheduler(const KeyRangeScheduler &) = delete;
+  KeyRangeScheduler &operator=(const KeyRangeScheduler &) = delete;
+
+  // `groups[worker]` is the group of each worker; all in one if empty.
+  KeyRangeScheduler(const KeyRange &keys, size_t workers,
+                    size_t ranges_per_worker,
+                    const std::vector<size_t> &groups = {});
+
+  size_t workers() const { return workers_.size(); }
+
+  // Returns the next range for `worker` (0 <= worker < `workers()`) to scan,
+  // from its own deque or stolen.  std::nullopt once there is nothing left
+  // to take.  Ends `worker`'s previous range.
+  std::optional<KeyRange> Next(size_t worker);
+
+  // Called by `worker` for each key it reaches in its current range, before
+  // processing it.  Returns `false` if the key was stolen, in which case the
+  // worker must stop scanning the range (and call `Next()`).
+  bool Claim(size_t worker, int64_t key);
+
+  // Count of successful steals so far.
+  uint64_t steals() const { return steals_; }
+
+  // Count of those that took work from another group.
+  uint64_t cross_group_steals() const { return cross_group_steals_; }
+
+private:
+  struct Worker {
+    explicit Worker(size_t group_)
+        : group(group_), mutex(), ranges(), cursor(1), hi(0) {}
+
+    const size_t group;
+
+    std::mutex mutex;
+    std::deque<KeyRange> ranges;
+
+    // Keys of the range being scanned that are not claimed yet.  Empty if
+    // `cursor > hi`.
+    int64_t cursor;
+    int64_t hi;
+
+    // Keys left (queued and being scanned), or 0 if there is nothing worth
+    // stealing.  Caller holds `mutex`.
+    uint64_t Stealable() const;
+  };
+
+  // Takes work from the busiest other worker, into `ranges`.  Returns
+  // `false` if nobody has anything worth stealing.
+  bool Steal(size_t thief, std::vector<KeyRange> *ranges);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<uint64_t> steals_;
+  std::atomic<uint64_t> cross_group_steals_;
+};
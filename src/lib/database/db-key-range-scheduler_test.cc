@@ -0,0 +1,130 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/database/db-key-range-scheduler.h"
+
+using ::testing::Each;
+using ::testing::Eq;
+using ::testing::Gt;
+using ::testing::Optional;
+
+using KeyRange = MapInterface::KeyRange;
+
+MATCHER_P2(IsRange, lo, hi, "") { return (arg.lo == lo) && (arg.hi == hi); }
+
+TEST(KeyRangeScheduler, OwnRangesFirst) {
+  KeyRangeScheduler sched(KeyRange{0, 15}, 2, 2);
+
+  // Worker 0 gets [0, 7], worker 1 gets [8, 15], in order.
+  EXPECT_THAT(sched.Next(0), Optional(IsRange(0, 3)));
+  EXPECT_THAT(sched.Next(1), Optional(IsRange(8, 11)));
+  EXPECT_THAT(sched.Next(0), Optional(IsRange(4, 7)));
+  EXPECT_THAT(sched.steals(), Eq(0));
+}
+
+TEST(KeyRangeScheduler, StealsQueuedRanges) {
+  KeyRangeScheduler sched(KeyRange{0, 39}, 2, 4);
+  EXPECT_THAT(sched.Next(1), Optional(IsRange(20, 24)));
+  for (int i = 0; i < 4; ++i) {
+    sched.Next(0);
+  }
+
+  // Worker 0 is out, worker 1 has 3 queued ranges: take the last 2.
+  EXPECT_THAT(sched.Next(0), Optional(IsRange(30, 34)));
+  EXPECT_THAT(sched.Next(0), Optional(IsRange(35, 39)));
+  EXPECT_THAT(sched.Next(1), Optional(IsRange(25, 29)));
+  EXPECT_THAT(sched.steals(), Eq(1));
+}
+
+TEST(KeyRangeScheduler, SplitsActiveRange) {
+  KeyRangeScheduler sched(KeyRange{0, 99}, 2, 1);
+  EXPECT_THAT(sched.Next(0), Optional(IsRange(0, 49)));
+  EXPECT_THAT(sched.Next(1), Optional(IsRange(50, 99)));
+  EXPECT_TRUE(sched.Claim(1, 50));
+  EXPECT_TRUE(sched.Claim(1, 59));
+
+  // Worker 0 is done, and steals the upper half of [60, 99].
+  EXPECT_THAT(sched.Next(0), Optional(IsRange(80, 99)));
+  EXPECT_TRUE(sched.Claim(1, 79));
+  EXPECT_FALSE(sched.Claim(1, 80));
+
+  // Worker 1 then steals back from worker 0's [80, 99].
+  EXPECT_THAT(sched.Next(1), Optional(IsRange(90, 99)));
+  EXPECT_THAT(sched.steals(), Eq(2));
+
+  // Nothing worth stealing is left once everything is claimed.
+  EXPECT_TRUE(sched.Claim(0, 89));
+  EXPECT_TRUE(sched.Claim(1, 98));
+  EXPECT_THAT(sched.Next(0), Eq(std::nullopt));
+  EXPECT_TRUE(sched.Claim(1, 99));
+  EXPECT_THAT(sched.Next(1), Eq(std::nullopt));
+}
+
+TEST(KeyRangeScheduler, StealsWithinGroupFirst) {
+  KeyRangeScheduler sched(KeyRange{0, 399}, 4, 1, {0, 0, 1, 1});
+  EXPECT_THAT(sched.Next(0), Optional(IsRange(0, 99)));
+  EXPECT_THAT(sched.Next(1), Optional(IsRange(100, 199)));
+  EXPECT_TRUE(sched.Claim(0, 89));
+  EXPECT_TRUE(sched.Claim(1, 199));
+
+  // Workers 2 and 3 have far more left, but worker 0 is in the same group.
+  EXPECT_THAT(sched.Next(1), Optional(IsRange(95, 99)));
+  EXPECT_THAT(sched.cross_group_steals(), Eq(0));
+
+  // Once the group is out of work, it steals from the other one.
+  EXPECT_TRUE(sched.Claim(0, 94));
+  EXPECT_TRUE(sched.Claim(1, 99));
+  EXPECT_THAT(sched.Next(1), Optional(IsRange(200, 299)));
+  EXPECT_THAT(sched.steals(), Eq(2));
+  EXPECT_THAT(sched.cross_group_steals(), Eq(1));
+}
+
+TEST(KeyRangeScheduler, FewerKeysThanRanges) {
+  KeyRangeScheduler sched(KeyRange{5, 6}, 4, 4);
+  EXPECT_THAT(sched.Next(3), Optional(IsRange(5, 5)));
+  EXPECT_THAT(sched.Next(2), Optional(IsRange(6, 6)));
+  EXPECT_THAT(sched.Next(1), Eq(std::nullopt));
+
+  KeyRangeScheduler empty(KeyRange{0, -1}, 2, 4);
+  EXPECT_THAT(empty.Next(0), Eq(std::nullopt));
+}
+
+TEST(KeyRangeScheduler, Threads) {
+  // Sparse keys, and one slow worker, so that there is stealing.
+  static constexpr int kKeys = 200000;
+  static constexpr size_t kWorkers = 4;
+  KeyRangeScheduler sched(KeyRange{0, kKeys - 1}, kWorkers, 4);
+  std::vector<std::atomic<int>> seen(kKeys);
+
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < kWorkers; ++w) {
+    threads.emplace_back([&, w]() {
+      while (const auto range = sched.Next(w)) {
+        for (int64_t key = range->lo; key <= range->hi; ++key) {
+          if (key % 3 == 0) {
+            continue;
+          }
+          if (!sched.Claim(w, key)) {
+            break;
+          }
+          seen[key]++;
+          if (w == 0) {
+            std::this_thread::yield();
+          }
+        }
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  for (int key = 0; key < kKeys; ++key) {
+    ASSERT_THAT(seen[key].load(), Eq((key % 3) ? 1 : 0)) << key;
+  }
+  EXPECT_THAT(sched.steals(), Gt(0));
+}
@@ -1,21 +1,88 @@
+#include <algorithm>
+
 #include "src/lib/database/db-map-interface.h"
+#include "src/lib/database/db-map-limiter.h"
 #include "src/lib/database/db-map-postgresql.h"
+#include "src/lib/database/db-map-sqlite3-direct.h"
 #include "src/lib/database/db-map-sqlite3.h"
 
 std::unique_ptr<MapInterface>
-MapInterface::Create(MapDriverType type, const std::string &connection_str) {
+MapInterface::Create(MapDriverType type, const std::string &connection_str,
+                     const MapOptions &options) {
+  if (options.limiter) {
+    MapOptions unlimited = options;
+    unlimited.limiter.reset();
+    return std::make_unique<MapInterfaceLimited>(
+        Create(type, connection_str, unlimited), options.limiter);
+  }
+
   switch (type) {
     case MapDriverType::SQLITE:
-      return std::make_unique<MapInterfaceSqlite3>(connection_str);
+      return std::make_unique<MapInterfaceSqlite3>(connection_str, options);
     case MapDriverType::POSTGRESQL:
 #if HAS_PQXX
-      return std::make_unique<MapInterfacePostgresql>(connection_str);
+      return std::make_unique<MapInterfacePostgresql>(connection_str, options);
 #else
       throw DatabaseError("Postgresql support not compiled in.");
 #endif
+    case MapDriverType::SQLITE_DIRECT:
+      return std::make_unique<MapInterfaceSqlite3Direct>(connection_str,
+                                                         options);
   }
 
   std::string err("Invalid database driver type: ");
   err += std::to_string(type);
   throw DatabaseError(err);
 }
+
+std::vector<MapInterface::KeyRange>
+MapInterface::SplitKeyRange(const KeyRange &range, size_t parts) {
+  std::vector<KeyRange> ret;
+  if (range.empty() || !parts) {
+    return ret;
+  }
+
+  // Width fits in int64 for every key space we use (mapblock ids are 36 bits).
+  const uint64_t width = range.hi - range.lo + 1;
+  parts = std::min<uint64_t>(parts, width);
+  ret.reserve(parts);
+
+  int64_t lo = range.lo;
+  for (size_t i = 0; i < parts; ++i) {
+    // Spread the remainder over the first `width % parts` ranges.
+    const uint64_t size = width / parts + ((i < width % parts) ? 1 : 0);
+    ret.push_back(KeyRange{lo, static_cast<int64_t>(lo + size - 1)});
+    lo += size;
+  }
+
+  return ret;
+}
+
+std::vector<std::optional<MapInterface::Blob>>
+MapInterface::LoadMapBlocks(std::span<const MapBlockPos> list) {
+  std::vector<std::optional<Blob>> blobs;
+  blobs.reserve(list.size());
+  for (const MapBlockPos &pos : list) {
+    blobs.push_back(LoadMapBlock(pos));
+  }
+  return blobs;
+}
+
+void MapInterface::LoadMapBlocks(
+    std::span<const MapBlockPos> list,
+    std::function<void(size_t, std::optional<Blob> &&)> callback) {
+  std::vector<std::optional<Blob>> blobs = LoadMapBlocks(list);
+  for (size_t i = 0; i < blobs.size(); ++i) {
+    callback(i, std::move(blobs[i]));
+  }
+}
+
+bool MapInterface::ProduceMapBlockData(
+    const MapBlockPos &min, const MapBlockPos &max,
+    std::function<bool(const MapBlockPos &, BlobView)> callback) {
+  return ProduceMapBlockData(
+      min, max, PartitionKeys(min, max),
+      [&callback](int64_t, const MapBlockPos &pos, BlobView data) {
+        return callback(pos, data);
+      });
+}
@@ -6,6 +6,7 @@
 #include <functional>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -14,24 +15,99 @@
 enum MapDriverType {
   SQLITE = 0,
   POSTGRESQL = 1,
+  SQLITE_DIRECT = 2,
+};
+
+class MapReadLimiter;
+
+// Options for opening the input map.  Backends ignore options that do not
+// apply to them.
+struct MapOptions {
+  MapOptions()
+      : read_only(true), immutable(false), mmap_size(0), cache_size(0),
+        readahead(0), connections(0), limiter() {}
+
+  // SQLITE: Open with `mode=ro`, so that we can never take a write lock on a
+  // live server's map.
+  bool read_only;
+
+  // SQLITE: Open with `immutable=1` (implies `read_only`).  Skips all file
+  // locking; only safe if the server is NOT running.
+  bool immutable;
+
+  // SQLITE: `pragma mmap_size` (bytes) for each connection.  0 = disabled.
+  int64_t mmap_size;
+
+  // SQLITE: `pragma cache_size` for each connection.  0 = sqlite default.
+  int64_t cache_size;
+
+  // SQLITE: Open through `SqliteReadaheadVfs`, reading ahead of sequential
+  // scans by up to this many bytes.  0 = disabled.
+  int64_t readahead;
+
+  // POSTGRESQL: Size of the connection pool shared by every instance in the
+  // process.  0 = one private connection per instance.
+  size_t connections;
+
+  // ALL: If set, every mapblock read is charged against this budget, shared
+  // by all instances opened with it (see `MapInterfaceLimited`).
+  std::shared_ptr<MapReadLimiter> limiter;
 };
 
 class MapInterface {
 public:
   using Blob = std::vector<uint8_t>;
 
+  // A `map.data` blob that the backend still owns (ex: sqlite's column
+  // buffer), handed to a callback.  Only valid until the callback returns;
+  // copy it into a `Blob` to keep it.
+  using BlobView = std::span<const uint8_t>;
+
+  // Inclusive range over a backend specific, ordered "partition key", used to
+  // split one scan into several independent range scans.  Empty if `lo > hi`.
+  struct KeyRange {
+    int64_t lo;
+    int64_t hi;
+
+    bool empty() const { return lo > hi; }
+  };
+
+  // Splits `range` into (at most) `parts` contiguous, non-overlapping ranges of
+  // roughly equal width, in order.
+  static std::vector<KeyRange> SplitKeyRange(const KeyRange &range,
+                                             size_t parts);
+
   // Static factory method.
   // Valid driver names are:
   // "sqlite3": sqlite3 backend, connection_string is raw filename.
-  // "postgresql" (not implemented yet).
+  // "postgresql": connection_string is passed to `PQconnectdb()`.
+  // "sqlite-direct": like "sqlite3", but whole-world scans parse the file
+  //   directly (see `MapInterfaceSqlite3Direct`).
+  // Each instance is meant to be used by one thread only.
   static std::unique_ptr<MapInterface>
-  Create(MapDriverType type, const std::string &connection_str);
+  Create(MapDriverType type, const std::string &connection_str,
+         const MapOptions &options = MapOptions());
 
   virtual ~MapInterface() {}
 
   // Returns the raw `map.data` blob, if available, std::nullopt if not.
   virtual std::optional<Blob> LoadMapBlock(const MapBlockPos &pos) = 0;
 
+  // Batched `LoadMapBlock()`: returns one entry per position in `list`, in the
+  // same order, std::nullopt for the ones not found.  Backends override this
+  // to fetch the whole batch with as few statements/round trips as possible;
+  // the default just calls `LoadMapBlock()` for each position.
+  virtual std::vector<std::optional<Blob>>
+  LoadMapBlocks(std::span<const MapBlockPos> list);
+
+  // Streaming `LoadMapBlocks()`: invokes `callback(i, blob)` once for each
+  // `list[i]` (std::nullopt if not found), in any order, as the data arrives.
+  // Lets backends keep requests in flight while the caller processes earlier
+  // results.  The default calls the batched version above.
+  virtual void
+  LoadMapBlocks(std::span<const MapBlockPos> list,
+                std::function<void(size_t, std::optional<Blob> &&)> callback);
+
   // Invoke the callback for each mapblock found between `min` and `max`.
   // Returns `true` after all map blocks are processed AND the `callback`
   // returned true for each map block.  Aborts early on database error and/or
@@ -40,8 +116,44 @@ public:
   ProduceMapBlocks(const MapBlockPos &min, const MapBlockPos &max,
                    std::function<bool(const MapBlockPos &pos)> callback) = 0;
 
+  // Same as `ProduceMapBlocks()`, but also hands the callback the size (in
+  // bytes) of each mapblock's `map.data` blob, without reading the blob where
+  // the backend can help it.  A cheap estimate of the work in a mapblock.
+  virtual bool ProduceMapBlockSizes(
+      const MapBlockPos &min, const MapBlockPos &max,
+      std::function<bool(const MapBlockPos &pos, size_t size)> callback) = 0;
+
+  // Same as `ProduceMapBlocks()`, but also hands the raw `map.data` blob to
+  // the callback, read by the same query.  A full-world pass then becomes one
+  // sequential scan over `blocks`, instead of a key scan followed by one
+  // indexed point lookup (`LoadMapBlock()`) per mapblock.
+  // The blob is not copied, see `BlobView`.
+  bool ProduceMapBlockData(
+      const MapBlockPos &min, const MapBlockPos &max,
+      std::function<bool(const MapBlockPos &pos, BlobView data)> callback);
+
+  // Returns the partition key range that covers every mapblock between `min`
+  // and `max`.
+  virtual KeyRange PartitionKeys(const MapBlockPos &min,
+                                 const MapBlockPos &max) = 0;
+
+  // Same as `ProduceMapBlockData()`, but only for the rows whose partition key
+  // is within `range`, in partition key order.  `range` must come from (or be
+  // a subset of) `PartitionKeys()` called with the same `min` and `max`.
+  // The callback also receives each row's partition key.
+  virtual bool ProduceMapBlockData(
+      const MapBlockPos &min, const MapBlockPos &max, const KeyRange &range,
+      std::function<bool(int64_t key, const MapBlockPos &pos, BlobView data)>
+          callback) = 0;
+
   virtual void DeleteMapBlocks(const std::vector<MapBlockPos> &list) = 0;
 
 protected:
   MapInterface() {}
+
+  // Returns `true` if `min` and `max` cover every possible mapblock.  Backends
+  // may use a cheaper partition key (ex: sqlite rowid) for whole-world scans.
+  static bool IsWholeWorld(const MapBlockPos &min, const MapBlockPos &max) {
+    return (min == MapBlockPos::min()) && (max == MapBlockPos::max());
+  }
 };
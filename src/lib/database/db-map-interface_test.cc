@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <filesystem>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/database/db-map-interface.h"
+#include "src/lib/database/db-map-limiter.h"
+#include "src/lib/database/db-sqlite3.h"
+
+using ::testing::Each;
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::Lt;
+using ::testing::SizeIs;
+
+using KeyRange = MapInterface::KeyRange;
+
+// Relative to the working directory; `rebuild.sh` wipes it.
+static const std::filesystem::path kTestDir = "tmp/test/db-map-interface";
+
+MATCHER_P2(IsRange, lo, hi, "") { return (arg.lo == lo) && (arg.hi == hi); }
+
+TEST(SplitKeyRange, Even) {
+  EXPECT_THAT(MapInterface::SplitKeyRange(KeyRange{0, 11}, 3),
+              ElementsAre(IsRange(0, 3), IsRange(4, 7), IsRange(8, 11)));
+}
+
+TEST(SplitKeyRange, Remainder) {
+  // Extra keys go to the first ranges.
+  EXPECT_THAT(MapInterface::SplitKeyRange(KeyRange{-5, 5}, 3),
+              ElementsAre(IsRange(-5, -2), IsRange(-1, 2), IsRange(3, 5)));
+}
+
+TEST(SplitKeyRange, MorePartsThanKeys) {
+  EXPECT_THAT(MapInterface::SplitKeyRange(KeyRange{7, 8}, 4),
+              ElementsAre(IsRange(7, 7), IsRange(8, 8)));
+}
+
+TEST(SplitKeyRange, Empty) {
+  EXPECT_THAT(MapInterface::SplitKeyRange(KeyRange{0, -1}, 4), IsEmpty());
+  EXPECT_THAT(MapInterface::SplitKeyRange(KeyRange{0, 10}, 0), IsEmpty());
+}
+
+TEST(SplitKeyRange, WholeWorld) {
+  const KeyRange world{MapBlockPos::min().MapBlockId(),
+                       MapBlockPos::max().MapBlockId()};
+  const auto parts = MapInterface::SplitKeyRange(world, 28);
+  ASSERT_THAT(parts, SizeIs(28));
+  EXPECT_THAT(parts.front().lo, Eq(world.lo));
+  EXPECT_THAT(parts.back().hi, Eq(world.hi));
+  for (size_t i = 1; i < parts.size(); ++i) {
+    EXPECT_THAT(parts[i].lo, Eq(parts[i - 1].hi + 1));
+  }
+}
+
+// Every even mapblock id in [-200, 200), data is the id as text.
+static std::string MakeMap(const std::string &name) {
+  std::filesystem::create_directories(kTestDir);
+  const std::string filename = (kTestDir / name).string();
+  std::filesystem::remove(filename);
+
+  SqliteDb db(filename);
+  db.Exec("create table blocks (pos int primary key, data blob)");
+  db.Exec("with recursive n(i) as (select -200 union all select i + 2 "
+          "from n where i < 198) insert into blocks select i, cast(i as "
+          "blob) from n");
+  return filename;
+}
+
+TEST(MapInterfaceSqlite3, LoadMapBlocks) {
+  const std::string filename = MakeMap("load.sqlite");
+  auto map = MapInterface::Create(MapDriverType::SQLITE, filename);
+
+  // More than one statement's worth, half missing, plus a duplicate.
+  std::vector<MapBlockPos> list;
+  for (int64_t id = 149; id >= -150; --id) {
+    list.push_back(MapBlockPos(id));
+  }
+  list.push_back(MapBlockPos(42));
+
+  const auto blobs = map->LoadMapBlocks(list);
+  ASSERT_THAT(blobs, SizeIs(list.size()));
+  for (size_t i = 0; i < list.size(); ++i) {
+    EXPECT_THAT(blobs[i], Eq(map->LoadMapBlock(list[i])));
+    EXPECT_THAT(blobs[i].has_value(), Eq(list[i].MapBlockId() % 2 == 0));
+  }
+
+  // Streaming: each index exactly once, with the same result.
+  std::vector<int> seen(list.size(), 0);
+  map->LoadMapBlocks(list,
+                     [&](size_t i, std::optional<MapInterface::Blob> &&blob) {
+                       ASSERT_THAT(i, Lt(list.size()));
+                       ++seen[i];
+                       EXPECT_THAT(blob, Eq(blobs[i]));
+                     });
+  EXPECT_THAT(seen, Each(Eq(1)));
+
+  EXPECT_THAT(map->LoadMapBlocks({}), IsEmpty());
+}
+
+TEST(MapInterfaceLimited, ChargesReads) {
+  MapOptions options;
+  options.limiter = std::make_shared<MapReadLimiter>();
+  auto map = MapInterface::Create(MapDriverType::SQLITE,
+                                  MakeMap("limited.sqlite"), options);
+  const MapReadLimiter &limiter = *options.limiter;
+
+  // Key scans are free.
+  int count = 0;
+  map->ProduceMapBlocks(MapBlockPos::min(), MapBlockPos::max(),
+                        [&](const MapBlockPos &) { return ++count; });
+  EXPECT_THAT(count, Eq(200));
+  EXPECT_THAT(limiter.blocks_read(), Eq(0));
+
+  // Blobs are the ids as text, "-200" .. "198".
+  map->ProduceMapBlockData(MapBlockPos::min(), MapBlockPos::max(),
+                           [](const MapBlockPos &, MapInterface::BlobView) {
+                             return true;
+                           });
+  EXPECT_THAT(limiter.blocks_read(), Eq(200));
+  EXPECT_THAT(limiter.bytes_read(), Eq(592));
+
+  // Missing mapblocks count as reads, but not as bytes.
+  const std::vector<MapBlockPos> list{MapBlockPos(-200), MapBlockPos(1),
+                                      MapBlockPos(42)};
+  EXPECT_THAT(map->LoadMapBlocks(list), SizeIs(3));
+  map->LoadMapBlocks(list, [](size_t, std::optional<MapInterface::Blob> &&) {});
+  EXPECT_THAT(map->LoadMapBlock(MapBlockPos(1)), Eq(std::nullopt));
+  EXPECT_THAT(limiter.blocks_read(), Eq(207));
+  EXPECT_THAT(limiter.bytes_read(), Eq(604));
+}
+
+TEST(MapInterface, ProduceMapBlockSizes) {
+  const std::string filename = MakeMap("sizes.sqlite");
+  for (const MapDriverType type :
+       {MapDriverType::SQLITE, MapDriverType::SQLITE_DIRECT}) {
+    auto map = MapInterface::Create(type, filename);
+
+    // Blobs are the ids as text.
+    size_t count = 0;
+    size_t total = 0;
+    map->ProduceMapBlockSizes(
+        MapBlockPos::min(), MapBlockPos::max(),
+        [&](const MapBlockPos &pos, size_t size) {
+          EXPECT_THAT(size, Eq(std::to_string(pos.MapBlockId()).size()));
+          ++count;
+          total += size;
+          return true;
+        });
+    EXPECT_THAT(count, Eq(200));
+    EXPECT_THAT(total, Eq(592));
+
+    // `max` is exclusive.  Stops early when the callback says so.
+    std::vector<int64_t> ids;
+    map->ProduceMapBlockSizes(MapBlockPos(-10, 0, 0), MapBlockPos(11, 1, 1),
+                              [&](const MapBlockPos &pos, size_t) {
+                                ids.push_back(pos.MapBlockId());
+                                return ids.size() < 3;
+                              });
+    EXPECT_THAT(ids, ElementsAre(-10, -8, -6));
+  }
+}
+
+TEST(MapInterfaceSqlite3, PartitionScanIsOrdered) {
+  // Inserted in descending order, so rowid order is the reverse of `pos`.
+  std::filesystem::create_directories(kTestDir);
+  const std::string filename = (kTestDir / "ordered.sqlite").string();
+  std::filesystem::remove(filename);
+  {
+    SqliteDb db(filename);
+    db.Exec("create table blocks (pos int primary key, data blob)");
+    db.Exec("with recursive n(i) as (select 100 union all select i - 1 "
+            "from n where i > -100) insert into blocks select i, x'00' "
+            "from n");
+  }
+
+  // `KeyRangeScheduler::Claim()` relies on keys in ascending order.
+  auto map = MapInterface::Create(MapDriverType::SQLITE, filename);
+  const MapBlockPos min(-50, 0, 0);
+  const MapBlockPos max(51, 1, 1);
+  std::vector<int64_t> keys;
+  map->ProduceMapBlockData(min, max, map->PartitionKeys(min, max),
+                           [&](int64_t key, const MapBlockPos &,
+                               MapInterface::BlobView) {
+                             keys.push_back(key);
+                             return true;
+                           });
+  EXPECT_THAT(keys, SizeIs(101));
+  EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+}
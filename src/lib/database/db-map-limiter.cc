@@ -0,0 +1,77 @@
+#include "src/lib/database/db-map-limiter.h"
+
+void MapReadLimiter::SetLimits(double bytes_per_sec, double blocks_per_sec) {
+  bytes_.SetRate(bytes_per_sec, bytes_per_sec * kBurstSeconds);
+  blocks_.SetRate(blocks_per_sec, blocks_per_sec * kBurstSeconds);
+}
+
+std::optional<MapInterface::Blob>
+MapInterfaceLimited::LoadMapBlock(const MapBlockPos &pos) {
+  limiter_->AcquireBlocks(1);
+  std::optional<Blob> blob = map_->LoadMapBlock(pos);
+  if (blob) {
+    limiter_->AcquireBytes(blob->size());
+  }
+  return blob;
+}
+
+std::vector<std::optional<MapInterface::Blob>>
+MapInterfaceLimited::LoadMapBlocks(std::span<const MapBlockPos> list) {
+  limiter_->AcquireBlocks(list.size());
+  std::vector<std::optional<Blob>> blobs = map_->LoadMapBlocks(list);
+
+  size_t size = 0;
+  for (const std::optional<Blob> &blob : blobs) {
+    size += blob ? blob->size() : 0;
+  }
+  limiter_->AcquireBytes(size);
+  return blobs;
+}
+
+void MapInterfaceLimited::LoadMapBlocks(
+    std::span<const MapBlockPos> list,
+    std::function<void(size_t, std::optional<Blob> &&)> callback) {
+  limiter_->AcquireBlocks(list.size());
+  map_->LoadMapBlocks(list, [this, &callback](size_t i,
+                                              std::optional<Blob> &&blob) {
+    if (blob) {
+      limiter_->AcquireBytes(blob->size());
+    }
+    callback(i, std::move(blob));
+  });
+}
+
+bool MapInterfaceLimited::ProduceMapBlocks(
+    const MapBlockPos &min, const MapBlockPos &max,
+    std::function<bool(const MapBlockPos &)> callback) {
+  return map_->ProduceMapBlocks(min, max, std::move(callback));
+}
+
+bool MapInterfaceLimited::ProduceMapBlockSizes(
+    const MapBlockPos &min, const MapBlockPos &max,
+    std::function<bool(const MapBlockPos &, size_t)> callback) {
+  return map_->ProduceMapBlockSizes(min, max, std::move(callback));
+}
+
+MapInterface::KeyRange
+MapInterfaceLimited::PartitionKeys(const MapBlockPos &min,
+                                   const MapBlockPos &max) {
+  return map_->PartitionKeys(min, max);
+}
+
+bool MapInterfaceLimited::ProduceMapBlockData(
+    const MapBlockPos &min, const MapBlockPos &max, const KeyRange &range,
+    std::function<bool(int64_t, const MapBlockPos &, BlobView)> callback) {
+  return map_->ProduceMapBlockData(
+      min, max, range,
+      [this, &callback](int64_t key, const MapBlockPos &pos, BlobView data) {
+        limiter_->AcquireBlocks(1);
+        limiter_->AcquireBytes(data.size());
+        return callback(key, pos, data);
+      });
+}
+
+void MapInterfaceLimited::DeleteMapBlocks(
+    const std::vector<MapBlockPos> &list) {
+  map_->DeleteMapBlocks(list);
+}
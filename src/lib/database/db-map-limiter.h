@@ -0,0 +1,91 @@
+// Read budget for the input map, so that a scan of a live server's map does
+// not starve the server of disk bandwidth.
+//
+// One `MapReadLimiter` is shared by every `MapInterface` in the process (via
+// `MapOptions::limiter`); `MapInterface::Create()` then wraps each backend in
+// a `MapInterfaceLimited`, which charges every mapblock read against it.
+
+#pragma once
+
+#include <memory>
+
+#include "src/lib/database/db-map-interface.h"
+#include "src/lib/util/rate_limiter.h"
+
+class MapReadLimiter {
+public:
+  MapReadLimiter() : bytes_(), blocks_() {}
+
+  // Sets both limits (0 = unlimited).  Safe to call at any time, from any
+  // thread.
+  void SetLimits(double bytes_per_sec, double blocks_per_sec);
+
+  double bytes_per_sec() const { return bytes_.rate(); }
+  double blocks_per_sec() const { return blocks_.rate(); }
+
+  // Charges `count` mapblocks, sleeping while over budget.
+  void AcquireBlocks(size_t count) { blocks_.Acquire(count); }
+
+  // Charges `size` bytes of mapblock data, sleeping while over budget.  Blob
+  // sizes are only known once read, so this is charged after the fact.
+  void AcquireBytes(size_t size) { bytes_.Acquire(size); }
+
+  // Totals charged so far.
+  uint64_t bytes_read() const { return bytes_.taken(); }
+  uint64_t blocks_read() const { return blocks_.taken(); }
+
+private:
+  // Lets each bucket bank this much of its per second rate, so that short
+  // bursts (ex: one batch of mapblocks) do not sleep.
+  static constexpr double kBurstSeconds = 0.25;
+
+  TokenBucket bytes_;
+  TokenBucket blocks_;
+};
+
+// Forwards everything to `map`, charging each mapblock read to `limiter`.
+// Key-only scans (`ProduceMapBlocks()`, `ProduceMapBlockSizes()`) are not
+// charged: each of those mapblocks is charged when it gets loaded.
+class MapInterfaceLimited : public MapInterface {
+public:
+  MapInterfaceLimited() = delete;
+
+  MapInterfaceLimited(std::unique_ptr<MapInterface> map,
+                      std::shared_ptr<MapReadLimiter> limiter)
+      : map_(std::move(map)), limiter_(std::move(limiter)) {}
+  virtual ~MapInterfaceLimited() {}
+
+  std::optional<Blob> LoadMapBlock(const MapBlockPos &pos) override;
+
+  std::vector<std::optional<Blob>>
+  LoadMapBlocks(std::span<const MapBlockPos> list) override;
+
+  void LoadMapBlocks(
+      std::span<const MapBlockPos> list,
+      std::function<void(size_t, std::optional<Blob> &&)> callback) override;
+
+  bool
+  ProduceMapBlocks(const MapBlockPos &min, const MapBlockPos &max,
+                   std::function<bool(const MapBlockPos &)> callback) override;
+
+  bool ProduceMapBlockSizes(
+      const MapBlockPos &min, const MapBlockPos &max,
+      std::function<bool(const MapBlockPos &, size_t)> callback) override;
+
+  // Un-hide the convenience overload from `MapInterface`.
+  using MapInterface::ProduceMapBlockData;
+
+  KeyRange PartitionKeys(const MapBlockPos &min,
+                         const MapBlockPos &max) override;
+
+  bool ProduceMapBlockData(
+      const MapBlockPos &min, const MapBlockPos &max, const KeyRange &range,
+      std::function<bool(int64_t, const MapBlockPos &, BlobView)> callback)
+      override;
+
+  void DeleteMapBlocks(const std::vector<MapBlockPos> &list) override;
+
+private:
+  std::unique_ptr<MapInterface> map_;
+  std::shared_ptr<MapReadLimiter> limiter_;
+};
@@ -1,14 +1,13 @@
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
+
 #include "src/lib/database/db-map-postgresql.h"
 #include "src/lib/exceptions/exceptions.h"
 
-static constexpr char kStmtProduceMapBlocks[] = "produceMapBlocks";
-static constexpr char kSqlProduceMapBlocks[] = R"sql(
-select posx, posy, posz
-from blocks
-where (posx between $1 and $2)
-  and (posy between $3 and $4)
-  and (posz between $5 and $6)
-)sql";
+// Rows pulled from a server-side cursor per round trip.
+static constexpr int kBlockKeyFetchSize = 16384;
+static constexpr int kBlockDataFetchSize = 1024;
 
 static constexpr char kStmtLoadMapBlock[] = "loadMapBlock";
 static constexpr char kSqlLoadMapBlock[] = R"sql(
@@ -17,57 +16,360 @@ from blocks
 where (posx = $1) and (posy = $2) and (posz = $3)
 )sql";
 
-MapInterfacePostgresql::MapInterfacePostgresql(
-    const std::string &connection_str)
-    : pqxx_url_(connection_str), connection_() {
-  connection_ = std::make_unique<pqxx::connection>(connection_str);
+// Neither the keys nor the blobs of an entire world can be materialized
+// client side, so these queries are only ever ran through a server-side
+// cursor.  Bounds are integers, so they are formatted into the query text
+// directly.
+static constexpr char kCursorBlockKeys[] = "block_keys";
+static constexpr char kSqlSelectBlockKeys[] = R"sql(
+select posx, posy, posz
+from blocks
+)sql";
+
+// `octet_length()` of a TOASTed value is read from its TOAST pointer, without
+// fetching (or decompressing) the value itself.
+static constexpr char kCursorBlockSizes[] = "block_sizes";
+static constexpr char kSqlSelectBlockSizes[] = R"sql(
+select posx, posy, posz, octet_length(data)
+from blocks
+)sql";
+
+static constexpr char kCursorBlockData[] = "block_data";
+static constexpr char kSqlSelectBlockData[] = R"sql(
+select posx, posy, posz, data
+from blocks
+)sql";
 
-  connection_->prepare(kStmtProduceMapBlocks, kSqlProduceMapBlocks);
-  connection_->prepare(kStmtLoadMapBlock, kSqlLoadMapBlock);
+static std::string FetchForward(const std::string_view &cursor, int count) {
+  return "fetch forward " + std::to_string(count) + " from " +
+         std::string(cursor);
 }
 
-std::optional<MapInterface::Blob>
-MapInterfacePostgresql::LoadMapBlock(const MapBlockPos &pos) {
-  pqxx::work xact(*connection_, __FUNCTION__);
-  const auto result =
-      xact.exec_prepared(kStmtLoadMapBlock, pos.x, pos.y, pos.z);
-  if (result.empty()) {
-    return std::nullopt; // block not found.
+// The primary key is (posx, posy, posz), so a batch is passed as three
+// parallel arrays, joined against the table.  Pipelined queries can not bind
+// parameters, so the (integer) arrays are inlined as literals.
+static std::string LoadMapBlocksQuery(std::span<const MapBlockPos> list) {
+  std::stringstream xs, ys, zs;
+  for (size_t i = 0; i < list.size(); ++i) {
+    const char *sep = i ? "," : "";
+    xs << sep << list[i].x;
+    ys << sep << list[i].y;
+    zs << sep << list[i].z;
   }
 
+  std::stringstream ss;
+  ss << "select b.posx, b.posy, b.posz, b.data"
+     << " from unnest('{" << xs.str() << "}'::int[], '{" << ys.str()
+     << "}'::int[], '{" << zs.str() << "}'::int[]) as k(x, y, z)"
+     << " join blocks b on (b.posx = k.x) and (b.posy = k.y)"
+     << " and (b.posz = k.z)";
+  return ss.str();
+}
+
+// Unescapes a `bytea` field.
+static pqxx::binarystring FieldToBinary(const pqxx::field &field) {
 #if (PQXX_VERSION_MAJOR * 100 + PQXX_VERSION_MINOR) >= 704
   // "binary_string" is deprecated.
   // Need to port to use 'std::basic_string<std::byte>'.
-  const pqxx::binarystring bin = result[0][0].as<pqxx::binarystring>();
-  const uint8_t *data = static_cast<const uint8_t *>(bin.data());
-  const size_t size = bin.size();
+  return field.as<pqxx::binarystring>();
 #else
   // Ubuntu 22.04 still uses libpqxx-6.4.
-  const pqxx::binarystring bin(result[0][0]);
+  return pqxx::binarystring(field);
+#endif
+}
+
+static MapInterface::Blob FieldToBlob(const pqxx::field &field) {
+  const pqxx::binarystring bin = FieldToBinary(field);
   const uint8_t *data = static_cast<const uint8_t *>(bin.data());
   const size_t size = bin.size();
-#endif
 
-  return std::vector<uint8_t>(data, data + size);
+  return MapInterface::Blob(data, data + size);
+}
+
+// `posx` is the partition key, and the leading column of the primary key, so
+// ordering by it is just an index scan.
+static std::string DeclareCursor(const std::string_view &cursor,
+                                 const std::string_view &select,
+                                 const MapBlockPos &min, const MapBlockPos &max,
+                                 const MapInterface::KeyRange &range) {
+  std::stringstream ss;
+  ss << "declare " << cursor << " no scroll cursor for " << select
+     << "where (posx between " << range.lo << " and " << range.hi << ")"
+     << " and (posy between " << min.y << " and " << max.y << ")"
+     << " and (posz between " << min.z << " and " << max.z << ")"
+     << " order by posx";
+  return ss.str();
+}
+
+PostgresqlConnectionPool::PostgresqlConnectionPool(
+    const std::string &connection_str, size_t size)
+    : connection_str_(connection_str), size_(std::max<size_t>(size, 1)),
+      mutex_(), cv_(), idle_(), open_(0) {}
+
+// static
+std::shared_ptr<PostgresqlConnectionPool>
+PostgresqlConnectionPool::Shared(const std::string &connection_str,
+                                 size_t size) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string,
+                            std::weak_ptr<PostgresqlConnectionPool>>
+      pools;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  std::shared_ptr<PostgresqlConnectionPool> pool =
+      pools[connection_str].lock();
+  if (!pool) {
+    pool = std::make_shared<PostgresqlConnectionPool>(connection_str, size);
+    pools[connection_str] = pool;
+  }
+  return pool;
+}
+
+PostgresqlConnectionPool::Lease PostgresqlConnectionPool::Acquire() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this]() { return !idle_.empty() || (open_ < size_); });
+
+  if (!idle_.empty()) {
+    std::unique_ptr<pqxx::connection> connection = std::move(idle_.back());
+    idle_.pop_back();
+    return Lease(this, std::move(connection));
+  }
+
+  // Connect outside the lock, other threads may return connections.
+  ++open_;
+  lock.unlock();
+  try {
+    auto connection = std::make_unique<pqxx::connection>(connection_str_);
+    connection->prepare(kStmtLoadMapBlock, kSqlLoadMapBlock);
+    return Lease(this, std::move(connection));
+  } catch (...) {
+    lock.lock();
+    --open_;
+    cv_.notify_one();
+    throw;
+  }
+}
+
+void PostgresqlConnectionPool::Release(
+    std::unique_ptr<pqxx::connection> connection) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (connection->is_open()) {
+    idle_.push_back(std::move(connection));
+  } else {
+    // Broken; let the next `Acquire()` open a fresh one.
+    --open_;
+  }
+  cv_.notify_one();
+}
+
+PostgresqlConnectionPool::Lease::~Lease() {
+  if (connection_) {
+    pool_->Release(std::move(connection_));
+  }
+}
+
+MapInterfacePostgresql::MapInterfacePostgresql(
+    const std::string &connection_str, const MapOptions &options)
+    : pqxx_url_(connection_str), pool_(), scan_pool_() {
+  if (options.connections) {
+    pool_ = PostgresqlConnectionPool::Shared(connection_str,
+                                             options.connections);
+    // Only connects if a key scan is made.
+    scan_pool_ = std::make_shared<PostgresqlConnectionPool>(connection_str, 1);
+  } else {
+    pool_ = std::make_shared<PostgresqlConnectionPool>(connection_str, 1);
+    scan_pool_ = pool_;
+    // Connect now, so that a bad connection string fails early.
+    pool_->Acquire();
+  }
+}
+
+std::optional<MapInterface::Blob>
+MapInterfacePostgresql::LoadMapBlock(const MapBlockPos &pos) {
+  PostgresqlConnectionPool::Lease connection = pool_->Acquire();
+  pqxx::work xact(*connection, __FUNCTION__);
+  const auto result =
+      xact.exec_prepared(kStmtLoadMapBlock, pos.x, pos.y, pos.z);
+  if (result.empty()) {
+    return std::nullopt; // block not found.
+  }
+
+  return FieldToBlob(result[0][0]);
+}
+
+std::vector<std::optional<MapInterface::Blob>>
+MapInterfacePostgresql::LoadMapBlocks(std::span<const MapBlockPos> list) {
+  std::vector<std::optional<Blob>> blobs(list.size());
+  LoadMapBlocks(list, [&blobs](size_t i, std::optional<Blob> &&blob) {
+    blobs[i] = std::move(blob);
+  });
+  return blobs;
+}
+
+void MapInterfacePostgresql::LoadMapBlocks(
+    std::span<const MapBlockPos> list,
+    std::function<void(size_t, std::optional<Blob> &&)> callback) {
+  if (list.empty()) {
+    return;
+  }
+
+  // One query per chunk of `list`.  `pqxx::pipeline` sends a query as soon
+  // as it is inserted, if none is pending (else it holds it back, and sends
+  // everything held back in one batch later).  So the next chunk is inserted
+  // right after the current one's results are in: the server works on it
+  // while we (and `callback`) process the current one.
+  PostgresqlConnectionPool::Lease connection = pool_->Acquire();
+  pqxx::work xact(*connection, __FUNCTION__);
+  pqxx::pipeline pipe(xact);
+
+  const size_t chunks = (list.size() + kLoadChunkSize - 1) / kLoadChunkSize;
+  const auto insert = [&](size_t chunk) {
+    const size_t start = chunk * kLoadChunkSize;
+    return pipe.insert(LoadMapBlocksQuery(
+        list.subspan(start, std::min(kLoadChunkSize, list.size() - start))));
+  };
+
+  // mapblock id -> index into `list`, for the current chunk.
+  std::unordered_multimap<int64_t, size_t> index;
+  index.reserve(kLoadChunkSize);
+
+  pqxx::pipeline::query_id query = insert(0);
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    const pqxx::result result = pipe.retrieve(query);
+    if (chunk + 1 < chunks) {
+      query = insert(chunk + 1);
+    }
+
+    const size_t start = chunk * kLoadChunkSize;
+    const size_t end = std::min(start + kLoadChunkSize, list.size());
+    index.clear();
+    for (size_t i = start; i < end; ++i) {
+      index.emplace(list[i].MapBlockId(), i);
+    }
+
+    for (const auto &row : result) {
+      const MapBlockPos pos(row[0].as<int>(), row[1].as<int>(),
+                            row[2].as<int>());
+      const auto range = index.equal_range(pos.MapBlockId());
+      for (auto it = range.first; it != range.second; ++it) {
+        callback(it->second, FieldToBlob(row[3]));
+      }
+      index.erase(range.first, range.second);
+    }
+
+    // Whatever is left was not found.
+    for (const auto &missing : index) {
+      callback(missing.second, std::nullopt);
+    }
+  }
 }
 
 bool MapInterfacePostgresql::ProduceMapBlocks(
     const MapBlockPos &min, const MapBlockPos &max,
     std::function<bool(const MapBlockPos &)> callback) {
-  pqxx::work xact(*connection_, __FUNCTION__);
-  const auto result = xact.exec_prepared(kStmtProduceMapBlocks, min.x, max.x,
-                                         min.y, max.y, min.z, max.z);
-  for (const auto &row : result) {
-    const int x = row["posx"].as<int64_t>();
-    const int y = row["posy"].as<int64_t>();
-    const int z = row["posz"].as<int64_t>();
-
-    MapBlockPos pos(x, y, z);
-    if (!pos.inside(min, max)) {
-      continue;
+  // Held for the whole scan; the cursor lives in this transaction.
+  PostgresqlConnectionPool::Lease connection = scan_pool_->Acquire();
+  pqxx::work xact(*connection, __FUNCTION__);
+  xact.exec(DeclareCursor(kCursorBlockKeys, kSqlSelectBlockKeys, min, max,
+                          PartitionKeys(min, max)));
+
+  const std::string fetch = FetchForward(kCursorBlockKeys, kBlockKeyFetchSize);
+
+  while (true) {
+    const pqxx::result result = xact.exec(fetch);
+    if (result.empty()) {
+      break;
     }
-    if (!callback(pos)) {
-      return false;
+
+    for (const auto &row : result) {
+      const int x = row[0].as<int64_t>();
+      const int y = row[1].as<int64_t>();
+      const int z = row[2].as<int64_t>();
+
+      MapBlockPos pos(x, y, z);
+      if (!pos.inside(min, max)) {
+        continue;
+      }
+      if (!callback(pos)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool MapInterfacePostgresql::ProduceMapBlockSizes(
+    const MapBlockPos &min, const MapBlockPos &max,
+    std::function<bool(const MapBlockPos &, size_t)> callback) {
+  // Held for the whole scan; the cursor lives in this transaction.
+  PostgresqlConnectionPool::Lease connection = scan_pool_->Acquire();
+  pqxx::work xact(*connection, __FUNCTION__);
+  xact.exec(DeclareCursor(kCursorBlockSizes, kSqlSelectBlockSizes, min, max,
+                          PartitionKeys(min, max)));
+
+  const std::string fetch =
+      FetchForward(kCursorBlockSizes, kBlockKeyFetchSize);
+
+  while (true) {
+    const pqxx::result result = xact.exec(fetch);
+    if (result.empty()) {
+      break;
+    }
+
+    for (const auto &row : result) {
+      MapBlockPos pos(row[0].as<int64_t>(), row[1].as<int64_t>(),
+                      row[2].as<int64_t>());
+      if (!pos.inside(min, max)) {
+        continue;
+      }
+      if (!callback(pos, row[3].as<int64_t>())) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+MapInterface::KeyRange
+MapInterfacePostgresql::PartitionKeys(const MapBlockPos &min,
+                                      const MapBlockPos &max) {
+  return KeyRange{min.x, max.x};
+}
+
+bool MapInterfacePostgresql::ProduceMapBlockData(
+    const MapBlockPos &min, const MapBlockPos &max, const KeyRange &range,
+    std::function<bool(int64_t, const MapBlockPos &, BlobView)> callback) {
+  // Held for the whole scan; the cursor lives in this transaction.
+  PostgresqlConnectionPool::Lease connection = pool_->Acquire();
+  pqxx::work xact(*connection, __FUNCTION__);
+  xact.exec(
+      DeclareCursor(kCursorBlockData, kSqlSelectBlockData, min, max, range));
+
+  const std::string fetch = FetchForward(kCursorBlockData, kBlockDataFetchSize);
+
+  while (true) {
+    const pqxx::result result = xact.exec(fetch);
+    if (result.empty()) {
+      break;
+    }
+
+    for (const auto &row : result) {
+      const int x = row[0].as<int64_t>();
+      const int y = row[1].as<int64_t>();
+      const int z = row[2].as<int64_t>();
+
+      MapBlockPos pos(x, y, z);
+      if (!pos.inside(min, max)) {
+        continue;
+      }
+      const pqxx::binarystring bin = FieldToBinary(row[3]);
+      if (!callback(x, pos,
+                    BlobView(static_cast<const uint8_t *>(bin.data()),
+                             bin.size()))) {
+        return false;
+      }
     }
   }
 
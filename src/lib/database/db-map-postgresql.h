@@ -4,25 +4,120 @@
 
 #include <pqxx/pqxx>
 
+#include <condition_variable>
+#include <mutex>
+
 #include "src/lib/database/db-map-interface.h"
 
+// A bounded set of connections to one server, shared by several
+// `MapInterfacePostgresql` instances (and threads).  Connections are opened
+// on demand, up to `size`, and are leased for one operation at a time.
+class PostgresqlConnectionPool {
+public:
+  // A connection, returned to its pool on destruction.
+  class Lease {
+  public:
+    Lease() = delete;
+    Lease(const Lease &) = delete;
+    Lease(Lease &&) = default;
+    ~Lease();
+
+    pqxx::connection &operator*() { return *connection_; }
+    pqxx::connection *operator->() { return connection_.get(); }
+
+  private:
+    friend class PostgresqlConnectionPool;
+    Lease(PostgresqlConnectionPool *pool,
+          std::unique_ptr<pqxx::connection> connection)
+        : pool_(pool), connection_(std::move(connection)) {}
+
+    PostgresqlConnectionPool *pool_;
+    std::unique_ptr<pqxx::connection> connection_;
+  };
+
+  PostgresqlConnectionPool() = delete;
+  PostgresqlConnectionPool(const std::string &connection_str, size_t size);
+
+  // Returns the process wide pool for `connection_str`, creating it (with
+  // `size` connections) if no live pool exists yet.
+  static std::shared_ptr<PostgresqlConnectionPool>
+  Shared(const std::string &connection_str, size_t size);
+
+  // Blocks while all `size` connections are leased.  A caller must never hold
+  // more than one lease from the same pool, or it can deadlock.
+  Lease Acquire();
+
+  size_t size() const { return size_; }
+
+private:
+  void Release(std::unique_ptr<pqxx::connection> connection);
+
+  const std::string connection_str_;
+  const size_t size_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::unique_ptr<pqxx::connection>> idle_;
+
+  // Count of open connections, idle or leased.
+  size_t open_;
+};
+
 class MapInterfacePostgresql : public MapInterface {
 public:
+  // Positions per `LoadMapBlocks()` query.
+  static constexpr size_t kLoadChunkSize = 16;
+
   MapInterfacePostgresql() = delete;
-  explicit MapInterfacePostgresql(const std::string &connection_str);
+
+  // Uses the shared pool for `connection_str` if `options.connections` is
+  // set, else a private connection.
+  explicit MapInterfacePostgresql(const std::string &connection_str,
+                                  const MapOptions &options = MapOptions());
   virtual ~MapInterfacePostgresql() {}
 
   std::optional<Blob> LoadMapBlock(const MapBlockPos &pos) override;
 
+  std::vector<std::optional<Blob>>
+  LoadMapBlocks(std::span<const MapBlockPos> list) override;
+
+  // Pipelined: the next chunk of `list` is on the wire while the current one
+  // is processed.
+  void LoadMapBlocks(
+      std::span<const MapBlockPos> list,
+      std::function<void(size_t, std::optional<Blob> &&)> callback) override;
+
   bool
   ProduceMapBlocks(const MapBlockPos &min, const MapBlockPos &max,
                    std::function<bool(const MapBlockPos &)> callback) override;
 
+  bool ProduceMapBlockSizes(
+      const MapBlockPos &min, const MapBlockPos &max,
+      std::function<bool(const MapBlockPos &, size_t)> callback) override;
+
+  // Un-hide the convenience overload from `MapInterface`.
+  using MapInterface::ProduceMapBlockData;
+
+  KeyRange PartitionKeys(const MapBlockPos &min,
+                         const MapBlockPos &max) override;
+
+  bool ProduceMapBlockData(
+      const MapBlockPos &min, const MapBlockPos &max, const KeyRange &range,
+      std::function<bool(int64_t, const MapBlockPos &, BlobView)> callback)
+      override;
+
   void DeleteMapBlocks(const std::vector<MapBlockPos> &list) override;
 
 protected:
   std::string pqxx_url_;
-  std::unique_ptr<pqxx::connection> connection_;
+  std::shared_ptr<PostgresqlConnectionPool> pool_;
+
+  // Key scans (`ProduceMapBlocks()`, `ProduceMapBlockSizes()`) lease from
+  // here instead: a private connection, outside of a shared `pool_`.  Their
+  // caller (the producer) blocks on a full queue while holding the scan, and
+  // the consumers that drain that queue lease from `pool_`.  Same as `pool_`
+  // if that is private anyway.
+  std::shared_ptr<PostgresqlConnectionPool> scan_pool_;
 };
 
 #endif
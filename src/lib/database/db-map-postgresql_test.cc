@@ -0,0 +1,102 @@
+#if HAS_PQXX
+
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <thread>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/database/db-map-postgresql.h"
+#include "src/lib/util/blocking_queue.h"
+
+using ::testing::Eq;
+
+// Connection string of a scratch database, whose `blocks` table the tests
+// replace.  Skipped if not set.
+static const char *TestDatabase() { return getenv("MAP_ANALYZER_TEST_PG"); }
+
+static void MakeMap(const std::string &connection_str) {
+  pqxx::connection connection(connection_str);
+  pqxx::work xact(connection);
+  xact.exec("drop table if exists blocks");
+  xact.exec("create table blocks (posx int, posy int, posz int, data bytea, "
+            "primary key (posx, posy, posz))");
+  xact.exec("insert into blocks select x, 0, 0, '\\x00' "
+            "from generate_series(-50, 49) as x");
+  xact.commit();
+}
+
+// The producer holds its key scan open while it blocks on a full queue.  The
+// consumer draining that queue must still get a connection from a pool of
+// one.
+TEST(MapInterfacePostgresql, KeyScanDoesNotStarvePool) {
+  if (!TestDatabase()) {
+    GTEST_SKIP() << "MAP_ANALYZER_TEST_PG not set";
+  }
+  MakeMap(TestDatabase());
+
+  MapOptions options;
+  options.connections = 1;
+  MapInterfacePostgresql producer_map(TestDatabase(), options);
+  MapInterfacePostgresql consumer_map(TestDatabase(), options);
+
+  BlockingQueue<MapBlockPos> queue(1);
+  std::thread producer([&]() {
+    producer_map.ProduceMapBlocks(MapBlockPos::min(), MapBlockPos::max(),
+                                  [&](const MapBlockPos &pos) {
+                                    queue.Enqueue(MapBlockPos(pos));
+                                    return true;
+                                  });
+    queue.SetTombstone();
+  });
+
+  auto consumer = std::async(std::launch::async, [&]() {
+    size_t found = 0;
+    std::vector<MapBlockPos> batch;
+    while (queue.PopBatch(1, &batch)) {
+      found += consumer_map.LoadMapBlock(batch.front()).has_value();
+    }
+    return found;
+  });
+
+  if (consumer.wait_for(std::chrono::seconds(30)) !=
+      std::future_status::ready) {
+    // Deadlocked: neither thread can ever be joined.
+    ADD_FAILURE() << "Consumer starved of connections";
+    std::_Exit(EXIT_FAILURE);
+  }
+  EXPECT_THAT(consumer.get(), Eq(100));
+  producer.join();
+}
+
+// Many more chunks than a single query, some positions missing, and some
+// repeated across chunks.
+TEST(MapInterfacePostgresql, LoadMapBlocksManyChunks) {
+  if (!TestDatabase()) {
+    GTEST_SKIP() << "MAP_ANALYZER_TEST_PG not set";
+  }
+  MakeMap(TestDatabase());
+
+  std::vector<MapBlockPos> list;
+  for (int x = -70; x < 70; ++x) {
+    list.push_back(MapBlockPos(x, 0, 0));
+  }
+  list.push_back(MapBlockPos(0, 0, 0));
+  list.push_back(MapBlockPos(-70, 0, 0));
+  ASSERT_GT(list.size(), MapInterfacePostgresql::kLoadChunkSize * 8);
+
+  MapInterfacePostgresql map(TestDatabase());
+  const auto blobs = map.LoadMapBlocks(list);
+  ASSERT_THAT(blobs.size(), Eq(list.size()));
+  for (size_t i = 0; i < list.size(); ++i) {
+    const bool expected = (list[i].x >= -50) && (list[i].x < 50);
+    EXPECT_THAT(blobs[i].has_value(), Eq(expected)) << list[i].str();
+    if (blobs[i]) {
+      EXPECT_THAT(blobs[i].value(), Eq(MapInterface::Blob{0}));
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include <spdlog/spdlog.h>
+
+#include "src/lib/database/db-map-sqlite3-direct.h"
+#include "src/lib/exceptions/exceptions.h"
+
+MapInterfaceSqlite3Direct::MapInterfaceSqlite3Direct(
+    std::string_view connection_str, const MapOptions &options)
+    : connection_str_(connection_str), options_(options),
+      file_(connection_str_), root_(file_.FindTable("blocks")), columns_(),
+      fallback_() {}
+
+MapInterfaceSqlite3 *MapInterfaceSqlite3Direct::Fallback() {
+  if (!fallback_) {
+    fallback_ =
+        std::make_unique<MapInterfaceSqlite3>(connection_str_, options_);
+  }
+  return fallback_.get();
+}
+
+std::optional<MapBlockPos>
+MapInterfaceSqlite3Direct::DecodeBlock(const SqliteBtreeFile::Row &row,
+                                       SqliteBtreeFile::Column *data) {
+  file_.DecodeRecord(row, &columns_);
+
+  // A missing, NULL or non-blob `data` is handed on empty, so that consumers
+  // count it as a bad mapblock, as they do with `MapInterfaceSqlite3`.
+  if ((columns_.size() >= 2) && columns_[1].IsBlob()) {
+    *data = columns_[1];
+  } else {
+    *data = SqliteBtreeFile::Column{0, nullptr, 0};
+  }
+
+  // Minetest declares `pos INT PRIMARY KEY`, stored in the record.  If a map
+  // declared `pos INTEGER PRIMARY KEY` instead, `pos` is the rowid, and the
+  // record holds a NULL.
+  if (columns_.empty() || columns_[0].IsNull()) {
+    return MapBlockPos(row.rowid);
+  }
+  if (!columns_[0].IsInt()) {
+    spdlog::warn("{0}: skipping `blocks` row with a non-integer `pos`, "
+                 "rowid {1}",
+                 connection_str_, row.rowid);
+    return std::nullopt;
+  }
+
+  // Integers are at most 8 bytes, and always fit on the leaf page.
+  if (!row.IsLocal(columns_[0])) {
+    throw SqliteBtreeError(connection_str_,
+                           "`pos` not on the leaf page, rowid " +
+                               std::to_string(row.rowid));
+  }
+  return MapBlockPos(columns_[0].Int64());
+}
+
+std::optional<MapInterface::Blob>
+MapInterfaceSqlite3Direct::LoadMapBlock(const MapBlockPos &pos) {
+  return Fallback()->LoadMapBlock(pos);
+}
+
+std::vector<std::optional<MapInterface::Blob>>
+MapInterfaceSqlite3Direct::LoadMapBlocks(std::span<const MapBlockPos> list) {
+  return Fallback()->LoadMapBlocks(list);
+}
+
+void MapInterfaceSqlite3Direct::DeleteMapBlocks(
+    const std::vector<MapBlockPos> &list) {
+  throw UnimplementedError("MapInterfaceSqlite3Direct::DeleteMapBlocks");
+}
+
+bool MapInterfaceSqlite3Direct::ProduceMapBlocks(
+    const MapBlockPos &min, const MapBlockPos &max,
+    std::function<bool(const MapBlockPos &)> callback) {
+  if (!IsWholeWorld(min, max)) {
+    return Fallback()->ProduceMapBlocks(min, max, callback);
+  }
+
+  // Only the keys: the blobs' overflow pages are never read.
+  const auto rowids = file_.RowidRange(root_);
+  SqliteBtreeFile::Column data;
+  return file_.ScanTable(
+      root_, rowids.first, rowids.second,
+      [&](const SqliteBtreeFile::Row &row) {
+        // Like `MapInterfaceSqlite3`, skip rows outside of the world.
+        const auto pos = DecodeBlock(row, &data);
+        if (!pos || !pos->inside(min, max)) {
+          return true;
+        }
+        return callback(*pos);
+      },
+      true);
+}
+
+bool MapInterfaceSqlite3Direct::ProduceMapBlockSizes(
+    const MapBlockPos &min, const MapBlockPos &max,
+    std::function<bool(const MapBlockPos &, size_t)> callback) {
+  if (!IsWholeWorld(min, max)) {
+    return Fallback()->ProduceMapBlockSizes(min, max, callback);
+  }
+
+  // The blob's size is in the record header, on the leaf page.
+  const auto rowids = file_.RowidRange(root_);
+  SqliteBtreeFile::Column data;
+  return file_.ScanTable(
+      root_, rowids.first, rowids.second,
+      [&](const SqliteBtreeFile::Row &row) {
+        const auto pos = DecodeBlock(row, &data);
+        if (!pos || !pos->inside(min, max)) {
+          return true;
+        }
+        return callback(*pos, data.size);
+      },
+      true);
+}
+
+MapInterface::KeyRange
+MapInterfaceSqlite3Direct::PartitionKeys(const MapBlockPos &min,
+                                         const MapBlockPos &max) {
+  if (!IsWholeWorld(min, max)) {
+    return Fallback()->PartitionKeys(min, max);
+  }
+
+  // Same partition key as `MapInterfaceSqlite3`: the rowid.
+  const auto rowids = file_.RowidRange(root_);
+  return KeyRange{rowids.first, rowids.second};
+}
+
+bool MapInterfaceSqlite3Direct::ProduceMapBlockData(
+    const MapBlockPos &min, const MapBlockPos &max, const KeyRange &range,
+    std::function<bool(int64_t, const MapBlockPos &, BlobView)> callback) {
+  if (!IsWholeWorld(min, max)) {
+    return Fallback()->ProduceMapBlockData(min, max, range, callback);
+  }
+
+  SqliteBtreeFile::Column data;
+  return file_.ScanTable(
+      root_, range.lo, range.hi, [&](const SqliteBtreeFile::Row &row) {
+        const auto pos = DecodeBlock(row, &data);
+        if (!pos || !pos->inside(min, max)) {
+          return true;
+        }
+        return callback(row.rowid, *pos, BlobView(data.data, data.size));
+      });
+}
@@ -0,0 +1,71 @@
+// `class MapInterface` for sqlite3 maps, that walks the `blocks` table's
+// b-tree pages directly (see `SqliteBtreeFile`) for whole-world scans, and
+// falls back to `MapInterfaceSqlite3` for everything else.
+//
+// Skips the sqlite3 VM, statement stepping and the intermediate blob copy.
+// Only safe if nothing writes to the map while we read it (see
+// `SqliteBtreeFile`).
+
+#pragma once
+
+#include "src/lib/database/db-map-interface.h"
+#include "src/lib/database/db-map-sqlite3.h"
+#include "src/lib/database/db-sqlite3-btree.h"
+
+class MapInterfaceSqlite3Direct : public MapInterface {
+public:
+  MapInterfaceSqlite3Direct() = delete;
+
+  explicit MapInterfaceSqlite3Direct(std::string_view connection_str,
+                                     const MapOptions &options = MapOptions());
+  virtual ~MapInterfaceSqlite3Direct() {}
+
+  std::optional<Blob> LoadMapBlock(const MapBlockPos &pos) override;
+
+  std::vector<std::optional<Blob>>
+  LoadMapBlocks(std::span<const MapBlockPos> list) override;
+
+  // Un-hide the streaming overload from `MapInterface`.
+  using MapInterface::LoadMapBlocks;
+
+  bool
+  ProduceMapBlocks(const MapBlockPos &min, const MapBlockPos &max,
+                   std::function<bool(const MapBlockPos &)> callback) override;
+
+  bool ProduceMapBlockSizes(
+      const MapBlockPos &min, const MapBlockPos &max,
+      std::function<bool(const MapBlockPos &, size_t)> callback) override;
+
+  // Un-hide the convenience overload from `MapInterface`.
+  using MapInterface::ProduceMapBlockData;
+
+  KeyRange PartitionKeys(const MapBlockPos &min,
+                         const MapBlockPos &max) override;
+
+  bool ProduceMapBlockData(
+      const MapBlockPos &min, const MapBlockPos &max, const KeyRange &range,
+      std::function<bool(int64_t, const MapBlockPos &, BlobView)> callback)
+      override;
+
+  void DeleteMapBlocks(const std::vector<MapBlockPos> &list) override;
+
+protected:
+  // Decodes a `blocks` row: (pos INT PRIMARY KEY, data BLOB).  Returns the
+  // position, and sets `data` to the blob inside the row's payload (only its
+  // size, if the row was scanned `local_only`), or to an empty column if the
+  // row has no blob.  Returns nullopt for rows to skip (a non-integer `pos`),
+  // and throws `SqliteBtreeError` only if the file is corrupt.
+  std::optional<MapBlockPos> DecodeBlock(const SqliteBtreeFile::Row &row,
+                                         SqliteBtreeFile::Column *data);
+
+  // Point lookups need the `pos` index, and sub-box scans are faster through
+  // it too.  Opened on first use.
+  MapInterfaceSqlite3 *Fallback();
+
+  std::string connection_str_;
+  MapOptions options_;
+  SqliteBtreeFile file_;
+  uint32_t root_;
+  std::vector<SqliteBtreeFile::Column> columns_;
+  std::unique_ptr<MapInterfaceSqlite3> fallback_;
+};
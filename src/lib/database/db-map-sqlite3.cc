@@ -1,28 +1,101 @@
+#include <algorithm>
+#include <unordered_map>
+
 #include "src/lib/database/db-map-sqlite3.h"
+#include "src/lib/database/db-sqlite3-vfs.h"
 #include "src/lib/exceptions/exceptions.h"
 
 static constexpr char kSqlLoadBlock[] = R"sql(
 select data from blocks where pos = :pos
 )sql";
 
+// Followed by `kLoadBatchSize` comma separated parameters, and ")".
+static constexpr char kSqlLoadBlocksPrefix[] = R"sql(
+select pos, data from blocks where pos in (
+)sql";
+
+// Scans are in partition key order (see `ProduceMapBlockData()`).  `pos` is
+// not the rowid, so this has to be asked for, but it is free with the index.
 static constexpr char kSqlListBlocks[] = R"sql(
 select pos
 from blocks
 where pos between :min_pos and :max_pos
+order by pos
+)sql";
+
+// `length()` of a blob is read from the record header, the blob itself (and
+// its overflow pages) is not loaded.
+static constexpr char kSqlListBlockSizes[] = R"sql(
+select pos, length(data)
+from blocks
+where pos between :min_pos and :max_pos
+order by pos
+)sql";
+
+// Minetest declares `pos INT PRIMARY KEY`, which is NOT an alias for the
+// rowid.  Selecting by a `pos` range walks the autoindex and then probes the
+// table b-tree once per row.  So for a whole-world pass, the partition key is
+// the rowid, and walking the table itself is a sequential read of the file.
+// If the caller asked for a subset of the world, the partition key is `pos`
+// (mapblock id), so that the index can skip everything else.
+static constexpr char kSqlRowidRange[] = R"sql(
+select coalesce(min(rowid), 0), coalesce(max(rowid), -1) from blocks
+)sql";
+
+static constexpr char kSqlScanBlockDataByRowid[] = R"sql(
+select rowid, pos, data
+from blocks
+where rowid between :lo and :hi
+order by rowid
+)sql";
+
+static constexpr char kSqlScanBlockDataByPos[] = R"sql(
+select pos, pos, data
+from blocks
+where pos between :lo and :hi
+order by pos
 )sql";
 
 static constexpr char kSqlDeleteBlock[] = R"sql(
 delete from blocks where pos = :pos
 )sql";
 
-MapInterfaceSqlite3::MapInterfaceSqlite3(std::string_view connection_str)
-    : db_(), stmt_load_block_(), stmt_list_blocks_(), stmt_delete_block_() {
-  db_ = std::make_unique<SqliteDb>(connection_str);
+MapInterfaceSqlite3::MapInterfaceSqlite3(std::string_view connection_str,
+                                         const MapOptions &options)
+    : db_(), stmt_load_block_(), stmt_load_blocks_(), stmt_list_blocks_(),
+      stmt_list_block_sizes_(), stmt_rowid_range_(),
+      stmt_scan_by_rowid_(), stmt_scan_by_pos_(), stmt_delete_block_() {
+  SqliteOptions sqlite_options;
+  sqlite_options.read_only = options.read_only || options.immutable;
+  sqlite_options.immutable = options.immutable;
+  sqlite_options.no_mutex = true; // See `MapInterface::Create()`.
+  sqlite_options.mmap_size = options.mmap_size;
+  sqlite_options.cache_size = options.cache_size;
+  if (options.readahead) {
+    sqlite_options.vfs = SqliteReadaheadVfs::Register(options.readahead);
+  }
+
+  db_ = std::make_unique<SqliteDb>(connection_str, sqlite_options);
 
   stmt_load_block_ = std::make_unique<SqliteStmt>(*db_.get(), kSqlLoadBlock);
+
+  std::string load_blocks(kSqlLoadBlocksPrefix);
+  for (size_t i = 0; i < kLoadBatchSize; ++i) {
+    load_blocks += i ? ",?" : "?";
+  }
+  load_blocks += ")";
+  stmt_load_blocks_ = std::make_unique<SqliteStmt>(*db_.get(), load_blocks);
+
   stmt_delete_block_ =
       std::make_unique<SqliteStmt>(*db_.get(), kSqlDeleteBlock);
   stmt_list_blocks_ = std::make_unique<SqliteStmt>(*db_.get(), kSqlListBlocks);
+  stmt_list_block_sizes_ =
+      std::make_unique<SqliteStmt>(*db_.get(), kSqlListBlockSizes);
+  stmt_rowid_range_ = std::make_unique<SqliteStmt>(*db_.get(), kSqlRowidRange);
+  stmt_scan_by_rowid_ =
+      std::make_unique<SqliteStmt>(*db_.get(), kSqlScanBlockDataByRowid);
+  stmt_scan_by_pos_ =
+      std::make_unique<SqliteStmt>(*db_.get(), kSqlScanBlockDataByPos);
 }
 
 std::optional<MapInterface::Blob>
@@ -39,6 +112,38 @@ MapInterfaceSqlite3::LoadMapBlock(const MapBlockPos &pos) {
   return blob;
 }
 
+std::vector<std::optional<MapInterface::Blob>>
+MapInterfaceSqlite3::LoadMapBlocks(std::span<const MapBlockPos> list) {
+  std::vector<std::optional<Blob>> blobs(list.size());
+
+  // mapblock id -> index into `list` (and `blobs`).
+  std::unordered_multimap<int64_t, size_t> index;
+  index.reserve(kLoadBatchSize);
+
+  for (size_t start = 0; start < list.size(); start += kLoadBatchSize) {
+    const size_t count = std::min(kLoadBatchSize, list.size() - start);
+
+    index.clear();
+    for (size_t i = 0; i < count; ++i) {
+      index.emplace(list[start + i].MapBlockId(), start + i);
+    }
+    for (size_t i = 0; i < kLoadBatchSize; ++i) {
+      const MapBlockPos &pos = list[start + std::min(i, count - 1)];
+      stmt_load_blocks_->BindInt(i + 1, pos.MapBlockId());
+    }
+
+    while (stmt_load_blocks_->Step()) {
+      const auto range = index.equal_range(stmt_load_blocks_->ColumnInt64(0));
+      for (auto it = range.first; it != range.second; ++it) {
+        blobs[it->second] = stmt_load_blocks_->ColumnBlob(1);
+      }
+    }
+    stmt_load_blocks_->Reset();
+  }
+
+  return blobs;
+}
+
 void MapInterfaceSqlite3::DeleteMapBlocks(
     const std::vector<MapBlockPos> &list) {
   throw UnimplementedError("MapInterfaceSqlite3::DeleteMapBlocks");
@@ -47,22 +152,110 @@ void MapInterfaceSqlite3::DeleteMapBlocks(
 bool MapInterfaceSqlite3::ProduceMapBlocks(
     const MapBlockPos &min, const MapBlockPos &max,
     std::function<bool(const MapBlockPos &)> callback) {
+  for (const MapBlockIdRange &ids : MapBlockIdRanges(min, max, kMaxIdRanges)) {
+    stmt_list_blocks_->BindInt(1, ids.lo);
+    stmt_list_blocks_->BindInt(2, ids.hi);
+
+    while (stmt_list_blocks_->Step()) {
+      const MapBlockPos pos(stmt_list_blocks_->ColumnInt64(0));
+
+      // Coarse (slab) ranges also cover ids outside of the box.
+      if (!pos.inside(min, max)) {
+        continue;
+      }
+
+      if (!callback(pos)) {
+        stmt_list_blocks_->Reset();
+        return false;
+      }
+    }
 
-  stmt_list_blocks_->BindInt(1, min.MapBlockId());
-  stmt_list_blocks_->BindInt(2, max.MapBlockId());
+    stmt_list_blocks_->Reset();
+  }
 
-  while (stmt_list_blocks_->Step()) {
-    const MapBlockPos pos(stmt_list_blocks_->ColumnInt64(0));
+  return true;
+}
+
+bool MapInterfaceSqlite3::ProduceMapBlockSizes(
+    const MapBlockPos &min, const MapBlockPos &max,
+    std::function<bool(const MapBlockPos &, size_t)> callback) {
+  SqliteStmt *stmt = stmt_list_block_sizes_.get();
+  for (const MapBlockIdRange &ids : MapBlockIdRanges(min, max, kMaxIdRanges)) {
+    stmt->BindInt(1, ids.lo);
+    stmt->BindInt(2, ids.hi);
+
+    while (stmt->Step()) {
+      const MapBlockPos pos(stmt->ColumnInt64(0));
+      if (!pos.inside(min, max)) {
+        continue;
+      }
+
+      if (!callback(pos, stmt->ColumnInt64(1))) {
+        stmt->Reset();
+        return false;
+      }
+    }
+
+    stmt->Reset();
+  }
 
-    if (!pos.inside(min, max)) {
+  return true;
+}
+
+MapInterface::KeyRange
+MapInterfaceSqlite3::PartitionKeys(const MapBlockPos &min,
+                                   const MapBlockPos &max) {
+  if (!IsWholeWorld(min, max)) {
+    return KeyRange{min.MapBlockId(), max.MapBlockId()};
+  }
+
+  stmt_rowid_range_->Step();
+  const KeyRange range{stmt_rowid_range_->ColumnInt64(0),
+                       stmt_rowid_range_->ColumnInt64(1)};
+  stmt_rowid_range_->Reset();
+  return range;
+}
+
+bool MapInterfaceSqlite3::ProduceMapBlockData(
+    const MapBlockPos &min, const MapBlockPos &max, const KeyRange &range,
+    std::function<bool(int64_t, const MapBlockPos &, BlobView)> callback) {
+  // Whole world: one rowid range.  Otherwise, the box's mapblock id ranges
+  // that fall within the partition.
+  std::vector<MapBlockIdRange> ranges;
+  SqliteStmt *stmt = nullptr;
+  if (IsWholeWorld(min, max)) {
+    ranges.push_back(MapBlockIdRange{range.lo, range.hi});
+    stmt = stmt_scan_by_rowid_.get();
+  } else {
+    ranges = MapBlockIdRanges(min, max, kMaxIdRanges);
+    stmt = stmt_scan_by_pos_.get();
+  }
+
+  for (const MapBlockIdRange &ids : ranges) {
+    const int64_t lo = std::max(ids.lo, range.lo);
+    const int64_t hi = std::min(ids.hi, range.hi);
+    if (lo > hi) {
       continue;
     }
 
-    if (!callback(pos)) {
-      return false;
+    stmt->BindInt(1, lo);
+    stmt->BindInt(2, hi);
+
+    while (stmt->Step()) {
+      const MapBlockPos pos(stmt->ColumnInt64(1));
+
+      if (!pos.inside(min, max)) {
+        continue;
+      }
+
+      if (!callback(stmt->ColumnInt64(0), pos, stmt->ColumnBlobView(2))) {
+        stmt->Reset();
+        return false;
+      }
     }
+
+    stmt->Reset();
   }
 
-  stmt_load_block_->Reset();
   return true;
 }
@@ -9,20 +9,55 @@ class MapInterfaceSqlite3 : public MapInterface {
 public:
   MapInterfaceSqlite3() = delete;
 
-  explicit MapInterfaceSqlite3(std::string_view connection_str);
+  explicit MapInterfaceSqlite3(std::string_view connection_str,
+                               const MapOptions &options = MapOptions());
   virtual ~MapInterfaceSqlite3() {}
 
   std::optional<Blob> LoadMapBlock(const MapBlockPos &pos) override;
 
+  std::vector<std::optional<Blob>>
+  LoadMapBlocks(std::span<const MapBlockPos> list) override;
+
+  // Un-hide the streaming overload from `MapInterface`.
+  using MapInterface::LoadMapBlocks;
+
   bool
   ProduceMapBlocks(const MapBlockPos &min, const MapBlockPos &max,
                    std::function<bool(const MapBlockPos &)> callback) override;
 
+  bool ProduceMapBlockSizes(
+      const MapBlockPos &min, const MapBlockPos &max,
+      std::function<bool(const MapBlockPos &, size_t)> callback) override;
+
+  // Un-hide the convenience overload from `MapInterface`.
+  using MapInterface::ProduceMapBlockData;
+
+  KeyRange PartitionKeys(const MapBlockPos &min,
+                         const MapBlockPos &max) override;
+
+  bool ProduceMapBlockData(
+      const MapBlockPos &min, const MapBlockPos &max, const KeyRange &range,
+      std::function<bool(int64_t, const MapBlockPos &, BlobView)> callback)
+      override;
+
   void DeleteMapBlocks(const std::vector<MapBlockPos> &list) override;
 
 protected:
+  // Positions bound per `LoadMapBlocks()` statement.  The statement always has
+  // this many parameters; short batches repeat their last position.
+  static constexpr size_t kLoadBatchSize = 64;
+
+  // Max count of mapblock id ranges (each one index seek) a `--min/--max` box
+  // is split into.  See `MapBlockIdRanges()`.
+  static constexpr size_t kMaxIdRanges = 65536;
+
   std::unique_ptr<SqliteDb> db_;
   std::unique_ptr<SqliteStmt> stmt_load_block_;
+  std::unique_ptr<SqliteStmt> stmt_load_blocks_;
   std::unique_ptr<SqliteStmt> stmt_list_blocks_;
+  std::unique_ptr<SqliteStmt> stmt_list_block_sizes_;
+  std::unique_ptr<SqliteStmt> stmt_rowid_range_;
+  std::unique_ptr<SqliteStmt> stmt_scan_by_rowid_;
+  std::unique_ptr<SqliteStmt> stmt_scan_by_pos_;
   std::unique_ptr<SqliteStmt> stmt_delete_block_;
 };
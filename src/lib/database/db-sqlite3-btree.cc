@@ -0,0 +1,446 @@
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+
+#include "src/lib/database/db-sqlite3-btree.h"
+
+// https://www.sqlite.org/fileformat2.html#the_database_header
+static constexpr char kMagic[] = "SQLite format 3";
+static constexpr size_t kFileHeaderSize = 100;
+
+// https://www.sqlite.org/fileformat2.html#b_tree_pages
+static constexpr uint8_t kTableInteriorPage = 0x05;
+static constexpr uint8_t kTableLeafPage = 0x0d;
+
+// sqlite's own limit on the size of a row (`SQLITE_MAX_LENGTH`).
+static constexpr uint64_t kMaxPayloadSize = 1000000000;
+
+static inline uint16_t GetBE16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+static inline uint32_t GetBE32(const uint8_t *p) {
+  return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) |
+         p[3];
+}
+
+// Decodes an sqlite varint at `p` into `value`.  Returns the number of bytes
+// consumed, or 0 if the varint runs past `end`.
+static size_t GetVarint(const uint8_t *p, const uint8_t *end,
+                        uint64_t *value) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < 9; ++i) {
+    if (p + i >= end) {
+      return 0;
+    }
+    if (i == 8) {
+      // The 9th byte contributes all 8 bits.
+      *value = (v << 8) | p[i];
+      return 9;
+    }
+    v = (v << 7) | (p[i] & 0x7f);
+    if (!(p[i] & 0x80)) {
+      *value = v;
+      return i + 1;
+    }
+  }
+  return 0; // Not reached.
+}
+
+// Returns the size of a column's data, given its serial type, or
+// std::nullopt for the reserved serial types.
+static std::optional<size_t> SerialTypeSize(uint64_t serial_type) {
+  static constexpr size_t kIntSizes[] = {0, 1, 2, 3, 4, 6, 8, 8, 0, 0};
+  if (serial_type < 10) {
+    return kIntSizes[serial_type];
+  }
+  if (serial_type < 12) {
+    return std::nullopt;
+  }
+  return (serial_type - 12) / 2;
+}
+
+int64_t SqliteBtreeFile::Column::Int64() const {
+  if (serial_type == 8) {
+    return 0;
+  }
+  if (serial_type == 9) {
+    return 1;
+  }
+
+  // Big-endian two's complement, sign extended from the first byte.
+  int64_t v = (size > 0) ? static_cast<int8_t>(data[0]) : 0;
+  for (size_t i = 1; i < size; ++i) {
+    v = (v << 8) | data[i];
+  }
+  return v;
+}
+
+SqliteBtreeFile::SqliteBtreeFile(const std::string &filename)
+    : filename_(filename), map_(nullptr), map_size_(0), page_size_(0),
+      usable_size_(0), page_count_(0) {
+  // Anything still in a WAL or a hot journal is invisible to us, and means
+  // that the file itself may be mid-update.
+  for (const char *suffix : {"-wal", "-journal"}) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(filename + suffix, ec);
+    if (!ec && size) {
+      throw SqliteBtreeError(
+          filename, std::string("has a non-empty ") + suffix +
+                        " file.  Stop the server (or checkpoint the map), or "
+                        "use the `sqlite` driver.");
+    }
+  }
+
+  const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw SqliteBtreeError(filename, strerror(errno));
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || (st.st_size < static_cast<off_t>(kFileHeaderSize))) {
+    close(fd);
+    throw SqliteBtreeError(filename, "not an sqlite3 database (too small)");
+  }
+
+  map_size_ = st.st_size;
+  void *map = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // The mapping keeps its own reference to the file.
+  if (map == MAP_FAILED) {
+    throw SqliteBtreeError(filename, strerror(errno));
+  }
+  map_ = static_cast<const uint8_t *>(map);
+
+  // From here on, the destructor will not run if we throw.
+  try {
+    if (memcmp(map_, kMagic, sizeof(kMagic))) {
+      throw SqliteBtreeError(filename, "not an sqlite3 database (bad magic)");
+    }
+
+    // 1 means 65536.
+    const uint32_t page_size = GetBE16(map_ + 16);
+    page_size_ = (page_size == 1) ? 65536 : page_size;
+    if ((page_size_ < 512) || (page_size_ & (page_size_ - 1))) {
+      throw SqliteBtreeError(filename, "invalid page size");
+    }
+
+    usable_size_ = page_size_ - map_[20];
+    if (usable_size_ < 480) {
+      throw SqliteBtreeError(filename, "invalid reserved space per page");
+    }
+
+    // Text encoding: 1 = UTF-8.  We only ever compare table names.
+    if (GetBE32(map_ + 56) != 1) {
+      throw SqliteBtreeError(filename, "only UTF-8 databases are supported");
+    }
+
+    // Trust the file size over the in-header page count, the same as sqlite
+    // does when the header's count is stale.
+    page_count_ = map_size_ / page_size_;
+  } catch (...) {
+    munmap(const_cast<uint8_t *>(map_), map_size_);
+    throw;
+  }
+
+  spdlog::debug("Btree file opened: {0}, {1} pages of {2} bytes", filename_,
+                page_count_, page_size_);
+}
+
+SqliteBtreeFile::~SqliteBtreeFile() {
+  munmap(const_cast<uint8_t *>(map_), map_size_);
+}
+
+void SqliteBtreeFile::Corrupt(uint32_t pgno, std::string_view what) const {
+  throw SqliteBtreeError(filename_, "corrupt page " + std::to_string(pgno) +
+                                        ": " + std::string(what));
+}
+
+const uint8_t *SqliteBtreeFile::Page(uint32_t pgno) const {
+  if ((pgno < 1) || (pgno > page_count_)) {
+    Corrupt(pgno, "page number out of range");
+  }
+  return map_ + static_cast<size_t>(pgno - 1) * page_size_;
+}
+
+uint32_t SqliteBtreeFile::FindTable(std::string_view name) const {
+  // Page 1 is the root of `sqlite_schema`:
+  //   (type text, name text, tbl_name text, rootpage integer, sql text)
+  std::vector<Column> columns;
+  std::optional<int64_t> root;
+
+  ScanTable(1, std::numeric_limits<int64_t>::min(),
+            std::numeric_limits<int64_t>::max(), [&](const Row &row) {
+              DecodeRecord(row, &columns);
+              if ((columns.size() >= 4) && columns[0].IsText() &&
+                  (columns[0].Text() == "table") && columns[1].IsText() &&
+                  (columns[1].Text() == name) && columns[3].IsInt()) {
+                root = columns[3].Int64();
+                return false;
+              }
+              return true;
+            });
+
+  const std::string table(name);
+  if (!root) {
+    throw SqliteBtreeError(filename_, "no such table: " + table);
+  }
+
+  // Virtual tables have no root page, WITHOUT ROWID tables are index b-trees.
+  const uint32_t pgno = *root;
+  if ((*root < 1) || (*root > page_count_)) {
+    throw SqliteBtreeError(filename_, "table has no b-tree: " + table);
+  }
+  const uint8_t type = Page(pgno)[(pgno == 1) ? kFileHeaderSize : 0];
+  if ((type != kTableInteriorPage) && (type != kTableLeafPage)) {
+    throw SqliteBtreeError(filename_, "not a rowid table: " + table);
+  }
+
+  return pgno;
+}
+
+std::pair<int64_t, int64_t> SqliteBtreeFile::RowidRange(uint32_t root) const {
+  const std::optional<int64_t> first = EdgeRowid(root, false, 0);
+  if (!first) {
+    return {0, -1};
+  }
+  return {*first, *EdgeRowid(root, true, 0)};
+}
+
+std::optional<int64_t> SqliteBtreeFile::EdgeRowid(uint32_t pgno, bool last,
+                                                  int depth) const {
+  if (depth > kMaxDepth) {
+    Corrupt(pgno, "b-tree too deep");
+  }
+
+  const uint8_t *page = Page(pgno);
+  const uint8_t *hdr = page + ((pgno == 1) ? kFileHeaderSize : 0);
+  const uint8_t *end = page + usable_size_;
+  const uint16_t cells = GetBE16(hdr + 3);
+
+  if (hdr[0] == kTableInteriorPage) {
+    if (last) {
+      return EdgeRowid(GetBE32(hdr + 8), last, depth + 1);
+    }
+    if (!cells) {
+      Corrupt(pgno, "interior page without cells");
+    }
+    const uint16_t offset = GetBE16(hdr + 12);
+    if (uint32_t{offset} + 4 > usable_size_) {
+      Corrupt(pgno, "cell offset out of range");
+    }
+    return EdgeRowid(GetBE32(page + offset), last, depth + 1);
+  }
+
+  if (hdr[0] != kTableLeafPage) {
+    Corrupt(pgno, "not a table b-tree page");
+  }
+  if (!cells) {
+    return std::nullopt; // Only the root of an empty table.
+  }
+
+  const uint16_t offset = GetBE16(hdr + 8 + 2 * (last ? cells - 1 : 0));
+  if (offset >= usable_size_) {
+    Corrupt(pgno, "cell offset out of range");
+  }
+
+  const uint8_t *p = page + offset;
+  uint64_t payload_size, rowid;
+  size_t n = GetVarint(p, end, &payload_size);
+  if (!n || !GetVarint(p + n, end, &rowid)) {
+    Corrupt(pgno, "truncated cell");
+  }
+  return static_cast<int64_t>(rowid);
+}
+
+bool SqliteBtreeFile::ScanTable(
+    uint32_t root, int64_t lo, int64_t hi,
+    const std::function<bool(const Row &)> &callback, bool local_only) const {
+  std::vector<uint8_t> scratch;
+  return ScanPage(root, lo, hi, callback, 0, local_only ? nullptr : &scratch);
+}
+
+bool SqliteBtreeFile::ScanPage(
+    uint32_t pgno, int64_t lo, int64_t hi,
+    const std::function<bool(const Row &)> &callback, int depth,
+    std::vector<uint8_t> *scratch) const {
+  if (depth > kMaxDepth) {
+    Corrupt(pgno, "b-tree too deep");
+  }
+
+  const uint8_t *page = Page(pgno);
+  const uint8_t *hdr = page + ((pgno == 1) ? kFileHeaderSize : 0);
+  const uint8_t *end = page + usable_size_;
+  const uint16_t cells = GetBE16(hdr + 3);
+
+  if (hdr[0] == kTableInteriorPage) {
+    // Each cell is (left child, key): every rowid in the child is <= key.
+    // Rowids greater than the last key are under the right-most pointer.
+    const uint8_t *cell_ptrs = hdr + 12;
+    if (cell_ptrs + 2 * cells > end) {
+      Corrupt(pgno, "too many cells");
+    }
+    for (uint16_t i = 0; i < cells; ++i) {
+      const uint16_t offset = GetBE16(cell_ptrs + 2 * i);
+      if (uint32_t{offset} + 4 > usable_size_) {
+        Corrupt(pgno, "cell offset out of range");
+      }
+      uint64_t key;
+      if (!GetVarint(page + offset + 4, end, &key)) {
+        Corrupt(pgno, "truncated cell");
+      }
+      if (static_cast<int64_t>(key) < lo) {
+        continue;
+      }
+      if (!ScanPage(GetBE32(page + offset), lo, hi, callback, depth + 1,
+                    scratch)) {
+        return false;
+      }
+      if (static_cast<int64_t>(key) >= hi) {
+        return true;
+      }
+    }
+    return ScanPage(GetBE32(hdr + 8), lo, hi, callback, depth + 1, scratch);
+  }
+
+  if (hdr[0] != kTableLeafPage) {
+    Corrupt(pgno, "not a table b-tree page");
+  }
+
+  // Payload that spills onto overflow pages keeps `local` bytes on the leaf.
+  // https://www.sqlite.org/fileformat2.html#cellformat
+  const uint64_t max_local = usable_size_ - 35;
+  const uint64_t min_local = ((usable_size_ - 12) * 32 / 255) - 23;
+  const uint64_t overflow_size = usable_size_ - 4;
+
+  const uint8_t *cell_ptrs = hdr + 8;
+  if (cell_ptrs + 2 * cells > end) {
+    Corrupt(pgno, "too many cells");
+  }
+  for (uint16_t i = 0; i < cells; ++i) {
+    const uint16_t offset = GetBE16(cell_ptrs + 2 * i);
+    if (offset >= usable_size_) {
+      Corrupt(pgno, "cell offset out of range");
+    }
+
+    const uint8_t *p = page + offset;
+    uint64_t payload_size, rowid;
+    size_t n = GetVarint(p, end, &payload_size);
+    if (!n) {
+      Corrupt(pgno, "truncated cell");
+    }
+    p += n;
+    n = GetVarint(p, end, &rowid);
+    if (!n) {
+      Corrupt(pgno, "truncated cell");
+    }
+    p += n;
+
+    Row row{static_cast<int64_t>(rowid), p, payload_size, payload_size};
+    if (row.rowid < lo) {
+      continue;
+    }
+    if (row.rowid > hi) {
+      return true;
+    }
+
+    if (payload_size <= max_local) {
+      if (p + payload_size > end) {
+        Corrupt(pgno, "payload out of range");
+      }
+    } else {
+      uint64_t local =
+          min_local + ((payload_size - min_local) % overflow_size);
+      if (local > max_local) {
+        local = min_local;
+      }
+      if (p + local + 4 > end) {
+        Corrupt(pgno, "payload out of range");
+      }
+      // Checked before allocating: the size comes straight from the file.
+      if ((payload_size > kMaxPayloadSize) ||
+          (payload_size - local >
+           static_cast<uint64_t>(page_count_) * overflow_size)) {
+        Corrupt(pgno, "payload too large");
+      }
+
+      if (!scratch) {
+        row.local_size = local; // `local_only`
+      } else {
+        AssembleOverflow(pgno, p, local, payload_size, scratch);
+        row.payload = scratch->data();
+      }
+    }
+
+    if (!callback(row)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void SqliteBtreeFile::AssembleOverflow(uint32_t pgno, const uint8_t *p,
+                                       uint64_t local, uint64_t payload_size,
+                                       std::vector<uint8_t> *scratch) const {
+  const uint64_t overflow_size = usable_size_ - 4;
+
+  scratch->resize(payload_size);
+  uint8_t *out = scratch->data();
+  memcpy(out, p, local);
+
+  // Each overflow page is (next page number, up to U-4 bytes).  Every step
+  // consumes bytes, so a cycle in the chain cannot loop forever.
+  uint64_t remaining = payload_size - local;
+  uint32_t next = GetBE32(p + local);
+  out += local;
+  while (remaining) {
+    if (!next) {
+      Corrupt(pgno, "overflow chain too short");
+    }
+    const uint8_t *overflow = Page(next);
+    const uint64_t size = std::min(remaining, overflow_size);
+    memcpy(out, overflow + 4, size);
+    out += size;
+    remaining -= size;
+    next = GetBE32(overflow);
+  }
+}
+
+void SqliteBtreeFile::DecodeRecord(const Row &row,
+                                   std::vector<Column> *columns) const {
+  // https://www.sqlite.org/fileformat2.html#record_format
+  columns->clear();
+
+  const uint8_t *p = row.payload;
+  const uint8_t *end = row.payload + row.payload_size;
+
+  uint64_t header_size;
+  size_t n = GetVarint(p, p + row.local_size, &header_size);
+  if (!n || (header_size > row.local_size)) {
+    throw SqliteBtreeError(filename_, "corrupt record header, rowid " +
+                                          std::to_string(row.rowid));
+  }
+
+  const uint8_t *header_end = p + header_size;
+  const uint8_t *data = header_end;
+  p += n;
+
+  while (p < header_end) {
+    uint64_t serial_type;
+    n = GetVarint(p, header_end, &serial_type);
+    const std::optional<size_t> size = SerialTypeSize(serial_type);
+    if (!n || !size || (*size > static_cast<size_t>(end - data))) {
+      throw SqliteBtreeError(filename_, "corrupt record, rowid " +
+                                            std::to_string(row.rowid));
+    }
+    columns->push_back(Column{serial_type, data, *size});
+    p += n;
+    data += *size;
+  }
+}
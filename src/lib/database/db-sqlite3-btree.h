@@ -0,0 +1,130 @@
+// Read-only reader for the rowid tables of an sqlite3 database file, that
+// parses the file format directly instead of going through the sqlite3 VM.
+// https://www.sqlite.org/fileformat2.html
+//
+// The file is mmap()'ed, so rows are handed out as pointers into the mapping
+// (or into a scratch buffer, for rows that spill onto overflow pages).
+// The file must NOT be modified while it is open: there is no locking, and
+// pending changes in a WAL or rollback journal are NOT seen (we refuse to
+// open the file if either exists).
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "src/lib/exceptions/exceptions.h"
+
+class SqliteBtreeError : public DatabaseError {
+public:
+  SqliteBtreeError() = delete;
+
+  explicit SqliteBtreeError(std::string_view filename, std::string_view msg)
+      : DatabaseError(std::string(filename) + ": " + std::string(msg)) {}
+};
+
+class SqliteBtreeFile {
+public:
+  SqliteBtreeFile() = delete;
+  SqliteBtreeFile(const SqliteBtreeFile &) = delete;
+  SqliteBtreeFile &operator=(const SqliteBtreeFile &) = delete;
+
+  explicit SqliteBtreeFile(const std::string &filename);
+  ~SqliteBtreeFile();
+
+  // One column of a decoded record.  `data` points into the row's payload.
+  struct Column {
+    uint64_t serial_type;
+    const uint8_t *data;
+    size_t size;
+
+    bool IsNull() const { return serial_type == 0; }
+    bool IsInt() const { return (serial_type <= 9) && (serial_type != 7); }
+    bool IsBlob() const { return (serial_type >= 12) && !(serial_type & 1); }
+    bool IsText() const { return (serial_type >= 13) && (serial_type & 1); }
+
+    // Only valid if `IsInt()`.
+    int64_t Int64() const;
+    // Only valid if `IsText()` (and the database is UTF-8).
+    std::string_view Text() const {
+      return std::string_view(reinterpret_cast<const char *>(data), size);
+    }
+  };
+
+  // One row of a table b-tree.  `payload` is the raw record (see
+  // `DecodeRecord()`), and is only valid during the callback.  Only its first
+  // `local_size` bytes are there; less than `payload_size` if the row spills
+  // onto overflow pages that the scan did not read.
+  struct Row {
+    int64_t rowid;
+    const uint8_t *payload;
+    size_t payload_size;
+    size_t local_size;
+
+    // Whether all of `column`'s data is within the local bytes.
+    bool IsLocal(const Column &column) const {
+      return column.data + column.size <= payload + local_size;
+    }
+  };
+
+  // Returns the root page of the rowid table `name`.  Throws if there is no
+  // such table, or if it was created `WITHOUT ROWID`.
+  uint32_t FindTable(std::string_view name) const;
+
+  // Returns the first and last rowid in the table rooted at `root`, or
+  // {0, -1} if the table is empty.
+  std::pair<int64_t, int64_t> RowidRange(uint32_t root) const;
+
+  // Invokes `callback` for each row whose rowid is between `lo` and `hi`
+  // (inclusive), in rowid order.  Returns `false` if the callback did.
+  // With `local_only`, overflow pages are not read, and rows hold only the
+  // bytes stored on their leaf page (enough for the record header and small
+  // leading columns), which makes listing keys and sizes much cheaper.
+  bool ScanTable(uint32_t root, int64_t lo, int64_t hi,
+                 const std::function<bool(const Row &)> &callback,
+                 bool local_only = false) const;
+
+  // Splits a record into its columns (`columns` is cleared first).  The
+  // header must be within the row's local bytes; columns past them have
+  // their type and size, but `data` must not be read (see `Row::IsLocal()`).
+  void DecodeRecord(const Row &row, std::vector<Column> *columns) const;
+
+  uint32_t page_size() const { return page_size_; }
+  uint32_t page_count() const { return page_count_; }
+
+protected:
+  // sqlite refuses b-trees deeper than this; so do we (catches page cycles).
+  static constexpr int kMaxDepth = 20;
+
+  const uint8_t *Page(uint32_t pgno) const;
+
+  // `scratch` holds rows assembled from overflow pages; null if
+  // `local_only`.
+  bool ScanPage(uint32_t pgno, int64_t lo, int64_t hi,
+                const std::function<bool(const Row &)> &callback, int depth,
+                std::vector<uint8_t> *scratch) const;
+
+  // Copies the payload of a cell on leaf page `pgno` into `scratch`: `local`
+  // bytes at `p`, followed by the 4 byte first overflow page number, then the
+  // rest from the overflow chain.
+  void AssembleOverflow(uint32_t pgno, const uint8_t *p, uint64_t local,
+                        uint64_t payload_size,
+                        std::vector<uint8_t> *scratch) const;
+
+  // Returns the first (`last == false`) or last rowid below page `pgno`.
+  std::optional<int64_t> EdgeRowid(uint32_t pgno, bool last, int depth) const;
+
+  [[noreturn]] void Corrupt(uint32_t pgno, std::string_view what) const;
+
+  std::string filename_;
+  const uint8_t *map_;
+  size_t map_size_;
+  uint32_t page_size_;
+  uint32_t usable_size_;
+  uint32_t page_count_;
+};
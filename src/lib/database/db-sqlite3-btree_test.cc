@@ -0,0 +1,319 @@
+#include <filesystem>
+#include <fstream>
+#include <tuple>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/database/db-map-interface.h"
+#include "src/lib/database/db-sqlite3-btree.h"
+#include "src/lib/database/db-sqlite3.h"
+
+using ::testing::ContainerEq;
+using ::testing::Eq;
+using ::testing::HasSubstr;
+using ::testing::IsEmpty;
+using ::testing::Le;
+using ::testing::Not;
+using ::testing::UnorderedElementsAreArray;
+
+// Relative to the working directory; `rebuild.sh` wipes it.
+static const std::filesystem::path kTestDir = "tmp/test/db-sqlite3-btree";
+
+using Rows = std::vector<std::tuple<int64_t, int64_t, std::vector<uint8_t>>>;
+
+static std::string TestFile(const std::string &name) {
+  std::filesystem::create_directories(kTestDir);
+  const std::filesystem::path path = kTestDir / name;
+  std::filesystem::remove(path);
+  return path.string();
+}
+
+// Creates a minetest style `blocks` table with small pages, so that the
+// b-tree has interior pages, and many blobs spill onto overflow pages.
+static std::string MakeMap(const std::string &name) {
+  const std::string filename = TestFile(name);
+  SqliteDb db(filename);
+  db.Exec("pragma page_size = 512");
+  db.Exec("create table blocks (pos int primary key, data blob)");
+  db.Exec("create table other (a text)");
+
+  SqliteStmt insert(db, "insert into blocks (pos, data) values (?, ?)");
+  db.Begin();
+  for (int i = 0; i < 2000; ++i) {
+    // Sizes from 1 byte to ~3 pages, ids in no particular order, some negative.
+    std::vector<uint8_t> data(1 + (i * 37) % 1700, static_cast<uint8_t>(i));
+    insert.BindInt(1, ((i * 7919) % 4001) - 2000);
+    insert.BindBlob(2, data.data(), data.size());
+    insert.Step();
+    insert.Reset();
+  }
+  db.Commit();
+
+  // Leave some holes in the rowids.
+  db.Exec("delete from blocks where rowid % 5 = 0");
+  return filename;
+}
+
+static Rows SqlRows(const std::string &filename, int64_t lo, int64_t hi) {
+  SqliteDb db(filename);
+  SqliteStmt stmt(db, "select rowid, pos, data from blocks "
+                      "where rowid between ? and ? order by rowid");
+  stmt.BindInt(1, lo);
+  stmt.BindInt(2, hi);
+
+  Rows rows;
+  while (stmt.Step()) {
+    rows.emplace_back(stmt.ColumnInt64(0), stmt.ColumnInt64(1),
+                      stmt.ColumnBlob(2));
+  }
+  return rows;
+}
+
+static Rows BtreeRows(const SqliteBtreeFile &file, int64_t lo, int64_t hi) {
+  const uint32_t root = file.FindTable("blocks");
+  std::vector<SqliteBtreeFile::Column> columns;
+
+  Rows rows;
+  file.ScanTable(root, lo, hi, [&](const SqliteBtreeFile::Row &row) {
+    file.DecodeRecord(row, &columns);
+    EXPECT_THAT(columns.size(), Eq(2));
+    EXPECT_TRUE(columns[0].IsInt());
+    EXPECT_TRUE(columns[1].IsBlob());
+    rows.emplace_back(row.rowid, columns[0].Int64(),
+                      std::vector<uint8_t>(columns[1].data,
+                                           columns[1].data + columns[1].size));
+    return true;
+  });
+  return rows;
+}
+
+TEST(SqliteBtreeFile, ScanTable) {
+  const std::string filename = MakeMap("scan.sqlite");
+  const SqliteBtreeFile file(filename);
+  EXPECT_THAT(file.page_size(), Eq(512));
+
+  const auto rowids = file.RowidRange(file.FindTable("blocks"));
+  EXPECT_THAT(rowids.first, Eq(1));
+  EXPECT_THAT(rowids.second, Eq(1999));
+
+  const Rows all = BtreeRows(file, rowids.first, rowids.second);
+  EXPECT_THAT(all.size(), Eq(1600));
+  EXPECT_THAT(all, ContainerEq(SqlRows(filename, rowids.first, rowids.second)));
+
+  // Sub-ranges, including ones that start/end on deleted rowids.
+  for (const auto &range : MapInterface::SplitKeyRange(
+           MapInterface::KeyRange{rowids.first, rowids.second}, 7)) {
+    EXPECT_THAT(BtreeRows(file, range.lo, range.hi),
+                ContainerEq(SqlRows(filename, range.lo, range.hi)));
+  }
+  EXPECT_THAT(BtreeRows(file, 5, 5), IsEmpty());
+  EXPECT_THAT(BtreeRows(file, 3000, 4000), IsEmpty());
+}
+
+TEST(SqliteBtreeFile, ScanTableLocalOnly) {
+  const std::string filename = MakeMap("local.sqlite");
+  const SqliteBtreeFile file(filename);
+  const Rows expected = SqlRows(filename, 0, 10000);
+
+  // Same keys and blob sizes, without reading overflow pages.
+  std::vector<SqliteBtreeFile::Column> columns;
+  size_t spilled = 0;
+  size_t i = 0;
+  file.ScanTable(
+      file.FindTable("blocks"), 0, 10000,
+      [&](const SqliteBtreeFile::Row &row) {
+        EXPECT_THAT(row.local_size, Le(row.payload_size));
+        spilled += (row.local_size < row.payload_size);
+
+        file.DecodeRecord(row, &columns);
+        EXPECT_THAT(columns.size(), Eq(2));
+        EXPECT_TRUE(row.IsLocal(columns[0]));
+        EXPECT_THAT(row.rowid, Eq(std::get<0>(expected[i])));
+        EXPECT_THAT(columns[0].Int64(), Eq(std::get<1>(expected[i])));
+        EXPECT_THAT(columns[1].size, Eq(std::get<2>(expected[i]).size()));
+        ++i;
+        return true;
+      },
+      true);
+  EXPECT_THAT(i, Eq(expected.size()));
+  EXPECT_THAT(spilled, Not(Eq(0)));
+}
+
+TEST(SqliteBtreeFile, StopsEarly) {
+  const SqliteBtreeFile file(MakeMap("stop.sqlite"));
+  int count = 0;
+  EXPECT_FALSE(file.ScanTable(file.FindTable("blocks"), 0, 10000,
+                              [&](const SqliteBtreeFile::Row &row) {
+                                return ++count < 10;
+                              }));
+  EXPECT_THAT(count, Eq(10));
+}
+
+TEST(SqliteBtreeFile, EmptyTable) {
+  const std::string filename = TestFile("empty.sqlite");
+  SqliteDb(filename).Exec("create table blocks (pos int primary key, data "
+                          "blob)");
+
+  const SqliteBtreeFile file(filename);
+  const auto rowids = file.RowidRange(file.FindTable("blocks"));
+  EXPECT_THAT(rowids.first, Eq(0));
+  EXPECT_THAT(rowids.second, Eq(-1));
+}
+
+TEST(SqliteBtreeFile, Errors) {
+  const std::string filename = TestFile("errors.sqlite");
+  SqliteDb(filename).Exec(
+      "create table blocks (x int, y int, z int, data blob, "
+      "primary key (x, y, z)) without rowid");
+
+  const SqliteBtreeFile file(filename);
+  EXPECT_THROW(file.FindTable("missing"), SqliteBtreeError);
+  EXPECT_THROW(file.FindTable("blocks"), SqliteBtreeError);
+
+  const std::string text = TestFile("not-sqlite.txt");
+  {
+    std::ofstream out(text);
+    out << std::string(4096, 'x');
+  }
+  EXPECT_THROW(SqliteBtreeFile{text}, SqliteBtreeError);
+  EXPECT_THROW(SqliteBtreeFile{TestFile("missing.sqlite")}, SqliteBtreeError);
+}
+
+TEST(MapInterfaceSqlite3Direct, MatchesSqlite3) {
+  const std::string filename = MakeMap("map.sqlite");
+  auto sqlite = MapInterface::Create(MapDriverType::SQLITE, filename);
+  auto direct = MapInterface::Create(MapDriverType::SQLITE_DIRECT, filename);
+
+  using Blocks = std::vector<std::pair<std::string, MapInterface::Blob>>;
+  const auto produce = [](MapInterface *map, const MapBlockPos &min,
+                          const MapBlockPos &max) {
+    Blocks blocks;
+    map->ProduceMapBlockData(
+        min, max, [&](const MapBlockPos &pos, MapInterface::BlobView data) {
+          blocks.emplace_back(pos.str(),
+                              MapInterface::Blob(data.begin(), data.end()));
+          return true;
+        });
+    return blocks;
+  };
+
+  // Whole world (direct), and a sub-box (fallback).
+  for (const auto &box :
+       {std::make_pair(MapBlockPos::min(), MapBlockPos::max()),
+        std::make_pair(MapBlockPos(-2048, -2048, -2048),
+                       MapBlockPos(0, 1, 2047))}) {
+    const Blocks expected = produce(sqlite.get(), box.first, box.second);
+    EXPECT_THAT(expected, Not(IsEmpty()));
+    EXPECT_THAT(produce(direct.get(), box.first, box.second),
+                ContainerEq(expected));
+  }
+
+  // Whole world key and size scans (in rowid order, rather than `pos`).
+  using Sizes = std::vector<std::pair<std::string, size_t>>;
+  const auto sizes = [](MapInterface *map) {
+    Sizes sizes;
+    map->ProduceMapBlockSizes(MapBlockPos::min(), MapBlockPos::max(),
+                              [&](const MapBlockPos &pos, size_t size) {
+                                sizes.emplace_back(pos.str(), size);
+                                return true;
+                              });
+    return sizes;
+  };
+  const Sizes expected_sizes = sizes(sqlite.get());
+  EXPECT_THAT(expected_sizes.size(), Eq(1600));
+  EXPECT_THAT(sizes(direct.get()),
+              UnorderedElementsAreArray(expected_sizes));
+
+  const MapBlockPos pos(-2000);
+  EXPECT_THAT(direct->LoadMapBlock(pos), Eq(sqlite->LoadMapBlock(pos)));
+}
+
+TEST(MapInterfaceSqlite3Direct, EdgesAndBadRows) {
+  const std::string filename = TestFile("edges.sqlite");
+  {
+    SqliteDb db(filename);
+    db.Exec("create table blocks (pos int primary key, data blob)");
+    SqliteStmt insert(db, "insert into blocks (pos, data) values (?, ?)");
+    const uint8_t blob[] = {1, 2, 3};
+    // In the world, and on its (exclusive) upper edge.
+    for (const int64_t id :
+         {MapBlockPos(0, 0, 0).MapBlockId(),
+          MapBlockPos(-2048, -2048, -2048).MapBlockId(),
+          MapBlockPos(2047, 0, 0).MapBlockId(),
+          MapBlockPos(0, 2047, 0).MapBlockId(),
+          MapBlockPos(0, 0, 2047).MapBlockId()}) {
+      insert.BindInt(1, id);
+      insert.BindBlob(2, blob, sizeof(blob));
+      insert.Step();
+      insert.Reset();
+    }
+    // No blob: counted as bad mapblocks, not fatal.
+    db.Exec("insert into blocks (pos, data) values (1, null)");
+    db.Exec("insert into blocks (pos) values (2)");
+  }
+
+  auto sqlite = MapInterface::Create(MapDriverType::SQLITE, filename);
+  auto direct = MapInterface::Create(MapDriverType::SQLITE_DIRECT, filename);
+
+  using Blocks = std::vector<std::pair<std::string, size_t>>;
+  const auto data = [](MapInterface *map) {
+    Blocks blocks;
+    map->ProduceMapBlockData(MapBlockPos::min(), MapBlockPos::max(),
+                             [&](const MapBlockPos &pos,
+                                 MapInterface::BlobView data) {
+                               blocks.emplace_back(pos.str(), data.size());
+                               return true;
+                             });
+    return blocks;
+  };
+  const auto keys = [](MapInterface *map) {
+    std::vector<std::string> keys;
+    map->ProduceMapBlocks(MapBlockPos::min(), MapBlockPos::max(),
+                          [&](const MapBlockPos &pos) {
+                            keys.push_back(pos.str());
+                            return true;
+                          });
+    return keys;
+  };
+
+  const Blocks expected = {{MapBlockPos(0, 0, 0).str(), 3},
+                           {MapBlockPos::min().str(), 3},
+                           {MapBlockPos(1).str(), 0},
+                           {MapBlockPos(2).str(), 0}};
+  EXPECT_THAT(data(direct.get()), ContainerEq(expected));
+  EXPECT_THAT(data(direct.get()), ContainerEq(data(sqlite.get())));
+  EXPECT_THAT(keys(direct.get()),
+              UnorderedElementsAreArray(keys(sqlite.get())));
+  EXPECT_THAT(keys(direct.get()).size(), Eq(expected.size()));
+}
+
+TEST(SqliteBtreeFile, PayloadTooLarge) {
+  const std::string filename = TestFile("too-large.sqlite");
+  {
+    SqliteDb db(filename);
+    db.Exec("pragma page_size = 512");
+    db.Exec("create table blocks (pos int primary key, data blob)");
+    db.Exec("insert into blocks values (1, zeroblob(20000))");
+  }
+
+  // One row, on the leaf root page (2).  Its payload size is a 3 byte
+  // varint; claim 2 MiB, more than the whole file.
+  {
+    std::fstream f(filename, std::ios::in | std::ios::out | std::ios::binary);
+    uint8_t ptr[2];
+    f.seekg(512 + 8);
+    f.read(reinterpret_cast<char *>(ptr), 2);
+    f.seekp(512 + ((ptr[0] << 8) | ptr[1]));
+    f.write("\xff\xff\x7f", 3);
+  }
+
+  const SqliteBtreeFile file(filename);
+  try {
+    file.ScanTable(file.FindTable("blocks"), 0, 10,
+                   [](const SqliteBtreeFile::Row &) { return true; });
+    FAIL() << "Expected SqliteBtreeError";
+  } catch (const SqliteBtreeError &e) {
+    EXPECT_THAT(std::string(e.what()), HasSubstr("payload too large"));
+  }
+}
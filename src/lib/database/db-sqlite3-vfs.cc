@@ -0,0 +1,356 @@
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sqlite3.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "src/lib/database/db-sqlite3-vfs.h"
+#include "src/lib/exceptions/exceptions.h"
+
+static constexpr char kVfsName[] = "readahead";
+
+// First read-ahead window, once reads look sequential.
+static constexpr int64_t kMinWindow = 256 * 1024;
+
+// Read-ahead windows start and end on multiples of this.
+static constexpr int64_t kAlignment = 64 * 1024;
+
+// Forward reads needed before we start reading ahead.  Gaps of up to one
+// window still count as forward, since b-tree pages are rarely contiguous.
+static constexpr int kSequentialReads = 4;
+
+static sqlite3_vfs *g_real_vfs = nullptr;
+static sqlite3_vfs g_vfs;
+static std::atomic<int64_t> g_max_window(0);
+
+static std::atomic<uint64_t> g_reads(0);
+static std::atomic<uint64_t> g_bytes_read(0);
+static std::atomic<uint64_t> g_hits(0);
+static std::atomic<uint64_t> g_readahead_bytes(0);
+static std::atomic<int64_t> g_stall_ns(0);
+
+// Issues `POSIX_FADV_WILLNEED` on its own file descriptor, so that the
+// connection's thread never waits for the kernel to queue the I/O.
+class Prefetcher {
+public:
+  explicit Prefetcher(int fd)
+      : fd_(fd), mutex_(), cv_(), lo_(0), hi_(0), stop_(false),
+        thread_(&Prefetcher::Run, this) {}
+
+  ~Prefetcher() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    close(fd_);
+  }
+
+  // Replaces any range not yet handed to the kernel; the reader has moved on.
+  void Request(int64_t lo, int64_t hi) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      lo_ = lo;
+      hi_ = hi;
+    }
+    cv_.notify_one();
+  }
+
+private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this] { return stop_ || (lo_ < hi_); });
+      if (stop_) {
+        return;
+      }
+      const int64_t lo = lo_;
+      const int64_t hi = hi_;
+      lo_ = hi_ = 0;
+
+      lock.unlock();
+      posix_fadvise(fd_, lo, hi - lo, POSIX_FADV_WILLNEED);
+      lock.lock();
+    }
+  }
+
+  const int fd_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  int64_t lo_;
+  int64_t hi_;
+  bool stop_;
+  std::thread thread_;
+};
+
+// Our `sqlite3_file`.  sqlite allocates `g_vfs.szOsFile` bytes for it, and we
+// place the default VFS's file right after it.  Never constructed, so only
+// plain members.
+struct ReadaheadFile {
+  sqlite3_file base;
+  sqlite3_file *real;
+  Prefetcher *prefetcher;
+
+  // Size when opened.  We never read ahead past it.
+  sqlite3_int64 file_size;
+
+  // Read pattern; only touched by the connection's own thread.
+  int64_t next_offset;
+  int sequential;
+  int64_t window;
+  int64_t ahead_lo;
+  int64_t ahead_hi;
+};
+
+static constexpr size_t kRealFileOffset =
+    (sizeof(ReadaheadFile) + 7) & ~static_cast<size_t>(7);
+
+static ReadaheadFile *Cast(sqlite3_file *file) {
+  return reinterpret_cast<ReadaheadFile *>(file);
+}
+
+static sqlite3_file *Real(sqlite3_file *file) { return Cast(file)->real; }
+
+// Counts a read of `amount` bytes at `offset`, and starts read-ahead once the
+// reads look sequential.
+static void OnRead(ReadaheadFile *file, int64_t offset, int64_t amount) {
+  ++g_reads;
+  g_bytes_read += amount;
+
+  const int64_t end = offset + amount;
+  if ((offset >= file->ahead_lo) && (end <= file->ahead_hi)) {
+    ++g_hits;
+  }
+
+  if ((offset >= file->next_offset) &&
+      (offset - file->next_offset <= file->window)) {
+    ++file->sequential;
+  } else {
+    file->sequential = 0;
+    file->window = kMinWindow;
+    file->ahead_lo = file->ahead_hi = 0;
+  }
+  file->next_offset = end;
+
+  // Top up once the reader is half way through the current window.
+  if (!file->prefetcher || (file->sequential < kSequentialReads) ||
+      (end + file->window / 2 <= file->ahead_hi)) {
+    return;
+  }
+
+  const int64_t lo = std::max(file->ahead_hi, end / kAlignment * kAlignment);
+  const int64_t hi = std::min<int64_t>(
+      (end + file->window + kAlignment - 1) / kAlignment * kAlignment,
+      file->file_size);
+  if (lo >= hi) {
+    return;
+  }
+  if (!file->ahead_hi) {
+    file->ahead_lo = lo;
+  }
+  file->ahead_hi = hi;
+  file->window = std::min(file->window * 2, g_max_window.load());
+
+  g_readahead_bytes += hi - lo;
+  file->prefetcher->Request(lo, hi);
+}
+
+static int xClose(sqlite3_file *file) {
+  const int rc = Real(file)->pMethods->xClose(Real(file));
+  delete Cast(file)->prefetcher;
+  Cast(file)->prefetcher = nullptr;
+  return rc;
+}
+
+static int xRead(sqlite3_file *file, void *buf, int amount,
+                 sqlite3_int64 offset) {
+  OnRead(Cast(file), offset, amount);
+
+  const auto start = std::chrono::steady_clock::now();
+  const int rc = Real(file)->pMethods->xRead(Real(file), buf, amount, offset);
+  g_stall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  return rc;
+}
+
+static int xWrite(sqlite3_file *file, const void *buf, int amount,
+                  sqlite3_int64 offset) {
+  return Real(file)->pMethods->xWrite(Real(file), buf, amount, offset);
+}
+
+static int xTruncate(sqlite3_file *file, sqlite3_int64 size) {
+  return Real(file)->pMethods->xTruncate(Real(file), size);
+}
+
+static int xSync(sqlite3_file *file, int flags) {
+  return Real(file)->pMethods->xSync(Real(file), flags);
+}
+
+static int xFileSize(sqlite3_file *file, sqlite3_int64 *size) {
+  return Real(file)->pMethods->xFileSize(Real(file), size);
+}
+
+static int xLock(sqlite3_file *file, int lock) {
+  return Real(file)->pMethods->xLock(Real(file), lock);
+}
+
+static int xUnlock(sqlite3_file *file, int lock) {
+  return Real(file)->pMethods->xUnlock(Real(file), lock);
+}
+
+static int xCheckReservedLock(sqlite3_file *file, int *out) {
+  return Real(file)->pMethods->xCheckReservedLock(Real(file), out);
+}
+
+static int xFileControl(sqlite3_file *file, int op, void *arg) {
+  return Real(file)->pMethods->xFileControl(Real(file), op, arg);
+}
+
+static int xSectorSize(sqlite3_file *file) {
+  return Real(file)->pMethods->xSectorSize(Real(file));
+}
+
+static int xDeviceCharacteristics(sqlite3_file *file) {
+  return Real(file)->pMethods->xDeviceCharacteristics(Real(file));
+}
+
+static int xShmMap(sqlite3_file *file, int page, int size, int extend,
+                   void volatile **out) {
+  return Real(file)->pMethods->xShmMap(Real(file), page, size, extend, out);
+}
+
+static int xShmLock(sqlite3_file *file, int offset, int n, int flags) {
+  return Real(file)->pMethods->xShmLock(Real(file), offset, n, flags);
+}
+
+static void xShmBarrier(sqlite3_file *file) {
+  Real(file)->pMethods->xShmBarrier(Real(file));
+}
+
+static int xShmUnmap(sqlite3_file *file, int delete_flag) {
+  return Real(file)->pMethods->xShmUnmap(Real(file), delete_flag);
+}
+
+// With `pragma mmap_size`, sqlite fetches pages from the mapping instead of
+// calling `xRead()`.  Page faults are not counted as stalls, but the read
+// pattern still drives read-ahead.
+static int xFetch(sqlite3_file *file, sqlite3_int64 offset, int amount,
+                  void **out) {
+  OnRead(Cast(file), offset, amount);
+  return Real(file)->pMethods->xFetch(Real(file), offset, amount, out);
+}
+
+static int xUnfetch(sqlite3_file *file, sqlite3_int64 offset, void *p) {
+  return Real(file)->pMethods->xUnfetch(Real(file), offset, p);
+}
+
+static int xOpen(sqlite3_vfs *vfs, const char *name, sqlite3_file *file,
+                 int flags, int *out_flags) {
+  // Everything but the database itself goes straight to the default VFS,
+  // which then owns `file` (its `szOsFile` is smaller than ours).
+  if (!name || !(flags & SQLITE_OPEN_MAIN_DB)) {
+    return g_real_vfs->xOpen(g_real_vfs, name, file, flags, out_flags);
+  }
+
+  ReadaheadFile *ours = Cast(file);
+  ours->real = reinterpret_cast<sqlite3_file *>(
+      reinterpret_cast<char *>(file) + kRealFileOffset);
+  const int rc =
+      g_real_vfs->xOpen(g_real_vfs, name, ours->real, flags, out_flags);
+  if (rc != SQLITE_OK) {
+    file->pMethods = nullptr;
+    return rc;
+  }
+
+  // The prefetch thread needs its own descriptor; without one we still count.
+  const int fd = open(name, O_RDONLY | O_CLOEXEC);
+  ours->prefetcher = (fd >= 0) ? new Prefetcher(fd) : nullptr;
+  ours->file_size = 0;
+  ours->real->pMethods->xFileSize(ours->real, &ours->file_size);
+  ours->next_offset = 0;
+  ours->sequential = 0;
+  ours->window = kMinWindow;
+  ours->ahead_lo = 0;
+  ours->ahead_hi = 0;
+
+  // Only advertise what the default VFS's file actually supports.
+  static const sqlite3_io_methods kMethods[] = {
+      {1, xClose, xRead, xWrite, xTruncate, xSync, xFileSize, xLock, xUnlock,
+       xCheckReservedLock, xFileControl, xSectorSize, xDeviceCharacteristics},
+      {2, xClose, xRead, xWrite, xTruncate, xSync, xFileSize, xLock, xUnlock,
+       xCheckReservedLock, xFileControl, xSectorSize, xDeviceCharacteristics,
+       xShmMap, xShmLock, xShmBarrier, xShmUnmap},
+      {3, xClose, xRead, xWrite, xTruncate, xSync, xFileSize, xLock, xUnlock,
+       xCheckReservedLock, xFileControl, xSectorSize, xDeviceCharacteristics,
+       xShmMap, xShmLock, xShmBarrier, xShmUnmap, xFetch, xUnfetch},
+  };
+  const int version = std::clamp(ours->real->pMethods->iVersion, 1, 3);
+  file->pMethods = &kMethods[version - 1];
+  return SQLITE_OK;
+}
+
+static int xDelete(sqlite3_vfs *vfs, const char *name, int sync_dir) {
+  return g_real_vfs->xDelete(g_real_vfs, name, sync_dir);
+}
+
+static int xAccess(sqlite3_vfs *vfs, const char *name, int flags, int *out) {
+  return g_real_vfs->xAccess(g_real_vfs, name, flags, out);
+}
+
+static int xFullPathname(sqlite3_vfs *vfs, const char *name, int size,
+                         char *out) {
+  return g_real_vfs->xFullPathname(g_real_vfs, name, size, out);
+}
+
+// static
+const char *SqliteReadaheadVfs::Register(int64_t max_window) {
+  static std::once_flag once;
+
+  g_max_window = std::max(max_window, kMinWindow);
+
+  std::call_once(once, [] {
+    g_real_vfs = sqlite3_vfs_find(nullptr);
+    if (!g_real_vfs) {
+      throw DatabaseError("sqlite3_vfs_find: no default VFS");
+    }
+
+    // Inherit everything (time, randomness, dlopen, ...), then override the
+    // file related entry points.
+    g_vfs = *g_real_vfs;
+    g_vfs.szOsFile = kRealFileOffset + g_real_vfs->szOsFile;
+    g_vfs.pNext = nullptr;
+    g_vfs.zName = kVfsName;
+    g_vfs.xOpen = xOpen;
+    g_vfs.xDelete = xDelete;
+    g_vfs.xAccess = xAccess;
+    g_vfs.xFullPathname = xFullPathname;
+
+    const int rc = sqlite3_vfs_register(&g_vfs, 0);
+    if (rc != SQLITE_OK) {
+      throw DatabaseError(std::string("sqlite3_vfs_register: ") +
+                          sqlite3_errstr(rc));
+    }
+    spdlog::debug("Registered sqlite3 VFS '{0}' over '{1}'", kVfsName,
+                  g_real_vfs->zName);
+  });
+
+  return kVfsName;
+}
+
+// static
+SqliteReadaheadStats SqliteReadaheadVfs::GetStats() {
+  SqliteReadaheadStats stats;
+  stats.reads = g_reads;
+  stats.bytes_read = g_bytes_read;
+  stats.hits = g_hits;
+  stats.readahead_bytes = g_readahead_bytes;
+  stats.stall_time = std::chrono::nanoseconds(g_stall_ns);
+  return stats;
+}
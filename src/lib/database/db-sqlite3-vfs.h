@@ -0,0 +1,46 @@
+// sqlite3 VFS shim that adds read-ahead to the default VFS, for the input map.
+// https://www.sqlite.org/vfs.html
+//
+// Watches each main database file's read pattern.  Once reads look
+// sequential (ex: a rowid scan of `blocks`), it asks the kernel to read ahead
+// of them, in large aligned chunks, from a per-file prefetch thread.  The
+// window doubles while the scan stays sequential, up to `max_window` bytes.
+// Journals, WALs and temp files pass straight through to the default VFS.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Counters summed over every file opened through the VFS.
+struct SqliteReadaheadStats {
+  // Page reads (`xRead()` and `xFetch()`) of main database files.
+  uint64_t reads;
+  uint64_t bytes_read;
+
+  // Reads that fell entirely within a window already handed to the kernel.
+  uint64_t hits;
+
+  // Total size of the read-ahead windows requested.
+  uint64_t readahead_bytes;
+
+  // Wall time spent inside the default VFS's `xRead()`.
+  std::chrono::nanoseconds stall_time;
+
+  double hit_rate() const {
+    return reads ? static_cast<double>(hits) / reads : 0.0;
+  }
+};
+
+class SqliteReadaheadVfs {
+public:
+  SqliteReadaheadVfs() = delete;
+
+  // Registers the VFS (not as the default).  Safe to call more than once;
+  // later calls change `max_window`, which is shared by all files, including
+  // ones that are already open (they use it the next time their window grows).
+  // Returns the VFS name to pass to `sqlite3_open_v2()`.
+  static const char *Register(int64_t max_window);
+
+  static SqliteReadaheadStats GetStats();
+};
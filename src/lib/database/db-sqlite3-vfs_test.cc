@@ -0,0 +1,71 @@
+#include <filesystem>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/database/db-sqlite3-vfs.h"
+#include "src/lib/database/db-sqlite3.h"
+
+using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::Gt;
+
+// Relative to the working directory; `rebuild.sh` wipes it.
+static const std::filesystem::path kTestDir = "tmp/test/db-sqlite3-vfs";
+
+TEST(SqliteReadaheadVfs, SequentialScan) {
+  std::filesystem::create_directories(kTestDir);
+  const std::string filename = (kTestDir / "scan.sqlite").string();
+  std::filesystem::remove(filename);
+
+  // ~4 MiB of 1 KiB rows, written in rowid order.
+  {
+    SqliteDb db(filename);
+    db.Exec("create table blocks (pos int primary key, data blob)");
+    db.Exec("with recursive n(i) as (select 1 union all select i + 1 from n "
+            "where i < 4096) insert into blocks select i, randomblob(1024) "
+            "from n");
+  }
+
+  SqliteOptions options;
+  options.read_only = true;
+  options.cache_size = 10; // Pages.  Make sure we go to the file.
+  options.vfs = SqliteReadaheadVfs::Register(1024 * 1024);
+  const SqliteReadaheadStats before = SqliteReadaheadVfs::GetStats();
+
+  SqliteDb db(filename, options);
+  SqliteStmt stmt(db, "select sum(length(data)) from blocks");
+  ASSERT_TRUE(stmt.Step());
+  EXPECT_THAT(stmt.ColumnInt64(0), Eq(4096 * 1024));
+
+  const SqliteReadaheadStats after = SqliteReadaheadVfs::GetStats();
+  EXPECT_THAT(after.reads - before.reads, Gt(1000));
+  EXPECT_THAT(after.bytes_read - before.bytes_read,
+              Ge(std::filesystem::file_size(filename) / 2));
+  EXPECT_THAT(after.readahead_bytes - before.readahead_bytes,
+              Ge(std::filesystem::file_size(filename) / 2));
+  EXPECT_THAT(after.hits - before.hits, Gt((after.reads - before.reads) / 2));
+  EXPECT_THAT(after.stall_time.count(), Gt(0));
+}
+
+TEST(SqliteReadaheadVfs, Writes) {
+  // Everything but reads passes straight through.
+  std::filesystem::create_directories(kTestDir);
+  const std::string filename = (kTestDir / "write.sqlite").string();
+  std::filesystem::remove(filename);
+
+  SqliteOptions options;
+  options.vfs = SqliteReadaheadVfs::Register(0);
+  {
+    SqliteDb db(filename, options);
+    db.Exec("create table t (a int)");
+    db.Begin();
+    db.Exec("insert into t values (1), (2), (3)");
+    db.Commit();
+  }
+
+  SqliteDb db(filename, options);
+  SqliteStmt stmt(db, "select sum(a) from t");
+  ASSERT_TRUE(stmt.Step());
+  EXPECT_THAT(stmt.ColumnInt64(0), Eq(6));
+}
@@ -71,43 +71,120 @@ void SqliteStmt::BindText(int index, const std::string_view &text) {
 }
 
 std::vector<uint8_t> SqliteStmt::ColumnBlob(int index) {
+  const std::span<const uint8_t> data = ColumnBlobView(index);
+  return std::vector<uint8_t>(data.begin(), data.end());
+}
+
+std::span<const uint8_t> SqliteStmt::ColumnBlobView(int index) {
+  // `sqlite3_column_blob()` first, then `sqlite3_column_bytes()`.
   const uint8_t *data =
       static_cast<const uint8_t *>(sqlite3_column_blob(stmt_.get(), index));
   const size_t data_len = sqlite3_column_bytes(stmt_.get(), index);
 
-  return std::vector<uint8_t>(data, data + data_len);
+  return std::span<const uint8_t>(data, data_len);
 }
 
 SqliteDb::SqliteDb(std::string_view connection_str)
+    : SqliteDb(connection_str, SqliteOptions()) {}
+
+SqliteDb::SqliteDb(std::string_view connection_str,
+                   const SqliteOptions &options)
     : connection_str_(connection_str), database_(), stmt_begin_(),
       stmt_commit_(), stmt_rollback_() {
 
-  // For now, treat connection_str as a raw filename.
-  // Possible future change: treat it as an sqlite3 "URI", so that we can
-  // reuse this code to handle a "read-only" open (via URI params).
+  // `connection_str` is a raw filename.  Read-only opens need URI params, so
+  // we convert it to a URI for those.
+  std::string filename = connection_str_;
+  int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+
+  if (options.read_only) {
+    filename = MakeUri(connection_str_,
+                       options.immutable ? "mode=ro&immutable=1" : "mode=ro");
+    flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_URI;
+  }
+
+  if (options.no_mutex) {
+    flags |= SQLITE_OPEN_NOMUTEX;
+  }
 
   sqlite3 *db = nullptr;
-  int r = sqlite3_open_v2(connection_str_.c_str(), &db,
-                          SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+  int r = sqlite3_open_v2(filename.c_str(), &db, flags,
+                          options.vfs.empty() ? nullptr : options.vfs.c_str());
   if (r != SQLITE_OK) {
+    // Must close the handle even on failure, if one was allocated.
+    sqlite3_close_v2(db);
     throw Sqlite3Error(r,
                        std::string("Failed to create/open sqlite3 database ") +
-                           connection_str_,
+                           filename,
                        "sqlite3_open_v2", "");
   }
 
   sqlite3_extended_result_codes(db, 1);
   database_.reset(db);
 
-  spdlog::debug("Database opened: {0} {1}", connection_str_, GetVersionInfo());
+  spdlog::debug("Database opened: {0} {1}", filename, GetVersionInfo());
+
+  if (options.busy_timeout_ms) {
+    sqlite3_busy_timeout(db, options.busy_timeout_ms);
+  }
+
+  if (options.mmap_size) {
+    Exec("pragma mmap_size = " + std::to_string(options.mmap_size));
+  }
+
+  if (options.cache_size) {
+    Exec("pragma cache_size = " + std::to_string(options.cache_size));
+  }
+
+  if (options.page_size) {
+    Exec("pragma page_size = " + std::to_string(options.page_size));
+  }
 
-  // TODO: Call sqlite3_busy_handler()
+  if (options.bulk_load) {
+    Exec("pragma journal_mode = off");
+    Exec("pragma synchronous = off");
+  }
 
-  stmt_begin_ = std::make_unique<SqliteStmt>(*this, "begin");
+  stmt_begin_ = std::make_unique<SqliteStmt>(
+      *this, options.busy_timeout_ms ? "begin immediate" : "begin");
   stmt_commit_ = std::make_unique<SqliteStmt>(*this, "end");
   stmt_rollback_ = std::make_unique<SqliteStmt>(*this, "rollback");
 }
 
+// static
+std::string SqliteDb::MakeUri(std::string_view filename,
+                              std::string_view query) {
+  // https://www.sqlite.org/uri.html
+  static constexpr char kHex[] = "0123456789ABCDEF";
+
+  std::string uri("file:");
+  uri.reserve(uri.size() + filename.size() + query.size() + 1);
+
+  // "file://" would start an authority section, so never emit two leading
+  // slashes.
+  if ((filename.size() >= 2) && (filename[0] == '/') && (filename[1] == '/')) {
+    filename.remove_prefix(1);
+  }
+
+  for (const char c : filename) {
+    const unsigned char u = static_cast<unsigned char>(c);
+    if ((c == '%') || (c == '?') || (c == '#') || (u < 0x20) || (u >= 0x7f)) {
+      uri += '%';
+      uri += kHex[u >> 4];
+      uri += kHex[u & 15];
+    } else {
+      uri += c;
+    }
+  }
+
+  if (!query.empty()) {
+    uri += '?';
+    uri += query;
+  }
+
+  return uri;
+}
+
 SqliteDb::~SqliteDb() {
   // Can't throw errors here, they call std::terminate().
   sqlite3_close_v2(database_.get());
@@ -138,3 +215,23 @@ void SqliteDb::Exec(const std::string &sql) {
     throw Sqlite3Error(r, sqlite3_errmsg(database_.get()), "sqlite3_exec", sql);
   }
 }
+
+// static
+std::string SqliteMultiInsert::MakeSql(std::string_view head, int columns,
+                                       size_t rows) {
+  std::string group("(");
+  for (int i = 0; i < columns; ++i) {
+    group += i ? ", ?" : "?";
+  }
+  group += ")";
+
+  std::string sql(head);
+  sql += " values ";
+  for (size_t i = 0; i < rows; ++i) {
+    if (i) {
+      sql += ", ";
+    }
+    sql += group;
+  }
+  return sql;
+}
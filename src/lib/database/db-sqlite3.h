@@ -4,6 +4,8 @@
 
 #include <chrono>
 #include <memory>
+#include <span>
+#include <string>
 #include <vector>
 
 #include "src/lib/exceptions/exceptions.h"
@@ -23,6 +25,56 @@ protected:
   std::string sql_;
 };
 
+// How to open an sqlite database.  The defaults (read/write, create if
+// missing, serialized mutex, sqlite's own cache settings) are what we want for
+// our output database.
+struct SqliteOptions {
+  SqliteOptions()
+      : read_only(false), immutable(false), no_mutex(false), mmap_size(0),
+        cache_size(0), busy_timeout_ms(0), bulk_load(false), page_size(0),
+        vfs() {}
+
+  // Open via URI with `mode=ro`.  The file must exist, and the connection can
+  // never take a write lock (important when reading a live server's map).
+  bool read_only;
+
+  // Also pass `immutable=1`, so sqlite skips all locking and change detection.
+  // Only safe if nothing else writes to the file while we have it open.
+  bool immutable;
+
+  // `SQLITE_OPEN_NOMUTEX`.  Only for connections used by a single thread.
+  bool no_mutex;
+
+  // `pragma mmap_size`, in bytes.  Zero keeps sqlite's default (no mmap).
+  // Capped at compile time by `SQLITE_MAX_MMAP_SIZE`.
+  int64_t mmap_size;
+
+  // `pragma cache_size`.  Positive is pages, negative is KiB (sqlite rules).
+  // Zero keeps sqlite's default.
+  int64_t cache_size;
+
+  // `sqlite3_busy_timeout()`: how long to wait for another connection's
+  // write lock, instead of failing with `SQLITE_BUSY`.  Also makes `Begin()`
+  // take the write lock up front (`begin immediate`), as sqlite can not wait
+  // for a reader to become a writer without risking a deadlock.  Zero fails
+  // right away (sqlite's default).
+  int busy_timeout_ms;
+
+  // `pragma journal_mode = off` and `pragma synchronous = off`: no rollback
+  // journal, no fsync.  Much faster writes, but a crash (or a `Rollback()`)
+  // leaves a corrupt database.  Only for output that can be rebuilt from
+  // scratch.
+  bool bulk_load;
+
+  // `pragma page_size`, in bytes (a power of two, 512 to 65536).  Only takes
+  // effect on a new, still empty database.  Zero keeps sqlite's default.
+  int page_size;
+
+  // Name of a registered VFS (ex: `SqliteReadaheadVfs`).  Empty for sqlite's
+  // default VFS.
+  std::string vfs;
+};
+
 class SqliteStmt;
 class SqliteDb {
   friend class SqliteStmt;
@@ -31,8 +83,13 @@ public:
   SqliteDb() = delete;
 
   explicit SqliteDb(std::string_view connection_str);
+  SqliteDb(std::string_view connection_str, const SqliteOptions &options);
   virtual ~SqliteDb();
 
+  // Returns an sqlite3 "file:" URI for `filename`, with `query` (may be
+  // empty) appended.  Escapes characters that are special in URIs.
+  static std::string MakeUri(std::string_view filename, std::string_view query);
+
   // https://stackoverflow.com/a/45215544
   struct sqlite3_deleter {
     void operator()(sqlite3 *db) {
@@ -92,6 +149,10 @@ public:
 
   std::vector<uint8_t> ColumnBlob(int index);
 
+  // Same, without the copy: the view points into sqlite's own buffer, and is
+  // only valid until the next `Step()` or `Reset()`.
+  std::span<const uint8_t> ColumnBlobView(int index);
+
 private:
   struct stmt_deleter {
     void operator()(sqlite3_stmt *stmt) {
@@ -108,3 +169,46 @@ private:
 
   sqlite3 *db_ptr() { return db_.database_.get(); }
 };
+
+// Inserts rows with one `insert ... values (...), (...), ...` statement per
+// `rows_per_step` rows, which costs a single `Step()` (and b-tree descent
+// setup) for all of them.  The remainder goes through a one row statement.
+class SqliteMultiInsert {
+public:
+  SqliteMultiInsert() = delete;
+
+  // `head` is the statement up to `values`, ex: "insert into t (a, b)".
+  SqliteMultiInsert(SqliteDb &db, std::string_view head, int columns,
+                    size_t rows_per_step)
+      : columns_(columns), rows_per_step_(rows_per_step),
+        stmt_many_(db, MakeSql(head, columns, rows_per_step)),
+        stmt_one_(db, MakeSql(head, columns, 1)) {}
+
+  // Returns `head` followed by `rows` groups of `columns` placeholders.
+  static std::string MakeSql(std::string_view head, int columns, size_t rows);
+
+  // Writes `count` rows.  `bind(SqliteStmt &stmt, size_t row, int first)`
+  // binds row `row` to the parameters `first` to `first + columns - 1`.
+  // Bound text and blobs must outlive the call.
+  template <typename Bind> void Insert(size_t count, Bind &&bind) {
+    size_t row = 0;
+    for (; row + rows_per_step_ <= count; row += rows_per_step_) {
+      for (size_t i = 0; i < rows_per_step_; ++i) {
+        bind(stmt_many_, row + i, static_cast<int>(i * columns_ + 1));
+      }
+      stmt_many_.Step();
+      stmt_many_.Reset();
+    }
+    for (; row < count; ++row) {
+      bind(stmt_one_, row, 1);
+      stmt_one_.Step();
+      stmt_one_.Reset();
+    }
+  }
+
+private:
+  const int columns_;
+  const size_t rows_per_step_;
+  SqliteStmt stmt_many_;
+  SqliteStmt stmt_one_;
+};
@@ -0,0 +1,139 @@
+#include <chrono>
+#include <filesystem>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/database/db-sqlite3.h"
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsEmpty;
+
+// Relative to the working directory; `rebuild.sh` wipes it.
+static const std::filesystem::path kTestDir = "tmp/test/db-sqlite3";
+
+static std::string TestFile(const std::string &name) {
+  std::filesystem::create_directories(kTestDir);
+  const std::filesystem::path path = kTestDir / name;
+  std::filesystem::remove(path);
+  return path.string();
+}
+
+TEST(SqliteDb, MakeUri) {
+  EXPECT_THAT(SqliteDb::MakeUri("/a/map.sqlite", ""),
+              Eq("file:/a/map.sqlite"));
+  EXPECT_THAT(SqliteDb::MakeUri("map.sqlite", "mode=ro"),
+              Eq("file:map.sqlite?mode=ro"));
+  EXPECT_THAT(SqliteDb::MakeUri("/w/50% #1?.sqlite", "mode=ro&immutable=1"),
+              Eq("file:/w/50%25 %231%3F.sqlite?mode=ro&immutable=1"));
+  EXPECT_THAT(SqliteDb::MakeUri("//srv/map.sqlite", ""),
+              Eq("file:/srv/map.sqlite"));
+}
+
+TEST(SqliteDb, ReadOnly) {
+  const std::string filename = TestFile("read #only?.sqlite");
+  {
+    SqliteDb db(filename);
+    db.Exec("create table blocks (pos int primary key, data blob)");
+    db.Exec("insert into blocks (pos, data) values (1, x'00')");
+  }
+
+  SqliteOptions options;
+  options.read_only = true;
+  options.no_mutex = true;
+  options.mmap_size = 1024 * 1024;
+  options.cache_size = -4096;
+  SqliteDb db(filename, options);
+
+  SqliteStmt count(db, "select count(1) from blocks");
+  ASSERT_TRUE(count.Step());
+  EXPECT_THAT(count.ColumnInt64(0), Eq(1));
+
+  SqliteStmt cache_size(db, "pragma cache_size");
+  ASSERT_TRUE(cache_size.Step());
+  EXPECT_THAT(cache_size.ColumnInt64(0), Eq(-4096));
+
+  EXPECT_THROW(db.Exec("insert into blocks (pos, data) values (2, x'00')"),
+               Sqlite3Error);
+}
+
+TEST(SqliteDb, ReadOnlyDoesNotCreate) {
+  const std::string filename = TestFile("missing.sqlite");
+
+  SqliteOptions options;
+  options.read_only = true;
+  options.immutable = true;
+  EXPECT_THROW(SqliteDb(filename, options), Sqlite3Error);
+  EXPECT_FALSE(std::filesystem::exists(filename));
+}
+
+TEST(SqliteDb, BusyTimeout) {
+  const std::string filename = TestFile("busy.sqlite");
+  SqliteOptions options;
+  options.busy_timeout_ms = 50;
+
+  SqliteDb first(filename, options);
+  first.Exec("create table blocks (pos int primary key)");
+  SqliteDb second(filename, options);
+
+  // `begin immediate`: the write lock is taken by `Begin()`, so the second
+  // writer waits (then gives up) there, instead of deadlocking later.
+  first.Begin();
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_THROW(second.Begin(), Sqlite3Error);
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(40));
+  first.Commit();
+
+  second.Begin();
+  second.Exec("insert into blocks (pos) values (1)");
+  second.Commit();
+}
+
+TEST(SqliteMultiInsert, MakeSql) {
+  EXPECT_THAT(SqliteMultiInsert::MakeSql("insert into t (a, b)", 2, 3),
+              Eq("insert into t (a, b) values (?, ?), (?, ?), (?, ?)"));
+  EXPECT_THAT(SqliteMultiInsert::MakeSql("insert into t (a)", 1, 1),
+              Eq("insert into t (a) values (?)"));
+}
+
+TEST(SqliteMultiInsert, Insert) {
+  const std::string filename = TestFile("multi.sqlite");
+  SqliteDb db(filename);
+  db.Exec("create table t (a integer primary key, b text)");
+
+  // Three two row statements, then one single row.
+  const std::vector<std::string> names = {"a", "b", "c", "d", "e", "f", "g"};
+  SqliteMultiInsert insert(db, "insert into t (a, b)", 2, 2);
+  insert.Insert(names.size(), [&names](SqliteStmt &stmt, size_t row,
+                                       int first) {
+    stmt.BindInt(first, row);
+    stmt.BindText(first + 1, names[row]);
+  });
+
+  SqliteStmt select(db, "select a, b from t order by a");
+  for (size_t i = 0; i < names.size(); ++i) {
+    ASSERT_TRUE(select.Step());
+    EXPECT_THAT(select.ColumnInt64(0), Eq(i));
+    EXPECT_THAT(select.ColumnText(1), Eq(names[i]));
+  }
+  EXPECT_FALSE(select.Step());
+}
+
+TEST(SqliteStmt, ColumnBlob) {
+  SqliteDb db(TestFile("blob.sqlite"));
+  db.Exec("create table t (a blob)");
+  db.Exec("insert into t (a) values (x'0102ff'), (x'')");
+
+  SqliteStmt select(db, "select a from t order by rowid");
+  ASSERT_TRUE(select.Step());
+  const std::span<const uint8_t> view = select.ColumnBlobView(0);
+  EXPECT_THAT(std::vector<uint8_t>(view.begin(), view.end()),
+              ElementsAre(0x01, 0x02, 0xff));
+  EXPECT_THAT(select.ColumnBlob(0), ElementsAre(0x01, 0x02, 0xff));
+
+  ASSERT_TRUE(select.Step());
+  EXPECT_THAT(select.ColumnBlobView(0), IsEmpty());
+  EXPECT_THAT(select.ColumnBlob(0), IsEmpty());
+}
@@ -137,32 +137,47 @@ public:
     by_string_.reserve(IdMap<TExtra>::kReservedSize);
   }
 
-  size_t Add(const std::string &key) {
+  // Cache hits do not copy `key`.
+  size_t Add(std::string_view key) {
     const auto iter = by_string_.find(key);
     if (iter != by_string_.end()) {
       return iter->second;
     }
 
-    const size_t id = shared_cache_.Add(key);
+    std::string owned(key);
+    const size_t id = shared_cache_.Add(owned);
 
-    if (id > by_id_.size()) {
+    if (id >= by_id_.size()) {
       by_id_.resize(id + 1);
     }
     by_id_[id] = &(shared_cache_.Get(id));
-    by_string_[key] = id;
+    by_string_.emplace(std::move(owned), id);
     return id;
   }
 
-  const IdMapItem<TExtra> &Get(size_t id) const {
-    const IdMapItem<TExtra> *foo = by_id_.at(id);
-    if (foo->key.empty()) {
-      return shared_cache_.Get(id);
+  // Also finds ids that another thread added.  Throws exception if not found.
+  const IdMapItem<TExtra> &Get(size_t id) {
+    if (id >= by_id_.size()) {
+      by_id_.resize(id + 1);
+    }
+    const IdMapItem<TExtra> *&item = by_id_[id];
+    if (!item) {
+      item = &(shared_cache_.Get(id));
     }
-    return *foo;
+    return *item;
   }
 
 private:
+  // Lets `by_string_` be searched with a `std::string_view`.
+  struct KeyHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view key) const {
+      return std::hash<std::string_view>()(key);
+    }
+  };
+
   IdMap<TExtra> &shared_cache_;
   std::vector<const IdMapItem<TExtra> *> by_id_;
-  std::unordered_map<std::string, size_t> by_string_;
+  std::unordered_map<std::string, size_t, KeyHash, std::equal_to<>>
+      by_string_;
 };
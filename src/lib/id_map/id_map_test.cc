@@ -57,6 +57,12 @@ TEST(ThreadLocalIdMap, General) {
 
   EXPECT_THAT(a.Add("bar"), Eq(2));
   EXPECT_THAT(b.Add("foo"), Eq(1));
+  EXPECT_THAT(a.Add(std::string_view("barn").substr(0, 3)), Eq(2));
+
+  // Ids added through another thread's map.
+  ThreadLocalIdMap<int> c(top);
+  EXPECT_THAT(c.Get(2).key, Eq("bar"));
+  EXPECT_THAT(c.Get(1).key, Eq("foo"));
 }
 
 TEST(IdMap, ExtraInfoCallback) {
@@ -1,25 +1,22 @@
-#include <zlib.h>
 #include <zstd.h>
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 
 #include "blob_reader.h"
+#include "inflate.h"
 #include "utils.h"
 
 static constexpr size_t BUFFER_SIZE = 1024 * 32;
 
 namespace {
-constexpr size_t ZSTD_BUFSIZE = 32768;
-
-constexpr size_t kDefaultReserveSize = 128 * 1024;
-
 struct ZSTD_C_Deleter {
   void operator()(ZSTD_CStream *cstream) { ZSTD_freeCStream(cstream); }
 };
 
 struct ZSTD_D_Deleter {
-  void operator()(ZSTD_DStream *dstream) { ZSTD_freeDStream(dstream); }
+  void operator()(ZSTD_DCtx *dctx) { ZSTD_freeDCtx(dctx); }
 };
 
 } // namespace
@@ -39,18 +36,18 @@ SerializationError::SerializationError(const BlobReader &br,
   msg_ = ss.str();
 }
 
-std::string BlobReader::read_line(const std::string_view desc) {
+std::string_view BlobReader::read_line(const std::string_view desc) {
   const char *start = reinterpret_cast<const char *>(_ptr);
-  std::string dest;
 
-  while ((_ptr + 1) <= &(*_blob.end())) {
+  while (_ptr < end()) {
     if (isprint(*_ptr)) {
       _ptr++;
       continue;
     } else if (*_ptr == '\n') {
-      dest.assign(start, reinterpret_cast<const char *>(_ptr) - start);
+      const std::string_view line(start,
+                                  reinterpret_cast<const char *>(_ptr) - start);
       _ptr++;
-      return dest;
+      return line;
     } else {
       throw SerializationError(*this, desc,
                                "Garbage data found during read_line()");
@@ -61,102 +58,128 @@ std::string BlobReader::read_line(const std::string_view desc) {
                            "End of blob without \\n during read_line()");
 }
 
-std::vector<uint8_t> BlobReader::decompress_zlib(const std::string_view desc) {
-  z_stream z{};
-  int status = 0;
-  std::vector<uint8_t> dest;
-
-  dest.reserve(BUFFER_SIZE);
-
-  z.zalloc = Z_NULL;
-  z.zfree = Z_NULL;
-  z.opaque = Z_NULL;
-  z.avail_in = 0;
-
-  if (inflateInit(&z) != Z_OK) {
-    throw SerializationError(*this, desc,
-                             "decompress_zlib(), inflateInit() failed.");
-  }
-
-  while (true) {
-    // Do we have anything to read?
-    if (!z.avail_in) {
-      z.next_in = const_cast<uint8_t *>(ptr());
-      z.avail_in = &*_blob.end() - ptr();
-    }
+size_t BlobReader::decompress_zlib(const std::string_view desc,
+                                  std::span<uint8_t> dest) {
+  const Inflater::Result r =
+      Inflater::ForThread().Inflate(std::span(ptr(), remaining()), dest);
 
-    if (z.avail_in <= 0) {
+  switch (r.status) {
+    case Inflater::Status::OK:
       break;
-    }
-    const size_t src_orig_size = z.avail_in;
-
-    // Make room to write to the output vector.
-    // Note that we are writing directly to the output vector.
-    dest.resize(dest.size() + BUFFER_SIZE);
-    z.avail_out = BUFFER_SIZE;
-    z.next_out = dest.data() + z.total_out;
-
-    // Decompress.
-    status = inflate(&z, Z_NO_FLUSH);
-    int bytes_read = src_orig_size - z.avail_in;
-    //  int bytes_written = BUFFER_SIZE - z.avail_out;
-
-    if ((status != Z_STREAM_END) && (status != Z_OK)) {
-      std::stringstream ss;
-      ss << "zlib error: " << status << ", " << (z.msg ? z.msg : "");
-      throw SerializationError(*this, desc, ss.str());
-    }
+    case Inflater::Status::OUTPUT_FULL:
+      throw SerializationError(*this, desc,
+                               "decompress_zlib(), more than " +
+                                   std::to_string(dest.size()) + " bytes.");
+    case Inflater::Status::BAD_DATA:
+      throw SerializationError(*this, desc, r.error);
+  }
 
-    // Update input stream pointer.
-    skip(bytes_read, "zlib.inflate");
+  // Update input stream pointer.
+  skip(r.consumed, "zlib.inflate");
+  return r.produced;
+}
 
-    if (status == Z_STREAM_END) {
-      // Update output buffer size/end.  "dest->size()" is likely bigger than
-      // the amount of data that we actually have.
-      dest.resize(z.total_out);
-      break;
+void BlobReader::decompress_zlib(const std::string_view desc,
+                                 std::vector<uint8_t> *dest) {
+  // The backends want all of the output space up front, so start over with
+  // twice the space when it runs out.  Reused buffers rarely need to.
+  dest->resize(std::max(dest->capacity(), BUFFER_SIZE));
+  while (true) {
+    const Inflater::Result r =
+        Inflater::ForThread().Inflate(std::span(ptr(), remaining()), *dest);
+
+    switch (r.status) {
+      case Inflater::Status::OK:
+        dest->resize(r.produced);
+        skip(r.consumed, "zlib.inflate");
+        return;
+      case Inflater::Status::OUTPUT_FULL:
+        if (dest->size() >= kMaxDecompressedSize) {
+          throw SerializationError(*this, desc,
+                                   "decompress_zlib(), more than " +
+                                       std::to_string(dest->size()) +
+                                       " bytes.");
+        }
+        dest->resize(std::min(dest->size() * 2, kMaxDecompressedSize));
+        break;
+      case Inflater::Status::BAD_DATA:
+        throw SerializationError(*this, desc, r.error);
     }
   }
-
-  inflateEnd(&z);
-
-  return dest;
 }
 
-std::vector<uint8_t> BlobReader::decompress_zstd(const std::string_view desc) {
+void BlobReader::decompress_zstd(const std::string_view desc,
+                                 std::vector<uint8_t> *dest) {
   // Reusing the context is recommended for performance.  It will be destroyed
   // when the thread ends
-  thread_local std::unique_ptr<ZSTD_DStream, ZSTD_D_Deleter> stream(
-      ZSTD_createDStream());
-  ZSTD_initDStream(stream.get());
+  thread_local std::unique_ptr<ZSTD_DCtx, ZSTD_D_Deleter> dctx(
+      ZSTD_createDCtx());
 
-  // Input buffer.
-  ZSTD_inBuffer zinput = {const_cast<uint8_t *>(ptr()), remaining(), 0};
-
-  // Output buffer.
-  std::vector<uint8_t> output;
-  output.reserve(kDefaultReserveSize);
-
-  while (zinput.pos < zinput.size) {
-    // Extend output buffer.
-    size_t tail = output.size();
-    output.resize(tail + ZSTD_BUFSIZE);
-
-    // Reset where ZSTD should write to.
-    ZSTD_outBuffer zoutput = {output.data() + tail, ZSTD_BUFSIZE, 0};
+  const size_t frame_size = ZSTD_findFrameCompressedSize(ptr(), remaining());
+  if (ZSTD_isError(frame_size)) {
+    throw SerializationError(*this, desc,
+                             std::string("decompress_zstd: ") +
+                                 ZSTD_getErrorName(frame_size));
+  }
 
-    size_t ret = ZSTD_decompressStream(stream.get(), &zoutput, &zinput);
-    if (ZSTD_isError(ret)) {
+  // Minetest writes the content size into the frame header, so the whole
+  // frame can be decompressed in one go.
+  const unsigned long long content_size =
+      ZSTD_getFrameContentSize(ptr(), frame_size);
+  if (content_size == ZSTD_CONTENTSIZE_ERROR) {
+    throw SerializationError(*this, desc, "decompress_zstd: bad frame header");
+  }
+  // Checked before allocating: the size comes straight from the blob.
+  if ((content_size != ZSTD_CONTENTSIZE_UNKNOWN) &&
+      (content_size > kMaxDecompressedSize)) {
+    throw SerializationError(*this, desc,
+                             "decompress_zstd: content size " +
+                                 std::to_string(content_size) + " too large");
+  }
+  if (content_size != ZSTD_CONTENTSIZE_UNKNOWN) {
+    dest->resize(content_size);
+    const size_t ret = ZSTD_decompressDCtx(dctx.get(), dest->data(),
+                                           dest->size(), ptr(), frame_size);
+    if (ZSTD_isError(ret) || (ret != content_size)) {
       throw SerializationError(
-          *this, desc, std::string("decompress_zstd") + ZSTD_getErrorName(ret));
+          *this, desc,
+          std::string("decompress_zstd: ") +
+              (ZSTD_isError(ret) ? ZSTD_getErrorName(ret) : "size mismatch"));
     }
+    skip(frame_size, "zstd.decompress");
+    return;
+  }
 
-    // Adjust end of buffer (chop of part not used)
-    output.resize(tail + zoutput.pos);
+  // No size in the header: stream, doubling the output space as needed.
+  ZSTD_DCtx_reset(dctx.get(), ZSTD_reset_session_only);
+  ZSTD_inBuffer zinput = {ptr(), frame_size, 0};
+  dest->resize(std::max(dest->capacity(), BUFFER_SIZE));
+  ZSTD_outBuffer zoutput = {dest->data(), dest->size(), 0};
+  while (true) {
+    const size_t ret = ZSTD_decompressStream(dctx.get(), &zoutput, &zinput);
+    if (ZSTD_isError(ret)) {
+      throw SerializationError(*this, desc,
+                               std::string("decompress_zstd: ") +
+                                   ZSTD_getErrorName(ret));
+    }
+    if (!ret) {
+      break;
+    }
+    if (zinput.pos == zinput.size && zoutput.pos < zoutput.size) {
+      throw SerializationError(*this, desc, "decompress_zstd: truncated");
+    }
+    if (zoutput.pos == zoutput.size) {
+      if (dest->size() >= kMaxDecompressedSize) {
+        throw SerializationError(*this, desc,
+                                 "decompress_zstd: more than " +
+                                     std::to_string(dest->size()) + " bytes");
+      }
+      dest->resize(std::min(dest->size() * 2, kMaxDecompressedSize));
+      zoutput = {dest->data(), dest->size(), zoutput.pos};
+    }
   }
+  dest->resize(zoutput.pos);
 
   // Update input stream pointer.
   skip(zinput.pos, "zstd.decompress");
-
-  return output;
 }
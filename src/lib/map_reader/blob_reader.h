@@ -1,10 +1,13 @@
-// Utility class that holds a const reference to a vector of data.
+// Utility class that holds a view of a blob of data.
 // Provides handy accessors for reading this data, and converting it from
 // big-endian format to machine-native format.
+// Nothing is copied: the blob (ex: a sqlite column buffer) must outlive the
+// reader, and any string views read from it.
 
 #pragma once
 
 #include <arpa/inet.h>
+#include <span>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -23,22 +26,27 @@ public:
 
 class BlobReader {
 public:
+  // Most a compressed section may decompress to into a vector.  A mapblock's
+  // nodes take 16 KiB; the limit keeps a corrupt size (or a decompression
+  // bomb) down to a `SerializationError`, rather than running out of memory.
+  static constexpr size_t kMaxDecompressedSize = 16 * 1024 * 1024;
+
   BlobReader() = delete;
-  explicit BlobReader(const std::vector<uint8_t> &blob)
+  explicit BlobReader(std::span<const uint8_t> blob)
       : _blob(blob), _ptr(blob.data()) {}
 
-  const std::vector<uint8_t> &data() const { return _blob; }
+  std::span<const uint8_t> data() const { return _blob; }
   const uint8_t *ptr() const { return _ptr; }
 
   size_t size() const { return _blob.size(); }
-  size_t remaining() const { return &*_blob.end() - _ptr; }
-  size_t offset() const { return _ptr - &*_blob.begin(); }
+  size_t remaining() const { return end() - _ptr; }
+  size_t offset() const { return _ptr - _blob.data(); }
   bool eof() const { return !remaining(); }
 
   // Throws error is the amount of requested bytes is not available.
 
   void size_check(size_t bytes, const std::string_view desc) const {
-    if ((_ptr + bytes) <= &(*_blob.end())) {
+    if (bytes <= remaining()) {
       return;
     }
 
@@ -81,31 +89,42 @@ public:
     return ret;
   }
 
-  // TODO: Can re return a string_view instead?
-  std::string read_str(uint32_t len, const std::string_view desc) {
+  // The view points into the blob, copy it to keep it around longer.
+  std::string_view read_str(uint32_t len, const std::string_view desc) {
     size_check(len, desc);
-    std::string ret(reinterpret_cast<const char *>(_ptr), len);
+    std::string_view ret(reinterpret_cast<const char *>(_ptr), len);
     _ptr += len;
     return ret;
   }
 
-  // Reads chars from from _ptr to '\n', returns string (trimmed).
+  // Reads chars from from _ptr to '\n', returns them (trimmed), as a view
+  // into the blob.
   // Throws exception to indicate blob overrun.
-  std::string read_line(const std::string_view desc);
-
-  // Assume that `_ptr` points to a zlib compressed block.  Return decompressed
-  // data and update this->_ptr to point to the first byte after the zlib
-  // compressed stream ends.
-  // Will throw an exception if decompression fails.
-  std::vector<uint8_t> decompress_zlib(const std::string_view desc);
-
-  // Assume that `_ptr` points to a zstd compressed block.  Return decompressed
-  // data and update this->_ptr to point to the first byte after the zstd
-  // compressed stream ends.
-  // Will throw an exception if decompression fails.
-  std::vector<uint8_t> decompress_zstd(const std::string_view desc);
+  std::string_view read_line(const std::string_view desc);
+
+  // Assume that `_ptr` points to a zlib compressed block.  Decompress it into
+  // `dest`, return the decompressed size, and update this->_ptr to point to
+  // the first byte after the zlib compressed stream ends.
+  // Will throw an exception if decompression fails, or the data does not fit
+  // into `dest`.
+  size_t decompress_zlib(const std::string_view desc, std::span<uint8_t> dest);
+
+  // Same, but into `*dest`, which is resized to fit (up to
+  // `kMaxDecompressedSize`).  Reuse `*dest` to save on allocations.
+  void decompress_zlib(const std::string_view desc, std::vector<uint8_t> *dest);
+
+  // Assume that `_ptr` points to a zstd compressed frame.  Decompress it into
+  // `*dest`, which is resized to fit, and update this->_ptr to point to the
+  // first byte after the frame.  Frames that record their size (all of
+  // Minetest's) are decompressed in a single call.  Reuse `*dest` to save on
+  // allocations.
+  // Will throw an exception if decompression fails, or the frame holds more
+  // than `kMaxDecompressedSize` bytes.
+  void decompress_zstd(const std::string_view desc, std::vector<uint8_t> *dest);
 
 private:
-  const std::vector<uint8_t> &_blob;
+  const uint8_t *end() const { return _blob.data() + _blob.size(); }
+
+  std::span<const uint8_t> _blob;
   const uint8_t *_ptr;
 };
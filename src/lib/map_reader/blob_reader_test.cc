@@ -1,3 +1,9 @@
+#include <zlib.h>
+#include <zstd.h>
+
+#include <array>
+#include <iterator>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -7,6 +13,7 @@ using ::testing::Eq;
 using ::testing::IsEmpty;
 using ::testing::IsFalse;
 using ::testing::IsTrue;
+using ::testing::Le;
 using ::testing::Ne;
 using ::testing::Pointwise;
 using ::testing::SizeIs;
@@ -51,8 +58,10 @@ TEST(BlobReader, General) {
   EXPECT_THAT(len, Eq(5));
   EXPECT_THAT(r.remaining(), Eq(5));
 
-  std::string s = r.read_str(len, "str");
+  // Points into `input`, no copy.
+  const std::string_view s = r.read_str(len, "str");
   EXPECT_THAT(s, Eq("hello"));
+  EXPECT_THAT(static_cast<const void *>(s.data()), Eq(&input[9]));
   EXPECT_THAT(r.remaining(), Eq(0));
 
   // We should have reached EOF.
@@ -61,5 +70,184 @@ TEST(BlobReader, General) {
   EXPECT_THROW(r.read_u8("past_eof"), SerializationError);
 }
 
-// TODO: Need unit test for `BlobReader::decompress_zlib()`
-// TODO: Need unit test for `BlobReader::read_line()`
+// `size` bytes of compressible data, zlib compressed, then `trailer`.
+static std::vector<uint8_t> ZlibBlob(size_t size, std::vector<uint8_t> *raw,
+                                     const std::vector<uint8_t> &trailer) {
+  raw->resize(size);
+  for (size_t i = 0; i < size; ++i) {
+    (*raw)[i] = (i * 7) % 13;
+  }
+
+  uLongf compressed_size = compressBound(size);
+  std::vector<uint8_t> blob(compressed_size);
+  EXPECT_THAT(compress(blob.data(), &compressed_size, raw->data(), size),
+              Eq(Z_OK));
+  blob.resize(compressed_size);
+  blob.insert(blob.end(), trailer.begin(), trailer.end());
+  return blob;
+}
+
+TEST(BlobReader, DecompressZlibIntoSpan) {
+  std::vector<uint8_t> raw;
+  const std::vector<uint8_t> blob = ZlibBlob(16384, &raw, {0x42});
+
+  // Exactly the right size, twice (reusing the thread's decompressor).
+  for (int i = 0; i < 2; ++i) {
+    BlobReader r(blob);
+    std::array<uint8_t, 16384> dest;
+    EXPECT_THAT(r.decompress_zlib("nodes", dest), Eq(raw.size()));
+    EXPECT_THAT(dest, Pointwise(Eq(), raw));
+
+    // Stops right after the stream.
+    EXPECT_THAT(r.read_u8("trailer"), Eq(0x42));
+    EXPECT_THAT(r.eof(), IsTrue());
+  }
+
+  // Too small.
+  BlobReader small(blob);
+  std::array<uint8_t, 16383> small_dest;
+  EXPECT_THROW(small.decompress_zlib("nodes", small_dest), SerializationError);
+
+  // Truncated.
+  const std::vector<uint8_t> truncated(blob.begin(), blob.begin() + 10);
+  BlobReader bad(truncated);
+  std::array<uint8_t, 16384> bad_dest;
+  EXPECT_THROW(bad.decompress_zlib("nodes", bad_dest), SerializationError);
+}
+
+TEST(BlobReader, DecompressZlibIntoVector) {
+  std::vector<uint8_t> raw;
+  const std::vector<uint8_t> blob = ZlibBlob(100000, &raw, {0x42});
+
+  // Grows past the initial 32 KiB.
+  BlobReader r(blob);
+  std::vector<uint8_t> dest;
+  r.decompress_zlib("metadata", &dest);
+  EXPECT_THAT(dest, Eq(raw));
+  EXPECT_THAT(r.read_u8("trailer"), Eq(0x42));
+
+  // Shrinks for a smaller stream, keeping the buffer.
+  const std::vector<uint8_t> small = ZlibBlob(3, &raw, {});
+  BlobReader r2(small);
+  r2.decompress_zlib("metadata", &dest);
+  EXPECT_THAT(dest, Eq(raw));
+  EXPECT_THAT(r2.eof(), IsTrue());
+
+  const std::vector<uint8_t> garbage = {1, 2, 3, 4};
+  BlobReader bad(garbage);
+  EXPECT_THROW(bad.decompress_zlib("metadata", &dest), SerializationError);
+
+  // Stops growing at the limit.
+  const std::vector<uint8_t> bomb =
+      ZlibBlob(BlobReader::kMaxDecompressedSize + 1, &raw, {});
+  BlobReader r3(bomb);
+  EXPECT_THROW(r3.decompress_zlib("metadata", &dest), SerializationError);
+  EXPECT_THAT(dest.size(), Le(BlobReader::kMaxDecompressedSize));
+}
+
+// Same as `ZlibBlob()`, for a zstd frame, with or without its content size
+// in the header.
+static std::vector<uint8_t> ZstdBlob(size_t size, std::vector<uint8_t> *raw,
+                                     const std::vector<uint8_t> &trailer,
+                                     bool content_size) {
+  raw->resize(size);
+  for (size_t i = 0; i < size; ++i) {
+    (*raw)[i] = (i * 7) % 13;
+  }
+
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, content_size);
+  std::vector<uint8_t> blob(ZSTD_compressBound(size));
+  const size_t compressed_size =
+      ZSTD_compress2(cctx, blob.data(), blob.size(), raw->data(), size);
+  ZSTD_freeCCtx(cctx);
+  EXPECT_THAT(ZSTD_isError(compressed_size), IsFalse());
+  blob.resize(compressed_size);
+  blob.insert(blob.end(), trailer.begin(), trailer.end());
+  return blob;
+}
+
+TEST(BlobReader, DecompressZstd) {
+  for (const bool content_size : {true, false}) {
+    std::vector<uint8_t> raw;
+    const std::vector<uint8_t> blob =
+        ZstdBlob(100000, &raw, {0x42}, content_size);
+    EXPECT_THAT(ZSTD_getFrameContentSize(blob.data(), blob.size()) ==
+                    ZSTD_CONTENTSIZE_UNKNOWN,
+                Ne(content_size));
+
+    // Grows past the initial 32 KiB when streaming.
+    BlobReader r(blob);
+    std::vector<uint8_t> dest;
+    r.decompress_zstd("format-29", &dest);
+    EXPECT_THAT(dest, Eq(raw));
+
+    // Stops right after the frame.
+    EXPECT_THAT(r.read_u8("trailer"), Eq(0x42));
+    EXPECT_THAT(r.eof(), IsTrue());
+
+    // Shrinks for a smaller frame, keeping the buffer.
+    const uint8_t *const data = dest.data();
+    const std::vector<uint8_t> small = ZstdBlob(3, &raw, {}, content_size);
+    BlobReader r2(small);
+    r2.decompress_zstd("format-29", &dest);
+    EXPECT_THAT(dest, Eq(raw));
+    EXPECT_THAT(dest.data(), Eq(data));
+    EXPECT_THAT(r2.eof(), IsTrue());
+
+    // Truncated.
+    const std::vector<uint8_t> truncated(blob.begin(), blob.end() - 8);
+    BlobReader bad(truncated);
+    EXPECT_THROW(bad.decompress_zstd("format-29", &dest), SerializationError);
+  }
+
+  const std::vector<uint8_t> garbage = {1, 2, 3, 4};
+  std::vector<uint8_t> dest;
+  BlobReader bad(garbage);
+  EXPECT_THROW(bad.decompress_zstd("format-29", &dest), SerializationError);
+}
+
+TEST(BlobReader, DecompressZstdTooLarge) {
+  // A header that claims 2^62 bytes of content: its 4 byte size field is
+  // widened to 8 bytes.
+  std::vector<uint8_t> raw;
+  std::vector<uint8_t> forged = ZstdBlob(100000, &raw, {}, true);
+  const uint8_t descriptor = forged[4];
+  ASSERT_THAT(descriptor >> 6, Eq(2));
+  const size_t size_field = 5 + ((descriptor & 0x20) ? 0 : 1);
+  forged[4] = descriptor | 0xc0;
+  forged.erase(forged.begin() + size_field,
+               forged.begin() + size_field + 4);
+  const uint8_t huge[] = {0, 0, 0, 0, 0, 0, 0, 0x40};
+  forged.insert(forged.begin() + size_field, std::begin(huge),
+                std::end(huge));
+  ASSERT_THAT(ZSTD_getFrameContentSize(forged.data(), forged.size()),
+              Eq(1ull << 62));
+
+  std::vector<uint8_t> dest;
+  BlobReader r(forged);
+  EXPECT_THROW(r.decompress_zstd("format-29", &dest), SerializationError);
+
+  // Without a size in the header, streaming stops at the limit too.
+  const std::vector<uint8_t> bomb =
+      ZstdBlob(BlobReader::kMaxDecompressedSize + 1, &raw, {}, false);
+  BlobReader r2(bomb);
+  EXPECT_THROW(r2.decompress_zstd("format-29", &dest), SerializationError);
+  EXPECT_THAT(dest.size(), Le(BlobReader::kMaxDecompressedSize));
+}
+
+TEST(BlobReader, ReadLine) {
+  const std::string text = "List main 2\n\nEnd\nno newline";
+  const std::vector<uint8_t> input(text.begin(), text.end());
+
+  // Over part of the vector only.
+  BlobReader r(std::span<const uint8_t>(input).subspan(5));
+  EXPECT_THAT(r.read_line("line"), Eq("main 2"));
+  EXPECT_THAT(r.read_line("line"), IsEmpty());
+  EXPECT_THAT(r.read_line("line"), Eq("End"));
+  EXPECT_THROW(r.read_line("line"), SerializationError);
+
+  const std::vector<uint8_t> garbage = {'a', 0x01, '\n'};
+  BlobReader bad(garbage);
+  EXPECT_THROW(bad.read_line("line"), SerializationError);
+}
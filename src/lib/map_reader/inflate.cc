@@ -0,0 +1,99 @@
+#include "src/lib/map_reader/inflate.h"
+
+#if HAS_LIBDEFLATE
+#include <libdeflate.h>
+#else
+#include <zlib.h>
+#endif
+
+#include <new>
+
+#if HAS_LIBDEFLATE
+
+Inflater::Inflater() : state_(libdeflate_alloc_decompressor()) {
+  if (!state_) {
+    throw std::bad_alloc();
+  }
+}
+
+Inflater::~Inflater() {
+  libdeflate_free_decompressor(
+      static_cast<libdeflate_decompressor *>(state_));
+}
+
+const char *Inflater::backend() { return "libdeflate"; }
+
+Inflater::Result Inflater::Inflate(std::span<const uint8_t> input,
+                                   std::span<uint8_t> output) {
+  size_t consumed = 0;
+  size_t produced = 0;
+  const libdeflate_result r = libdeflate_zlib_decompress_ex(
+      static_cast<libdeflate_decompressor *>(state_), input.data(),
+      input.size(), output.data(), output.size(), &consumed, &produced);
+
+  switch (r) {
+    case LIBDEFLATE_SUCCESS:
+      return Result{Status::OK, consumed, produced, ""};
+    case LIBDEFLATE_INSUFFICIENT_SPACE:
+      return Result{Status::OUTPUT_FULL, 0, output.size(), ""};
+    default:
+      return Result{Status::BAD_DATA, 0, 0,
+                    "libdeflate error " + std::to_string(r)};
+  }
+}
+
+#else
+
+Inflater::Inflater() : state_(new z_stream{}) {
+  z_stream *z = static_cast<z_stream *>(state_);
+  z->zalloc = Z_NULL;
+  z->zfree = Z_NULL;
+  z->opaque = Z_NULL;
+  if (inflateInit(z) != Z_OK) {
+    delete z;
+    throw std::bad_alloc();
+  }
+}
+
+Inflater::~Inflater() {
+  z_stream *z = static_cast<z_stream *>(state_);
+  inflateEnd(z);
+  delete z;
+}
+
+const char *Inflater::backend() { return "zlib"; }
+
+Inflater::Result Inflater::Inflate(std::span<const uint8_t> input,
+                                   std::span<uint8_t> output) {
+  z_stream *z = static_cast<z_stream *>(state_);
+
+  // Keeps the window and tables allocated by `inflateInit()`.
+  inflateReset(z);
+  z->next_in = const_cast<uint8_t *>(input.data());
+  z->avail_in = input.size();
+  z->next_out = output.data();
+  z->avail_out = output.size();
+
+  // Everything is in memory already: one call does it all.
+  const int status = inflate(z, Z_FINISH);
+  const size_t produced = output.size() - z->avail_out;
+
+  if (status == Z_STREAM_END) {
+    return Result{Status::OK, input.size() - z->avail_in, produced, ""};
+  }
+  if (((status == Z_BUF_ERROR) || (status == Z_OK)) && !z->avail_out) {
+    return Result{Status::OUTPUT_FULL, 0, produced, ""};
+  }
+  return Result{Status::BAD_DATA, 0, produced,
+                "zlib error " + std::to_string(status) + ", " +
+                    (z->msg ? z->msg : "truncated stream")};
+}
+
+#endif
+
+// static
+Inflater &Inflater::ForThread() {
+  // Destroyed when the thread ends.
+  thread_local Inflater inflater;
+  return inflater;
+}
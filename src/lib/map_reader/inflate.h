@@ -0,0 +1,61 @@
+// Decompresses zlib streams (the node data and metadata of format 28
+// mapblocks), reusing one decompressor per thread instead of setting up a
+// new one (and its 40+ KiB of state) per stream.
+//
+// Backed by libdeflate (https://github.com/ebiggers/libdeflate) when built
+// with `HAS_LIBDEFLATE=1`, and by zlib otherwise.  libdeflate decompresses
+// whole buffers only, which is all we need, and is about twice as fast.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+#if !defined(HAS_LIBDEFLATE)
+#define HAS_LIBDEFLATE 0
+#endif
+
+class Inflater {
+public:
+  enum class Status {
+    OK,
+    // `output` is too small for the decompressed data.
+    OUTPUT_FULL,
+    // Corrupt or truncated stream.
+    BAD_DATA,
+  };
+
+  struct Result {
+    Status status;
+
+    // Bytes of `input` taken by the stream (`OK` only), and bytes written to
+    // `output`.
+    size_t consumed;
+    size_t produced;
+
+    // Backend's description of the problem, if any.
+    std::string error;
+  };
+
+  Inflater(const Inflater &) = delete;
+  Inflater &operator=(const Inflater &) = delete;
+  ~Inflater();
+
+  // The calling thread's.
+  static Inflater &ForThread();
+
+  // "zlib" or "libdeflate".
+  static const char *backend();
+
+  // Decompresses the zlib stream at the start of `input` (which may go on
+  // past its end) into `output`.
+  Result Inflate(std::span<const uint8_t> input, std::span<uint8_t> output);
+
+private:
+  Inflater();
+
+  // `z_stream` or `libdeflate_decompressor`.
+  void *state_;
+};
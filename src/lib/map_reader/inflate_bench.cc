@@ -0,0 +1,156 @@
+// Compares zlib decompression strategies on the zlib streams (node data and
+// metadata) of the format 28 mapblocks in a map.sqlite file.
+//
+// usage: inflate_bench map.sqlite [passes]
+//
+// "zlib, new state" is how `BlobReader::decompress_zlib()` used to work
+// (`inflateInit()` / `inflateEnd()`, and a fresh output vector, per stream).
+// "Inflater" is what it does now, with whichever backend this was built with
+// (`HAS_LIBDEFLATE`); build it both ways to compare the backends.
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "src/lib/database/db-sqlite3.h"
+#include "src/lib/map_reader/blob_reader.h"
+#include "src/lib/map_reader/inflate.h"
+
+// version, flags, lighting_complete, content_width, params_width.
+static constexpr size_t kFormat28HeaderSize = 6;
+
+// Decompressed sizes of node data are 16 KiB; metadata is mostly tiny.
+static constexpr size_t kOutputSize = 64 * 1024;
+
+struct Stream {
+  std::span<const uint8_t> data;
+  size_t decompressed_size;
+};
+
+// Loads the format 28 blobs of `filename` into `blobs`, and finds the zlib
+// streams in them.
+static std::vector<Stream>
+LoadStreams(const std::string &filename,
+            std::vector<std::vector<uint8_t>> *blobs) {
+  SqliteOptions options;
+  options.read_only = true;
+  SqliteDb db(filename, options);
+  SqliteStmt stmt(db, "select data from blocks");
+  while (stmt.Step()) {
+    std::vector<uint8_t> blob = stmt.ColumnBlob(0);
+    if (!blob.empty() && (blob[0] == 28)) {
+      blobs->push_back(std::move(blob));
+    }
+  }
+
+  std::vector<Stream> streams;
+  std::vector<uint8_t> buffer;
+  for (const std::vector<uint8_t> &blob : *blobs) {
+    BlobReader r(blob);
+    r.skip(kFormat28HeaderSize, "header");
+    for (const char *desc : {"nodes", "metadata"}) {
+      const size_t offset = r.offset();
+      r.decompress_zlib(desc, &buffer);
+      streams.push_back(Stream{
+          std::span(blob.data() + offset, r.offset() - offset), buffer.size()});
+    }
+  }
+  return streams;
+}
+
+// Decompresses every stream `passes` times with `inflate_one`, which returns
+// the decompressed size.  Prints throughput.
+static void Bench(const char *name, const std::vector<Stream> &streams,
+                  int passes,
+                  const std::function<size_t(const Stream &)> &inflate_one) {
+  size_t bytes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < passes; ++pass) {
+    for (const Stream &stream : streams) {
+      const size_t size = inflate_one(stream);
+      if (size != stream.decompressed_size) {
+        std::cerr << name << ": decompressed " << size << " bytes, expected "
+                  << stream.decompressed_size << "\n";
+        exit(1);
+      }
+      bytes += size;
+    }
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  const double count = static_cast<double>(streams.size()) * passes;
+  std::cout << std::left << std::setw(28) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(10)
+            << (bytes / elapsed.count() / (1024 * 1024)) << " MiB/s"
+            << std::setw(10) << (elapsed.count() * 1e9 / count)
+            << " ns/stream\n";
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " map.sqlite [passes]\n";
+    return 1;
+  }
+  const int passes = (argc > 2) ? std::max(1, atoi(argv[2])) : 5;
+
+  std::vector<std::vector<uint8_t>> blobs;
+  const std::vector<Stream> streams = LoadStreams(argv[1], &blobs);
+
+  size_t compressed = 0;
+  size_t decompressed = 0;
+  for (const Stream &stream : streams) {
+    compressed += stream.data.size();
+    decompressed += stream.decompressed_size;
+  }
+  std::cout << blobs.size() << " format 28 mapblocks, " << streams.size()
+            << " zlib streams, " << compressed << " bytes compressed, "
+            << decompressed << " decompressed, " << passes << " passes.\n";
+  if (streams.empty()) {
+    return 0;
+  }
+
+  Bench("zlib, new state", streams, passes, [](const Stream &stream) {
+    z_stream z{};
+    inflateInit(&z);
+    std::vector<uint8_t> dest(kOutputSize);
+    z.next_in = const_cast<uint8_t *>(stream.data.data());
+    z.avail_in = stream.data.size();
+    z.next_out = dest.data();
+    z.avail_out = dest.size();
+    inflate(&z, Z_FINISH);
+    const size_t size = z.total_out;
+    inflateEnd(&z);
+    return size;
+  });
+
+  z_stream reused{};
+  inflateInit(&reused);
+  std::vector<uint8_t> dest(kOutputSize);
+  Bench("zlib, inflateReset()", streams, passes, [&](const Stream &stream) {
+    inflateReset(&reused);
+    reused.next_in = const_cast<uint8_t *>(stream.data.data());
+    reused.avail_in = stream.data.size();
+    reused.next_out = dest.data();
+    reused.avail_out = dest.size();
+    inflate(&reused, Z_FINISH);
+    return static_cast<size_t>(reused.total_out);
+  });
+  inflateEnd(&reused);
+
+  const std::string name =
+      std::string("Inflater (") + Inflater::backend() + ")";
+  Bench(name.c_str(), streams, passes, [&](const Stream &stream) {
+    return Inflater::ForThread().Inflate(stream.data, dest).produced;
+  });
+
+  return 0;
+}
@@ -21,16 +21,18 @@ void Inventory::deserialize_inventory(BlobReader &blob) {
   std::string list_name;
 
   while (true) {
-    const std::string line = blob.read_line("inventory");
+    const std::string_view line = blob.read_line("inventory");
+    const char *const first = line.data();
+    const char *const last = first + line.size();
 
-    std::smatch sm;
-    if (std::regex_match(line, sm, re_new_list)) {
+    std::cmatch sm;
+    if (std::regex_match(first, last, sm, re_new_list)) {
       list_name = sm[1];
       current.clear();
       continue;
     }
 
-    if (std::regex_match(line, sm, re_width)) {
+    if (std::regex_match(first, last, sm, re_width)) {
       // meh, we don't care about the width right now.
       continue;
     }
@@ -38,25 +40,25 @@ void Inventory::deserialize_inventory(BlobReader &blob) {
     // If the item string is HUGE then std::regex can exhaust its stack
     // and segfault.  Ex: A crated digtron inside a chest.
     if ((line.size() > 4096) && (line.substr(0, 5) == "Item ")) {
-      current.add(std::move(line.substr(5)));
+      current.add(std::string(line.substr(5)));
       continue;
     }
 
-    if (std::regex_match(line, sm, re_item)) {
+    if (std::regex_match(first, last, sm, re_item)) {
       if (list_name.empty()) {
         // `list_name` should eb filled in BEFORE we find items.
         throw SerializationError(blob, "inventory", "list_name.empty()");
       }
-      current.add(std::move(sm[1]));
+      current.add(sm[1].str());
       continue;
     }
 
-    if (std::regex_match(line, sm, re_empty)) {
+    if (std::regex_match(first, last, sm, re_empty)) {
       if (list_name.empty()) {
         // `list_name` should eb filled in BEFORE we find items.
         throw SerializationError(blob, "inventory", "list_name.empty()");
       }
-      current.add(std::move(sm[1]));
+      current.add(sm[1].str());
       continue;
     }
 
@@ -71,7 +73,8 @@ void Inventory::deserialize_inventory(BlobReader &blob) {
       break;
     }
 
-    throw SerializationError(blob, "inventory", "Junk string? " + line);
+    throw SerializationError(blob, "inventory",
+                             "Junk string? " + std::string(line));
   }
 }
 
@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <array>
+#include <cstring>
 #include <sstream>
 
 #include "mapblock.h"
@@ -8,10 +10,13 @@
 MapBlock::MapBlock()
     : valid_(false), version_(0), flags_(0), lighting_complete_(0),
       timestamp_(0), num_name_id_mappings_(0), content_width_(0),
-      params_width_(0), nodes_(), param0_map_() {}
+      params_width_(0), param0_(), param1_(), param2_(), meta_(),
+      param0_map_() {}
 
 void MapBlock::deserialize(BlobReader &blob, int64_t pos_id,
                            ThreadLocalIdMap<NodeIdMapExtraInfo> &id_map) {
+  meta_.clear();
+
   version_ = blob.read_u8("version");
   switch (version_) {
     case 28:
@@ -75,8 +80,9 @@ void MapBlock::deserialize_format_28(
 void MapBlock::deserialize_format_29(
     BlobReader &blob_zstd, int64_t pos_id,
     ThreadLocalIdMap<NodeIdMapExtraInfo> &id_map) {
-  const std::vector<uint8_t> fmt29_raw =
-      blob_zstd.decompress_zstd("format-29.zstd");
+  // Kept per thread, so that its space is reused by the next block.
+  thread_local std::vector<uint8_t> fmt29_raw;
+  blob_zstd.decompress_zstd("format-29.zstd", &fmt29_raw);
   BlobReader b2(fmt29_raw);
 
   flags_ = b2.read_u8("flags");
@@ -108,45 +114,57 @@ void MapBlock::deserialize_format_29(
 
 void MapBlock::deserialize_nodes_28(BlobReader &blob) {
   // node data (zlib-compressed if version < 29).
-  // We expect 16384 bytes.
-  const std::vector<uint8_t> node_buffer = blob.decompress_zlib("nodes");
+  // We expect 16384 bytes, so decompress straight into a buffer of that size.
+  std::array<uint8_t, NODE_DATA_SIZE> node_buffer;
+  const size_t node_bytes = blob.decompress_zlib("nodes", node_buffer);
 
-  if (node_buffer.size() != NODE_DATA_SIZE) {
+  if (node_bytes != NODE_DATA_SIZE) {
     std::stringstream ss;
-    ss << "Decompressed into " << node_buffer.size() << " nodes; expected "
+    ss << "Decompressed into " << node_bytes << " nodes; expected "
        << NODE_DATA_SIZE << " instead.";
     throw SerializationError(blob, "MapBlock::deserialize_nodes", ss.str());
   }
 
-  nodes_.resize(NODES_PER_BLOCK);
-
-  for (size_t i = 0; i < NODES_PER_BLOCK; i++) {
-    const uint16_t *p0 =
-        reinterpret_cast<const uint16_t *>(node_buffer.data() + i * 2);
-    nodes_[i].param_0 = ntohs(*p0);
-    nodes_[i].param_1 = node_buffer[PARAM0_SIZE + i];
-    nodes_[i].param_2 = node_buffer[PARAM0_SIZE + PARAM1_SIZE + i];
-  }
+  load_nodes(node_buffer.data());
 }
 
 void MapBlock::deserialize_nodes_29(BlobReader &blob) {
-  nodes_.resize(NODES_PER_BLOCK);
+  // Same layout as format 28, just not compressed on its own.
+  const uint8_t *data = blob.ptr();
+  blob.skip(NODE_DATA_SIZE, "nodes");
+  load_nodes(data);
+}
 
-  // TODO: Might be faster to bulk copy 16384 bytes instead of reading them
-  // byte/word at a time.
-  for (size_t i = 0; i < NODES_PER_BLOCK; i++) {
-    nodes_[i].param_0 = blob.read_u16("nodes.param0");
-  }
+void MapBlock::load_nodes(const uint8_t *data) {
   for (size_t i = 0; i < NODES_PER_BLOCK; i++) {
-    nodes_[i].param_1 = blob.read_u8("nodes.param1");
+    param0_[i] = (data[i * 2] << 8) | data[i * 2 + 1];
   }
-  for (size_t i = 0; i < NODES_PER_BLOCK; i++) {
-    nodes_[i].param_2 = blob.read_u8("nodes.param2");
+  std::memcpy(param1_.data(), data + PARAM0_SIZE, PARAM1_SIZE);
+  std::memcpy(param2_.data(), data + PARAM0_SIZE + PARAM1_SIZE, PARAM2_SIZE);
+}
+
+const NodeMeta *MapBlock::find_meta(size_t index) const {
+  const auto iter = std::lower_bound(
+      meta_.begin(), meta_.end(), index,
+      [](const NodeMeta &meta, size_t i) { return meta.index < i; });
+  return ((iter != meta_.end()) && (iter->index == index)) ? &*iter : nullptr;
+}
+
+NodeMeta &MapBlock::add_meta(uint16_t index) {
+  // Usually appends: nodes are stored in index order.
+  const auto iter = std::lower_bound(
+      meta_.begin(), meta_.end(), index,
+      [](const NodeMeta &meta, uint16_t i) { return meta.index < i; });
+  if ((iter != meta_.end()) && (iter->index == index)) {
+    return *iter;
   }
+  return *meta_.emplace(iter, index);
 }
 
 void MapBlock::deserialize_metadata_28(BlobReader &blob, int64_t pos_id) {
-  const std::vector<uint8_t> meta_buffer = blob.decompress_zlib("metadata");
+  // Reused by each block this thread parses.
+  thread_local std::vector<uint8_t> meta_buffer;
+  blob.decompress_zlib("metadata", &meta_buffer);
   BlobReader r(meta_buffer);
 
   const uint8_t version = r.read_u8("meta.version");
@@ -174,7 +192,7 @@ void MapBlock::deserialize_metadata_28(BlobReader &blob, int64_t pos_id) {
 
     const NodePos pos(pos_id, local_pos);
 
-    nodes_.at(local_pos).deserialize_metadata(r, version, pos);
+    add_meta(local_pos).deserialize(r, version, pos);
   }
 }
 
@@ -204,7 +222,7 @@ void MapBlock::deserialize_metadata_29(BlobReader &blob, int64_t pos_id) {
 
     const NodePos pos(pos_id, local_pos);
 
-    nodes_.at(local_pos).deserialize_metadata(blob, version, pos);
+    add_meta(local_pos).deserialize(blob, version, pos);
   }
 }
 
@@ -231,7 +249,7 @@ void MapBlock::deserialize_name_id_mapping(
 
     const uint16_t name_len = blob.read_u16("nim.name_len");
 
-    const std::string name = blob.read_str(name_len, "nim.name");
+    const std::string_view name = blob.read_str(name_len, "nim.name");
 
     if (id > param0_map_.size()) {
       param0_map_.resize(id, -1);
@@ -284,7 +302,7 @@ void MapBlock::deserialize_node_timers(BlobReader &blob) {
 }
 
 void MapBlock::remap_param0() {
-  for (Node &node : nodes_) {
-    node.param_0 = param0_map_.at(node.param_0);
+  for (uint16_t &param0 : param0_) {
+    param0 = param0_map_.at(param0);
   }
 }
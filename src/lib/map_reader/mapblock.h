@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <array>
 #include <string>
 #include <vector>
 
@@ -39,7 +40,21 @@ public:
 
   uint8_t version() { return version_; }
 
-  const std::vector<Node> &nodes() const { return nodes_; }
+  // View of node `i`, `i < NODES_PER_BLOCK`.
+  Node node(size_t i) const {
+    return Node(param0_[i], param1_[i], param2_[i], find_meta(i));
+  }
+
+  // The params of every node, each in its own array.  Loops over a single
+  // param stay within a few KiB.
+  const std::array<uint16_t, NODES_PER_BLOCK> &param0() const {
+    return param0_;
+  }
+  const std::array<uint8_t, NODES_PER_BLOCK> &param1() const { return param1_; }
+  const std::array<uint8_t, NODES_PER_BLOCK> &param2() const { return param2_; }
+
+  // Metadata of the nodes that have any, sorted by `NodeMeta::index`.
+  const std::vector<NodeMeta> &node_meta() const { return meta_; }
 
   size_t unique_content_ids() const { return param0_map_.size(); }
 
@@ -56,9 +71,15 @@ private:
   uint8_t content_width_;
   uint8_t params_width_;
 
-  // Has 4096 entries.
+  // Node params, as in the format 29 node data.
   // Index = p.Z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + p.Y*MAP_BLOCKSIZE + p.X
-  std::vector<Node> nodes_;
+  // `param0_` is remapped to global node ids after deserialization.
+  std::array<uint16_t, NODES_PER_BLOCK> param0_;
+  std::array<uint8_t, NODES_PER_BLOCK> param1_;
+  std::array<uint8_t, NODES_PER_BLOCK> param2_;
+
+  // Side table of the few nodes with metadata.  Sorted by index.
+  std::vector<NodeMeta> meta_;
 
   // Maps param0 to global node_id (from ThreadLocalIdMap).
   // Index is param0, Value is global node id.
@@ -75,6 +96,16 @@ private:
   void deserialize_nodes_28(BlobReader &blob);
   void deserialize_nodes_29(BlobReader &blob);
 
+  // Splits `NODE_DATA_SIZE` bytes of (big-endian) node data into the param
+  // arrays.
+  void load_nodes(const uint8_t *data);
+
+  // Entry for node `index`, or nullptr.
+  const NodeMeta *find_meta(size_t index) const;
+
+  // Entry for node `index`, added if needed.
+  NodeMeta &add_meta(uint16_t index);
+
   // TODO: Change 2nd arg to 'const MapBlockPos &pos'.
   void deserialize_metadata_28(BlobReader &blob, int64_t pos_id);
   void deserialize_metadata_29(BlobReader &blob, int64_t pos_id);
@@ -7,6 +7,7 @@
 
 using ::testing::ElementsAreArray;
 using ::testing::Eq;
+using ::testing::IsEmpty;
 using ::testing::Ne;
 using ::testing::Not;
 using ::testing::SizeIs;
@@ -102,11 +103,10 @@ static const std::vector<uint8_t> format_28_input = {
     0x72, 0x00, 0x01, 0x00, 0x0D, 0x64, 0x65, 0x66, 0x61, 0x75, 0x6C, 0x74,
     0x3A, 0x73, 0x74, 0x6F, 0x6E, 0x65, 0x0A, 0x00, 0x00};
 
-void DumpNodes(const std::vector<Node> &nodes,
-               const IdMap<NodeIdMapExtraInfo> &id_map) {
+void DumpNodes(const MapBlock &mb, const IdMap<NodeIdMapExtraInfo> &id_map) {
   const uint16_t air = id_map.Get("air").id;
   for (int i = 0; i < 4096; i++) {
-    const auto &node = nodes.at(i);
+    const Node node = mb.node(i);
     if (node.param0() != air) {
       std::cout << i << " " << node.param0() << " "
                 << id_map.Get(node.param0()).key << "\n";
@@ -149,16 +149,22 @@ TEST(MapBlock, Format28) {
   std::sort(found_node_names.begin(), found_node_names.end());
   EXPECT_THAT(found_node_names, ElementsAreArray(expected_node_names));
 
-  // DumpNodes(m.nodes(), id_map);
+  // DumpNodes(m, id_map);
+
+  // Only the three nodes below have metadata.
+  EXPECT_THAT(m.node_meta(), SizeIs(3));
+  EXPECT_THAT(m.node(0).metadata(), IsEmpty());
+  EXPECT_THAT(m.node(0).inventory().empty(), Eq(true));
 
   // Chest (w/ minegeld inventory)
-  const Node &chest = m.nodes().at(1994);
+  const Node chest = m.node(1994);
+  EXPECT_THAT(m.param0()[1994], Eq(chest.param0()));
   EXPECT_THAT(id_map.Get(chest.param0()).key, Eq("default:chest"));
   // DumpInventory(chest.inventory());
   EXPECT_THAT(chest.inventory().total_minegeld(), Eq(10));
 
   // Furnace (w/ uncooked sand, no fuel, no outputs)
-  const Node &furnace = m.nodes().at(1996);
+  const Node furnace = m.node(1996);
   EXPECT_THAT(id_map.Get(furnace.param0()).key, Eq("default:furnace"));
   // DumpInventory(furnace.inventory());
   const auto furnace_src = furnace.inventory().lists().find("src");
@@ -167,7 +173,7 @@ TEST(MapBlock, Format28) {
   EXPECT_THAT(furnace_src->second.items().at(0), Eq("default:silver_sand 3"));
 
   // Protection block (owned)
-  const Node &prot = m.nodes().at(1998);
+  const Node prot = m.node(1998);
   EXPECT_THAT(id_map.Get(prot.param0()).key, Eq("protector:protect"));
   // DumpInventory(prot.inventory());
   EXPECT_THAT(prot.get_owner(), Eq("sysadmin"));
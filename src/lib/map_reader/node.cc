@@ -5,12 +5,12 @@
 #include "src/lib/map_reader/node.h"
 #include "src/lib/map_reader/utils.h"
 
-void Node::deserialize_metadata(BlobReader &blob, uint8_t version,
-                                const NodePos &pos) {
+void NodeMeta::deserialize(BlobReader &blob, uint8_t version,
+                           const NodePos &pos) {
   uint32_t num_vars = blob.read_u32("meta.num_vars");
 
   for (uint32_t v = 0; v < num_vars; v++) {
-    MetaDataVar var;
+    Var var;
 
     const uint16_t key_len = blob.read_u16("meta.key_len");
     var.key = blob.read_str(key_len, "meta.key");
@@ -28,18 +28,28 @@ void Node::deserialize_metadata(BlobReader &blob, uint8_t version,
       }
     }
 
-    metadata_.push_back(std::move(var));
+    vars.push_back(std::move(var));
   }
 
-  inventory_.deserialize_inventory(blob);
+  inventory.deserialize_inventory(blob);
 }
 
-std::string Node::get_meta(const std::string &key) const {
+const std::vector<Node::MetaDataVar> &Node::metadata() const {
+  static const std::vector<MetaDataVar> none;
+  return meta_ ? meta_->vars : none;
+}
+
+const Inventory &Node::inventory() const {
+  static const Inventory none;
+  return meta_ ? meta_->inventory : none;
+}
+
+std::string_view Node::get_meta(std::string_view key) const {
   // This is a linear search, but we rarely need to search meta,
   // its usually small, and making is an unordered_map slows down the
   // program.
 
-  for (const auto &meta : metadata_) {
+  for (const auto &meta : metadata()) {
     if (meta.key == key) {
       return meta.value;
     }
@@ -48,8 +58,8 @@ std::string Node::get_meta(const std::string &key) const {
   return "";
 }
 
-std::string Node::get_owner() const {
-  for (const auto &meta : metadata_) {
+std::string_view Node::get_owner() const {
+  for (const auto &meta : metadata()) {
     if ((meta.key == "owner") || (meta.key == "_owner")) {
       return meta.value;
     }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "inventory.h"
@@ -8,29 +10,53 @@
 class BlobReader;
 class MapBlock;
 
-class Node {
-  friend class MapBlock;
-
-public:
-  struct MetaDataVar {
+// Metadata (and inventory) of a single node.  Few nodes have any, so
+// `MapBlock` keeps these in a side table, keyed by `index`.
+struct NodeMeta {
+  struct Var {
     std::string key;
     std::string value;
     uint8_t private_;
   };
 
-  Node() : param_0(0), param_1(0), param_2(0), metadata_(), inventory_() {}
+  NodeMeta() = delete;
+  explicit NodeMeta(uint16_t index_) : index(index_), vars(), inventory() {}
+
+  // Index of the node within its mapblock.
+  uint16_t index;
+
+  std::vector<Var> vars;
+
+  Inventory inventory;
+
+  // Extracts metadata from input stream for THIS NODE ONLY.
+  // Called immediately after MapBlock::deserialize_metadata() extracts the
+  // per-node `pos`.
+  void deserialize(BlobReader &blob, uint8_t version, const NodePos &pos);
+};
+
+// Lightweight view of one node of a `MapBlock` (see `MapBlock::node()`).
+// Only valid while the mapblock is.
+class Node {
+public:
+  using MetaDataVar = NodeMeta::Var;
+
+  Node(uint16_t param0, uint8_t param1, uint8_t param2, const NodeMeta *meta)
+      : param_0(param0), param_1(param1), param_2(param2), meta_(meta) {}
 
   uint16_t param0() const { return param_0; }
   uint8_t param1() const { return param_1; }
   uint8_t param2() const { return param_2; }
 
-  const std::vector<MetaDataVar> &metadata() const { return metadata_; }
-  const Inventory &inventory() const { return inventory_; }
-  std::string get_meta(const std::string &key) const;
+  const std::vector<MetaDataVar> &metadata() const;
+  const Inventory &inventory() const;
+
+  // Views into the mapblock.  Empty if not found.
+  std::string_view get_meta(std::string_view key) const;
 
   // Attempts to determine the "owner" via the metadata.  Most nodes use
   // "owner", but `bones:bones` use "_owner".
-  std::string get_owner() const;
+  std::string_view get_owner() const;
 
 private:
   // NOTE: Upon deserialization, param_0 is remapped to the global node ID.
@@ -38,13 +64,6 @@ private:
   uint8_t param_1;
   uint8_t param_2;
 
-  std::vector<MetaDataVar> metadata_;
-
-  Inventory inventory_;
-
-  // Extracts metadata from input stream for THIS NODE ONLY.
-  // Called immediately after MapBlock::deserialize_metadata() extracts the
-  // per-node `pos`.
-  void deserialize_metadata(BlobReader &blob, uint8_t version,
-                            const NodePos &pos);
+  // nullptr if the node has no metadata.
+  const NodeMeta *meta_;
 };
@@ -38,6 +38,47 @@ MapBlockPos::MapBlockPos(int64_t mapblock_id) : Pos() {
   z = unsigned_to_signed(pythonmodulo(mapblock_id, 4096), 2048);
 }
 
+std::vector<MapBlockIdRange> MapBlockIdRanges(const MapBlockPos &min,
+                                              const MapBlockPos &max,
+                                              size_t max_ranges) {
+  std::vector<MapBlockIdRange> ranges;
+  if ((min.x >= max.x) || (min.y >= max.y) || (min.z >= max.z) ||
+      !max_ranges) {
+    return ranges;
+  }
+
+  const size_t rows = static_cast<size_t>(max.y - min.y) * (max.z - min.z);
+  const size_t slabs = max.z - min.z;
+
+  const auto add = [&ranges](int64_t lo, int64_t hi) {
+    if (!ranges.empty() && (ranges.back().hi + 1 == lo)) {
+      ranges.back().hi = hi;
+    } else {
+      ranges.push_back(MapBlockIdRange{lo, hi});
+    }
+  };
+
+  if (rows <= max_ranges) {
+    ranges.reserve(rows);
+    for (int z = min.z; z < max.z; ++z) {
+      for (int y = min.y; y < max.y; ++y) {
+        add(block_as_int(min.x, y, z), block_as_int(max.x - 1, y, z));
+      }
+    }
+  } else if (slabs <= max_ranges) {
+    ranges.reserve(slabs);
+    for (int z = min.z; z < max.z; ++z) {
+      add(block_as_int(min.x, min.y, z),
+          block_as_int(max.x - 1, max.y - 1, z));
+    }
+  } else {
+    add(block_as_int(min.x, min.y, min.z),
+        block_as_int(max.x - 1, max.y - 1, max.z - 1));
+  }
+
+  return ranges;
+}
+
 NodePos::NodePos(int64_t mapblock_id, uint16_t node_id) : Pos() {
   x = unsigned_to_signed(pythonmodulo(mapblock_id, 4096), 2048);
   mapblock_id = (mapblock_id - x) / 4096;
@@ -4,6 +4,7 @@
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 template <typename T> struct Pos {
   T x, y, z;
@@ -97,6 +98,22 @@ struct MapBlockPos : public Pos<int16_t> {
   static MapBlockPos max() { return MapBlockPos(2047, 2047, 2047); }
 };
 
+// Inclusive range of mapblock ids.
+struct MapBlockIdRange {
+  int64_t lo;
+  int64_t hi;
+};
+
+// Returns sorted, non-overlapping mapblock id ranges that cover every mapblock
+// `inside(min, max)`.  Ids are z-major, so that takes one range per (z, y) row
+// of the box (adjacent rows are merged when they touch).  If that would be
+// more than `max_ranges` ranges, returns one range per z slab instead (which
+// also covers ids outside the box), and if that is still too many, a single
+// range from `min` to `max`.  Empty if the box is empty.
+std::vector<MapBlockIdRange> MapBlockIdRanges(const MapBlockPos &min,
+                                              const MapBlockPos &max,
+                                              size_t max_ranges);
+
 struct MapBlockPosHashFunc {
   std::size_t operator()(const MapBlockPos &pos) const {
     return MurMur64Hash(pos.MapBlockId());
@@ -3,7 +3,9 @@
 
 #include "src/lib/map_reader/pos.h"
 
+using ::testing::ElementsAre;
 using ::testing::Eq;
+using ::testing::IsEmpty;
 using ::testing::IsFalse;
 using ::testing::IsTrue;
 using ::testing::Values;
@@ -252,3 +254,55 @@ TEST(NodePos, NodePosId) {
   EXPECT_THAT(NodePos(0, -1, 0).NodePosId(), Eq(0x0000ffff0000LU));
   EXPECT_THAT(NodePos(0, 0, -1).NodePosId(), Eq(0xffff00000000LU));
 }
+
+MATCHER_P2(IsIdRange, lo, hi, "") { return (arg.lo == lo) && (arg.hi == hi); }
+
+TEST(MapBlockIdRanges, Rows) {
+  // 3 x 2 x 2 box: one range per (z, y) row, in id order.
+  const auto ranges =
+      MapBlockIdRanges(MapBlockPos(-1, 0, 5), MapBlockPos(2, 2, 7), 100);
+  EXPECT_THAT(
+      ranges,
+      ElementsAre(IsIdRange(block_as_int(-1, 0, 5), block_as_int(1, 0, 5)),
+                  IsIdRange(block_as_int(-1, 1, 5), block_as_int(1, 1, 5)),
+                  IsIdRange(block_as_int(-1, 0, 6), block_as_int(1, 0, 6)),
+                  IsIdRange(block_as_int(-1, 1, 6), block_as_int(1, 1, 6))));
+}
+
+TEST(MapBlockIdRanges, Exact) {
+  // Every id within the ranges is inside the box, and vice versa.
+  const MapBlockPos min(-3, -2, -1);
+  const MapBlockPos max(4, 3, 2);
+  size_t count = 0;
+  for (const auto &range : MapBlockIdRanges(min, max, 1000)) {
+    for (int64_t id = range.lo; id <= range.hi; ++id) {
+      EXPECT_TRUE(MapBlockPos(id).inside(min, max)) << id;
+      ++count;
+    }
+  }
+  EXPECT_THAT(count, Eq(7 * 5 * 3));
+}
+
+TEST(MapBlockIdRanges, Coarser) {
+  const MapBlockPos min(0, 0, 0);
+  const MapBlockPos max(10, 10, 3);
+
+  // Too many rows: one range per z slab.
+  EXPECT_THAT(
+      MapBlockIdRanges(min, max, 29),
+      ElementsAre(IsIdRange(block_as_int(0, 0, 0), block_as_int(9, 9, 0)),
+                  IsIdRange(block_as_int(0, 0, 1), block_as_int(9, 9, 1)),
+                  IsIdRange(block_as_int(0, 0, 2), block_as_int(9, 9, 2))));
+
+  // Too many slabs: one range.
+  EXPECT_THAT(
+      MapBlockIdRanges(min, max, 2),
+      ElementsAre(IsIdRange(block_as_int(0, 0, 0), block_as_int(9, 9, 2))));
+}
+
+TEST(MapBlockIdRanges, Empty) {
+  EXPECT_THAT(MapBlockIdRanges(MapBlockPos(0, 0, 0), MapBlockPos(0, 5, 5), 10),
+              IsEmpty());
+  EXPECT_THAT(MapBlockIdRanges(MapBlockPos(0, 0, 0), MapBlockPos(5, 5, 5), 0),
+              IsEmpty());
+}
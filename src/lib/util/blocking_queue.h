@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "src/lib/util/mpmc_ring.h"
+
+// Blocking FIFO between producer and consumer threads, with an end of stream
+// marker (the "tombstone").
+//
+// Bounded queues are an `MpmcRing`: producers and consumers never take a
+// lock, and only sleep (on an atomic counter) when the ring is full or empty.
+// Unbounded queues are meant for producers and consumers that take turns on
+// one thread (ex: `App::RunSerially()`), so those are a plain `std::deque`,
+// behind a mutex.
+template <typename T> class BlockingQueue final {
+public:
+  // `limit` is the count of queued items at which `Enqueue()` blocks until
+  // consumers catch up (rounded up to a power of two).  Zero means
+  // "unbounded".
+  explicit BlockingQueue(size_t limit = 0)
+      : ring_(limit ? std::make_unique<MpmcRing<T>>(limit) : nullptr),
+        unbounded_(), unbounded_mutex_(), tombstoned_(false), pushes_(0),
+        pops_(0), idle_mutex_(), idle_cv_() {}
+
+  ~BlockingQueue() {}
+
+  void Enqueue(T &&item) {
+    Push(std::move(item));
+    Pushed();
+  }
+
+  // Blocks while the queue is full.
+  void Enqueue(std::vector<T> &&items) {
+    for (auto &item : items) {
+      Push(std::move(item));
+    }
+    Pushed();
+  }
+
+  // Marks the end of the stream, so that consumers stop waiting for items
+  // (once they drained the queue) and exit.  Nothing may be enqueued after.
+  void SetTombstone() {
+    tombstoned_ = true;
+    Pushed();
+    NotifyIdle();
+  }
+
+  // Moves up to `max_items` items into `items` (cleared first) in one go.
+  // Blocks while the queue is empty.  Returns `false`, with `items` empty,
+  // once the queue is tombstoned and drained.
+  bool PopBatch(size_t max_items, std::vector<T> *items) {
+    items->clear();
+
+    while (true) {
+      const uint32_t pushes = pushes_.load();
+      if (TryPopBatch(max_items, items)) {
+        pops_.fetch_add(1);
+        pops_.notify_all();
+        return true;
+      }
+      if (tombstoned_ && empty()) {
+        NotifyIdle();
+        return false;
+      }
+      pushes_.wait(pushes);
+    }
+  }
+
+  size_t size() const {
+    if (ring_) {
+      return ring_->size();
+    }
+    std::unique_lock<std::mutex> lock(unbounded_mutex_);
+    return unbounded_.size();
+  }
+
+  bool empty() const { return !size(); }
+
+  // 0 if unbounded.
+  size_t capacity() const { return ring_ ? ring_->capacity() : 0; }
+
+  // Waits until the queue is either tombstoned and drained, or the timeout is
+  // reached.
+  // Returns 'true' if the timeout is reached AND the queue still has data.
+  // Returns 'false' if the queue is tombstoned and drained.
+  template <class Rep, class Period>
+  bool idle_wait(const std::chrono::duration<Rep, Period> &timeout) {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    return !idle_cv_.wait_for(lock, timeout,
+                              [this]() { return tombstoned_ && empty(); });
+  }
+
+private:
+  std::unique_ptr<MpmcRing<T>> ring_;
+  std::deque<T> unbounded_;
+  mutable std::mutex unbounded_mutex_;
+
+  std::atomic<bool> tombstoned_;
+
+  // Bumped after each push (pop) batch.  Consumers (producers) sleep on them
+  // while the queue is empty (full).  Wrapping around is fine.
+  std::atomic<uint32_t> pushes_;
+  std::atomic<uint32_t> pops_;
+
+  // Only used by `idle_wait()`, which needs a timeout.
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+
+  // Blocks the producer while the ring is full.  Wakes up the consumers
+  // before sleeping, or they could all be asleep on items we already pushed.
+  void Push(T &&item) {
+    if (!ring_) {
+      std::unique_lock<std::mutex> lock(unbounded_mutex_);
+      unbounded_.push_back(std::move(item));
+      return;
+    }
+
+    while (true) {
+      const uint32_t pops = pops_.load();
+      if (ring_->TryPush(std::move(item))) {
+        return;
+      }
+      Pushed();
+      pops_.wait(pops);
+    }
+  }
+
+  bool TryPopBatch(size_t max_items, std::vector<T> *items) {
+    if (ring_) {
+      return ring_->TryPopBatch(max_items, items);
+    }
+
+    std::unique_lock<std::mutex> lock(unbounded_mutex_);
+    while ((items->size() < max_items) && !unbounded_.empty()) {
+      items->push_back(std::move(unbounded_.front()));
+      unbounded_.pop_front();
+    }
+    return !items->empty();
+  }
+
+  void Pushed() {
+    pushes_.fetch_add(1);
+    pushes_.notify_all();
+  }
+
+  void NotifyIdle() {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_cv_.notify_all();
+  }
+};
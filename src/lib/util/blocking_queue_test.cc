@@ -0,0 +1,94 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/util/blocking_queue.h"
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::Le;
+
+using std::chrono::milliseconds;
+
+TEST(BlockingQueue, Unbounded) {
+  BlockingQueue<int> queue;
+  EXPECT_THAT(queue.capacity(), Eq(0));
+  queue.Enqueue(std::vector<int>{1, 2, 3, 4, 5});
+  queue.Enqueue(6);
+  EXPECT_THAT(queue.size(), Eq(6));
+
+  std::vector<int> items;
+  EXPECT_TRUE(queue.PopBatch(4, &items));
+  EXPECT_THAT(items, ElementsAre(1, 2, 3, 4));
+
+  // Still has data.
+  EXPECT_TRUE(queue.idle_wait(milliseconds(1)));
+
+  queue.SetTombstone();
+  EXPECT_TRUE(queue.PopBatch(4, &items));
+  EXPECT_THAT(items, ElementsAre(5, 6));
+  EXPECT_FALSE(queue.PopBatch(4, &items));
+  EXPECT_THAT(items, IsEmpty());
+  EXPECT_FALSE(queue.idle_wait(milliseconds(1)));
+}
+
+TEST(BlockingQueue, Backpressure) {
+  static constexpr int kItems = 10000;
+  BlockingQueue<int> queue(8);
+  EXPECT_THAT(queue.capacity(), Eq(8));
+
+  std::thread producer([&queue]() {
+    for (int i = 0; i < kItems; i += 2) {
+      queue.Enqueue(std::vector<int>{i, i + 1});
+    }
+    queue.SetTombstone();
+  });
+
+  // Every item, in order, and never more than `capacity()` queued.
+  std::vector<int> all;
+  std::vector<int> items;
+  while (queue.PopBatch(3, &items)) {
+    EXPECT_THAT(queue.size(), Le(8));
+    all.insert(all.end(), items.begin(), items.end());
+  }
+  producer.join();
+
+  ASSERT_THAT(all.size(), Eq(kItems));
+  for (int i = 0; i < kItems; ++i) {
+    ASSERT_THAT(all[i], Eq(i));
+  }
+  EXPECT_FALSE(queue.idle_wait(milliseconds(1)));
+}
+
+TEST(BlockingQueue, ManyConsumers) {
+  BlockingQueue<int> queue(4);
+  std::atomic<int> sum(0);
+
+  std::vector<std::thread> consumers;
+  for (int t = 0; t < 4; ++t) {
+    consumers.emplace_back([&queue, &sum]() {
+      std::vector<int> items;
+      while (queue.PopBatch(2, &items)) {
+        for (int item : items) {
+          sum += item;
+        }
+      }
+    });
+  }
+
+  for (int i = 1; i <= 1000; ++i) {
+    queue.Enqueue(int(i));
+  }
+  queue.SetTombstone();
+  while (queue.idle_wait(milliseconds(10))) {
+  }
+  for (auto &t : consumers) {
+    t.join();
+  }
+  EXPECT_THAT(sum.load(), Eq(500500));
+}
@@ -0,0 +1,28 @@
+#include <algorithm>
+
+#include "src/lib/util/concurrency_gate.h"
+
+ConcurrencyGate::ConcurrencyGate(size_t limit)
+    : mutex_(), cv_(), limit_(std::max<size_t>(limit, 1)), running_(0) {}
+
+void ConcurrencyGate::SetLimit(size_t limit) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    limit_ = std::max<size_t>(limit, 1);
+  }
+  cv_.notify_all();
+}
+
+void ConcurrencyGate::Enter() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this]() { return running_ < limit_; });
+  ++running_;
+}
+
+void ConcurrencyGate::Leave() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    --running_;
+  }
+  cv_.notify_one();
+}
@@ -0,0 +1,45 @@
+// Caps how many threads may run at once, with a cap that can change while
+// they run.  Threads `Enter()` before working, `Leave()` when done, and call
+// `Yield()` between units of work, which parks them while the gate is over
+// its limit.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+class ConcurrencyGate {
+public:
+  ConcurrencyGate() = delete;
+  explicit ConcurrencyGate(size_t limit);
+
+  // Values below 1 are raised to 1, so that work always progresses.
+  void SetLimit(size_t limit);
+
+  size_t limit() const { return limit_; }
+
+  // Count of threads inside the gate (not parked).
+  size_t running() const { return running_; }
+
+  // Blocks while `running() >= limit()`.
+  void Enter();
+
+  void Leave();
+
+  // If the gate is over its limit, parks until it has room again.  Cheap when
+  // it is not.
+  void Yield() {
+    if (running_ > limit_) {
+      Leave();
+      Enter();
+    }
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::atomic<size_t> limit_;
+  std::atomic<size_t> running_;
+};
@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/util/concurrency_gate.h"
+
+using ::testing::Eq;
+using ::testing::Le;
+
+TEST(ConcurrencyGate, Limit) {
+  ConcurrencyGate gate(0);
+  EXPECT_THAT(gate.limit(), Eq(1));
+  gate.SetLimit(3);
+  EXPECT_THAT(gate.limit(), Eq(3));
+
+  gate.Enter();
+  gate.Enter();
+  EXPECT_THAT(gate.running(), Eq(2));
+  gate.Yield(); // Under the limit: returns right away.
+  gate.Leave();
+  gate.Leave();
+  EXPECT_THAT(gate.running(), Eq(0));
+}
+
+TEST(ConcurrencyGate, ParksThreads) {
+  ConcurrencyGate gate(8);
+  std::atomic<size_t> inside(0);
+  std::atomic<size_t> peak(0);
+  std::atomic<bool> lowered(false);
+  std::atomic<size_t> peak_after(0);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&]() {
+      gate.Enter();
+      for (int i = 0; i < 2000; ++i) {
+        gate.Yield();
+        const size_t n = ++inside;
+        peak = std::max<size_t>(peak, n);
+        if (lowered) {
+          peak_after = std::max<size_t>(peak_after, n);
+        }
+        std::this_thread::yield();
+        --inside;
+      }
+      gate.Leave();
+    });
+  }
+
+  gate.SetLimit(2);
+  // Threads already past `Yield()` may still finish their step.
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  lowered = true;
+
+  for (auto &t : threads) {
+    t.join();
+  }
+  EXPECT_THAT(peak.load(), Le(8));
+  EXPECT_THAT(peak_after.load(), Le(2));
+  EXPECT_THAT(gate.running(), Eq(0));
+}
@@ -0,0 +1,133 @@
+#include <sched.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include "src/lib/util/cpu_topology.h"
+
+size_t CpuTopology::NodeForWorker(size_t worker, size_t workers) const {
+  if (nodes.empty() || !workers) {
+    return 0;
+  }
+  return std::min(worker, workers - 1) * nodes.size() / workers;
+}
+
+std::vector<int> ParseCpuList(std::string_view list) {
+  std::vector<int> cpus;
+  while (!list.empty() && ((list.back() == '\n') || (list.back() == ' '))) {
+    list.remove_suffix(1);
+  }
+  if (list.empty()) {
+    return cpus;
+  }
+
+  const std::string text(list);
+  const char *p = text.c_str();
+  while (true) {
+    char *end = nullptr;
+    const long lo = strtol(p, &end, 10);
+    if ((end == p) || (lo < 0)) {
+      return {};
+    }
+    long hi = lo;
+    p = end;
+    if (*p == '-') {
+      ++p;
+      hi = strtol(p, &end, 10);
+      if ((end == p) || (hi < lo)) {
+        return {};
+      }
+      p = end;
+    }
+    for (long cpu = lo; cpu <= hi; ++cpu) {
+      cpus.push_back(cpu);
+    }
+
+    if (!*p) {
+      return cpus;
+    }
+    if (*p != ',') {
+      return {};
+    }
+    ++p;
+  }
+}
+
+CpuTopology GetCpuTopology(const std::vector<int> &allowed,
+                           const std::filesystem::path &sysfs) {
+  static constexpr std::string_view kNodePrefix = "node";
+
+  // (node id, CPUs), sorted by node id below.
+  std::vector<std::pair<long, std::vector<int>>> found;
+
+  std::error_code ec;
+  const std::filesystem::path dir = sysfs / "devices/system/node";
+  for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+    const std::string name = entry.path().filename().string();
+    if (!name.starts_with(kNodePrefix) || (name.size() == kNodePrefix.size()) ||
+        (name.find_first_not_of("0123456789", kNodePrefix.size()) !=
+         std::string::npos)) {
+      continue;
+    }
+
+    std::ifstream is(entry.path() / "cpulist");
+    const std::string list((std::istreambuf_iterator<char>(is)),
+                           std::istreambuf_iterator<char>());
+
+    std::vector<int> cpus;
+    for (int cpu : ParseCpuList(list)) {
+      if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) {
+      found.emplace_back(strtol(name.c_str() + kNodePrefix.size(), NULL, 10),
+                         std::move(cpus));
+    }
+  }
+
+  std::sort(found.begin(), found.end());
+
+  CpuTopology topology;
+  for (auto &node : found) {
+    topology.nodes.push_back(std::move(node.second));
+  }
+  if (topology.nodes.empty()) {
+    topology.nodes.push_back(allowed);
+  }
+  return topology;
+}
+
+std::vector<int> GetAllowedCpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set)) {
+    return cpus;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+bool PinCurrentThread(const std::vector<int> &cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if ((cpu >= 0) && (cpu < CPU_SETSIZE)) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  if (!CPU_COUNT(&set)) {
+    return false;
+  }
+  // pid 0: the calling thread.
+  return !sched_setaffinity(0, sizeof(set), &set);
+}
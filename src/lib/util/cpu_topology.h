@@ -0,0 +1,39 @@
+// CPU / NUMA topology of the host (from sysfs), and pinning threads to it.
+// https://docs.kernel.org/admin-guide/cputopology.html
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+struct CpuTopology {
+  CpuTopology() : nodes() {}
+
+  // The CPUs of each NUMA node that this process may run on, in node order.
+  // Nodes with no such CPUs (ex: memory only nodes) are left out.  Always at
+  // least one node.
+  std::vector<std::vector<int>> nodes;
+
+  // Spreads `workers` over the nodes in contiguous runs, so that neighbouring
+  // workers share a node.  Returns the node index for `worker`.
+  size_t NodeForWorker(size_t worker, size_t workers) const;
+};
+
+// Parses a sysfs CPU list, ex: "0-3,8,10-11\n".  Returns the CPUs in the
+// order given, or an empty list on error.
+std::vector<int> ParseCpuList(std::string_view list);
+
+// Reads `<sysfs>/devices/system/node/node*/cpulist`, keeping only the CPUs in
+// `allowed`.  Without NUMA information, returns a single node holding every
+// CPU in `allowed`.
+CpuTopology GetCpuTopology(const std::vector<int> &allowed,
+                           const std::filesystem::path &sysfs = "/sys");
+
+// CPUs the calling thread may run on (`sched_getaffinity()`).
+std::vector<int> GetAllowedCpus();
+
+// Restricts the calling thread to `cpus` (`sched_setaffinity()`).  Returns
+// `false` on failure, leaving the thread where it was.
+bool PinCurrentThread(const std::vector<int> &cpus);
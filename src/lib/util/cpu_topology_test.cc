@@ -0,0 +1,75 @@
+#include <filesystem>
+#include <fstream>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/util/cpu_topology.h"
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::Not;
+
+// Relative to the working directory; `rebuild.sh` wipes it.
+static const std::filesystem::path kTestDir = "tmp/test/cpu_topology";
+
+TEST(ParseCpuList, Works) {
+  EXPECT_THAT(ParseCpuList("0-3,8,10-11\n"),
+              ElementsAre(0, 1, 2, 3, 8, 10, 11));
+  EXPECT_THAT(ParseCpuList("5"), ElementsAre(5));
+  EXPECT_THAT(ParseCpuList("\n"), IsEmpty());
+  EXPECT_THAT(ParseCpuList("3-1"), IsEmpty());
+  EXPECT_THAT(ParseCpuList("1,,2"), IsEmpty());
+  EXPECT_THAT(ParseCpuList("x"), IsEmpty());
+}
+
+static void WriteNode(const std::filesystem::path &root, const char *name,
+                      const char *cpulist) {
+  const std::filesystem::path dir = root / "devices/system/node" / name;
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "cpulist") << cpulist;
+}
+
+TEST(GetCpuTopology, ReadsSysfs) {
+  const std::filesystem::path root = kTestDir / "sysfs";
+  std::filesystem::remove_all(root);
+  WriteNode(root, "node10", "4-5\n");
+  WriteNode(root, "node1", "2-3\n");
+  WriteNode(root, "node0", "0-1\n");
+  WriteNode(root, "node2", "\n"); // Memory only.
+  WriteNode(root, "possible", "0-10\n");
+
+  // Numeric node order; CPUs outside of `allowed` are dropped.
+  const CpuTopology topology = GetCpuTopology({0, 1, 3, 4, 5}, root);
+  EXPECT_THAT(topology.nodes, ElementsAre(ElementsAre(0, 1), ElementsAre(3),
+                                          ElementsAre(4, 5)));
+
+  // No NUMA information: one node.
+  EXPECT_THAT(GetCpuTopology({0, 1}, kTestDir / "missing").nodes,
+              ElementsAre(ElementsAre(0, 1)));
+}
+
+TEST(CpuTopology, NodeForWorker) {
+  CpuTopology topology;
+  topology.nodes = {{0, 1}, {2, 3}};
+
+  // Contiguous runs.
+  EXPECT_THAT(topology.NodeForWorker(0, 5), Eq(0));
+  EXPECT_THAT(topology.NodeForWorker(2, 5), Eq(0));
+  EXPECT_THAT(topology.NodeForWorker(3, 5), Eq(1));
+  EXPECT_THAT(topology.NodeForWorker(4, 5), Eq(1));
+  EXPECT_THAT(topology.NodeForWorker(0, 1), Eq(0));
+}
+
+TEST(PinCurrentThread, Works) {
+  const std::vector<int> allowed = GetAllowedCpus();
+  ASSERT_THAT(allowed, Not(IsEmpty()));
+
+  EXPECT_TRUE(PinCurrentThread({allowed.front()}));
+  EXPECT_THAT(GetAllowedCpus(), ElementsAre(allowed.front()));
+
+  EXPECT_FALSE(PinCurrentThread({}));
+  EXPECT_TRUE(PinCurrentThread(allowed));
+  EXPECT_THAT(GetAllowedCpus(), Eq(allowed));
+}
@@ -0,0 +1,139 @@
+// Bounded, lock-free, multi-producer multi-consumer FIFO ring.
+// Dmitry Vyukov's design:
+// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+//
+// Each cell carries a sequence number that says whose turn it is (the
+// producer of lap N, or the consumer of lap N), so producers and consumers
+// only contend on their own position counter (one CAS per item), and never
+// on each other's.  Never blocks; see `BlockingQueue` for a blocking wrapper.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+template <typename T> class MpmcRing {
+public:
+  MpmcRing() = delete;
+  MpmcRing(const MpmcRing &) = delete;
+  MpmcRing &operator=(const MpmcRing &) = delete;
+
+  // Capacity is rounded up to a power of two (at least 2).
+  explicit MpmcRing(size_t capacity)
+      : mask_(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1),
+        cells_(new Cell[mask_ + 1]), enqueue_pos_(0), dequeue_pos_(0) {
+    for (size_t i = 0; i <= mask_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~MpmcRing() {
+    while (Pop([](T &&) {})) {
+    }
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // Moves `item` in and returns `true`, or returns `false` (and leaves `item`
+  // alone) if the ring is full.
+  bool TryPush(T &&item) {
+    Cell *cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false; // Full.
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    new (cell->storage) T(std::move(item));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Moves the oldest item into `*item` and returns `true`, or returns `false`
+  // if the ring is empty.
+  bool TryPop(T *item) {
+    return Pop([item](T &&popped) { *item = std::move(popped); });
+  }
+
+  // Appends up to `max_items` items to `items`.  Returns how many.
+  size_t TryPopBatch(size_t max_items, std::vector<T> *items) {
+    const auto append = [items](T &&popped) {
+      items->push_back(std::move(popped));
+    };
+    size_t count = 0;
+    while ((count < max_items) && Pop(append)) {
+      ++count;
+    }
+    return count;
+  }
+
+  // Only a snapshot while other threads push or pop.
+  size_t size() const {
+    const size_t dequeue = dequeue_pos_.load(std::memory_order_acquire);
+    const size_t enqueue = enqueue_pos_.load(std::memory_order_acquire);
+    return (enqueue > dequeue) ? (enqueue - dequeue) : 0;
+  }
+
+  bool empty() const { return !size(); }
+
+private:
+  // Keeps the two hot position counters out of each other's cache lines.
+  static constexpr size_t kCacheLine = 64;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  // Hands the oldest item to `sink(T &&)`, unless the ring is empty.
+  template <typename Sink> bool Pop(Sink &&sink) {
+    Cell *cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false; // Empty.
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    T *stored = std::launder(reinterpret_cast<T *>(cell->storage));
+    sink(std::move(*stored));
+    stored->~T();
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  const size_t mask_;
+  const std::unique_ptr<Cell[]> cells_;
+  alignas(kCacheLine) std::atomic<size_t> enqueue_pos_;
+  alignas(kCacheLine) std::atomic<size_t> dequeue_pos_;
+};
@@ -0,0 +1,113 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/util/mpmc_ring.h"
+
+using ::testing::Each;
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Gt;
+
+TEST(MpmcRing, Capacity) {
+  EXPECT_THAT(MpmcRing<int>(0).capacity(), Eq(2));
+  EXPECT_THAT(MpmcRing<int>(4).capacity(), Eq(4));
+  EXPECT_THAT(MpmcRing<int>(5).capacity(), Eq(8));
+}
+
+TEST(MpmcRing, Fifo) {
+  MpmcRing<int> ring(4);
+  EXPECT_TRUE(ring.empty());
+
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.TryPush(int(i)));
+  }
+  int full = 4;
+  EXPECT_FALSE(ring.TryPush(std::move(full)));
+  EXPECT_THAT(ring.size(), Eq(4));
+
+  int item = -1;
+  EXPECT_TRUE(ring.TryPop(&item));
+  EXPECT_THAT(item, Eq(0));
+
+  // Wraps around.
+  EXPECT_TRUE(ring.TryPush(4));
+  std::vector<int> items;
+  EXPECT_THAT(ring.TryPopBatch(3, &items), Eq(3));
+  EXPECT_THAT(ring.TryPopBatch(3, &items), Eq(1));
+  EXPECT_THAT(items, ElementsAre(1, 2, 3, 4));
+  EXPECT_FALSE(ring.TryPop(&item));
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(MpmcRing, MoveOnly) {
+  MpmcRing<std::unique_ptr<int>> ring(2);
+  auto p = std::make_unique<int>(42);
+  EXPECT_TRUE(ring.TryPush(std::move(p)));
+  EXPECT_THAT(p, Eq(nullptr));
+
+  // Items left in the ring are destroyed with it.
+  EXPECT_TRUE(ring.TryPush(std::make_unique<int>(7)));
+  std::vector<std::unique_ptr<int>> items;
+  EXPECT_THAT(ring.TryPopBatch(1, &items), Eq(1));
+  EXPECT_THAT(*items[0], Eq(42));
+}
+
+TEST(MpmcRing, Threads) {
+  static constexpr int kThreads = 4;
+  static constexpr int kItems = 100000;
+  MpmcRing<int> ring(64);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&ring, t]() {
+      for (int i = 0; i < kItems; ++i) {
+        int item = t * kItems + i;
+        while (!ring.TryPush(std::move(item))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // Every item exactly once, and each producer's items in order.
+  std::vector<std::vector<int>> popped(kThreads);
+  std::atomic<int> total(0);
+  std::vector<std::thread> consumers;
+  for (int t = 0; t < kThreads; ++t) {
+    consumers.emplace_back([&ring, &popped, &total, t]() {
+      while (total < kThreads * kItems) {
+        const size_t n = ring.TryPopBatch(16, &popped[t]);
+        if (n) {
+          total += n;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  for (auto &t : threads) {
+    t.join();
+  }
+  for (auto &t : consumers) {
+    t.join();
+  }
+  EXPECT_TRUE(ring.empty());
+
+  std::vector<int> next(kThreads);
+  std::vector<int> last(kThreads * kThreads, -1);
+  for (int c = 0; c < kThreads; ++c) {
+    for (int item : popped[c]) {
+      const int producer = item / kItems;
+      EXPECT_THAT(item, Gt(last[c * kThreads + producer]));
+      last[c * kThreads + producer] = item;
+      ++next[producer];
+    }
+  }
+  EXPECT_THAT(next, Each(Eq(kItems)));
+}
@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <thread>
+
+#include "src/lib/util/rate_limiter.h"
+
+TokenBucket::TokenBucket()
+    : mutex_(), rate_(0), burst_(0), tokens_(0), last_(), taken_(0) {}
+
+void TokenBucket::SetRate(double rate, double burst) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  rate = std::max(rate, 0.0);
+  burst = std::max(burst, 0.0);
+
+  // Coming from (or going to) unlimited, start over with a full bucket.
+  // Otherwise keep the balance (and any debt), so that flipping the rate
+  // back and forth can not mint tokens.
+  if (!rate_ || !rate) {
+    tokens_ = burst;
+    last_ = Clock::now();
+  } else {
+    tokens_ = std::min(tokens_, burst);
+  }
+
+  burst_ = burst;
+  rate_ = rate;
+}
+
+TokenBucket::Clock::duration TokenBucket::Reserve(double n,
+                                                  Clock::time_point now) {
+  taken_ += static_cast<uint64_t>(n);
+  if (!rate_) {
+    return Clock::duration::zero();
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  const double rate = rate_;
+  if (!rate) {
+    return Clock::duration::zero();
+  }
+
+  if (now > last_) {
+    const std::chrono::duration<double> elapsed = now - last_;
+    tokens_ = std::min(burst_, tokens_ + elapsed.count() * rate);
+    last_ = now;
+  }
+
+  tokens_ -= n;
+  if (tokens_ >= 0) {
+    return Clock::duration::zero();
+  }
+
+  return std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(-tokens_ / rate));
+}
+
+void TokenBucket::Acquire(double n) {
+  const Clock::duration wait = Reserve(n, Clock::now());
+  if (wait > Clock::duration::zero()) {
+    std::this_thread::sleep_for(wait);
+  }
+}
@@ -0,0 +1,48 @@
+// Token bucket rate limiter, shared between threads.
+// https://en.wikipedia.org/wiki/Token_bucket
+//
+// The bucket refills at `rate` tokens per second, and banks at most `burst`
+// tokens.  Takers may overdraw it: a request larger than the balance is
+// granted at once, but the caller must then wait until the refill has paid
+// the debt back.  That way a single request larger than `burst` (ex: one huge
+// mapblock) can never stall forever, and the long term rate still holds.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+class TokenBucket {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Unlimited until `SetRate()` is called.
+  TokenBucket();
+
+  // `rate` tokens per second, banking up to `burst` tokens.  A `rate` of 0
+  // removes the limit.  Callers already sleeping in `Acquire()` finish their
+  // current wait.
+  void SetRate(double rate, double burst);
+
+  double rate() const { return rate_; }
+
+  // Takes `n` tokens at time `now`, and returns how long the caller must wait
+  // before using them (zero if the bucket had enough).
+  Clock::duration Reserve(double n, Clock::time_point now);
+
+  // `Reserve()` + sleep.
+  void Acquire(double n);
+
+  // Total of every `n` passed to `Reserve()`/`Acquire()`, limited or not.
+  uint64_t taken() const { return taken_; }
+
+private:
+  std::mutex mutex_;
+  std::atomic<double> rate_;
+  double burst_;
+  double tokens_;
+  Clock::time_point last_;
+  std::atomic<uint64_t> taken_;
+};
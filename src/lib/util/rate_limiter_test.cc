@@ -0,0 +1,62 @@
+#include <chrono>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/util/rate_limiter.h"
+
+using ::testing::Eq;
+
+using std::chrono::milliseconds;
+
+static milliseconds Ms(TokenBucket::Clock::duration d) {
+  return std::chrono::round<milliseconds>(d);
+}
+
+TEST(TokenBucket, UnlimitedByDefault) {
+  TokenBucket bucket;
+  const auto now = TokenBucket::Clock::now();
+  EXPECT_THAT(bucket.rate(), Eq(0));
+  EXPECT_THAT(Ms(bucket.Reserve(1e12, now)), Eq(milliseconds(0)));
+  EXPECT_THAT(bucket.taken(), Eq(1000000000000));
+}
+
+TEST(TokenBucket, Reserve) {
+  TokenBucket bucket;
+  bucket.SetRate(100, 10);
+  const auto now = TokenBucket::Clock::now();
+
+  // Starts full, then every token costs 10ms.
+  EXPECT_THAT(Ms(bucket.Reserve(10, now)), Eq(milliseconds(0)));
+  EXPECT_THAT(Ms(bucket.Reserve(10, now)), Eq(milliseconds(100)));
+  EXPECT_THAT(Ms(bucket.Reserve(5, now)), Eq(milliseconds(150)));
+
+  // Debt is paid back over time, but no more than `burst` is ever banked.
+  EXPECT_THAT(Ms(bucket.Reserve(0, now + milliseconds(150))),
+              Eq(milliseconds(0)));
+  EXPECT_THAT(Ms(bucket.Reserve(20, now + milliseconds(10000))),
+              Eq(milliseconds(100)));
+
+  // One request larger than the burst is granted, then waited off.
+  EXPECT_THAT(Ms(bucket.Reserve(1000, now + milliseconds(10100))),
+              Eq(milliseconds(10000)));
+  EXPECT_THAT(bucket.taken(), Eq(1045));
+}
+
+TEST(TokenBucket, SetRate) {
+  TokenBucket bucket;
+  bucket.SetRate(100, 10);
+  const auto now = TokenBucket::Clock::now();
+  EXPECT_THAT(Ms(bucket.Reserve(30, now)), Eq(milliseconds(200)));
+
+  // Changing the rate keeps the debt, but pays it back at the new rate.
+  bucket.SetRate(1000, 10);
+  EXPECT_THAT(Ms(bucket.Reserve(0, now)), Eq(milliseconds(20)));
+
+  // Lifting the limit forgives it.
+  bucket.SetRate(0, 0);
+  EXPECT_THAT(Ms(bucket.Reserve(100, now)), Eq(milliseconds(0)));
+  bucket.SetRate(100, 10);
+  EXPECT_THAT(Ms(bucket.Reserve(10, TokenBucket::Clock::now())),
+              Eq(milliseconds(0)));
+}
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <string_view>
+
+#include "src/lib/util/system_load.h"
+
+double ParseLoadAvg(std::istream &is) {
+  double load_avg = 0;
+  if (!(is >> load_avg)) {
+    return 0;
+  }
+  return load_avg;
+}
+
+double ParsePressure(std::istream &is) {
+  // Ex: "some avg10=0.74 avg60=6.54 avg300=5.77 total=185758722"
+  static constexpr std::string_view kAvg10 = "avg10=";
+
+  std::string kind;
+  std::string field;
+  while (is >> kind >> field) {
+    if ((kind == "some") && field.starts_with(kAvg10)) {
+      return strtod(field.c_str() + kAvg10.size(), NULL);
+    }
+    is.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  return 0;
+}
+
+SystemLoad GetSystemLoad() {
+  SystemLoad s;
+
+  std::ifstream loadavg("/proc/loadavg");
+  s.load_avg = ParseLoadAvg(loadavg);
+
+  std::ifstream cpu("/proc/pressure/cpu");
+  s.cpu_pressure = ParsePressure(cpu);
+
+  std::ifstream io("/proc/pressure/io");
+  s.io_pressure = ParsePressure(io);
+
+  return s;
+}
+
+LoadController::LoadController(size_t max_threads, double max_load_avg,
+                               double max_pressure, Clock::duration hold)
+    : max_threads_(std::max<size_t>(max_threads, 1)),
+      max_load_avg_(max_load_avg), max_pressure_(max_pressure), hold_(hold),
+      threads_(max_threads_), last_change_() {}
+
+size_t LoadController::Update(const SystemLoad &load, Clock::time_point now) {
+  if (now - last_change_ < hold_) {
+    return threads_;
+  }
+
+  // A limit of 0 (or less) is not checked.
+  const bool check_load = (max_load_avg_ > 0);
+  const bool check_pressure = (max_pressure_ > 0);
+
+  const bool over =
+      (check_load && (load.load_avg > max_load_avg_)) ||
+      (check_pressure && ((load.cpu_pressure > max_pressure_) ||
+                          (load.io_pressure > max_pressure_)));
+
+  // Leave a thread's worth of headroom, so that adding one does not
+  // immediately push us back over.
+  const bool under =
+      (!check_load || (load.load_avg + 1 <= max_load_avg_)) &&
+      (!check_pressure || ((load.cpu_pressure <= max_pressure_ / 2) &&
+                           (load.io_pressure <= max_pressure_ / 2)));
+
+  if (over && (threads_ > 1)) {
+    --threads_;
+    last_change_ = now;
+  } else if (under && (threads_ < max_threads_)) {
+    ++threads_;
+    last_change_ = now;
+  }
+
+  return threads_;
+}
@@ -0,0 +1,58 @@
+// Host load sampling, and a controller that picks how many worker threads to
+// run so that the host stays under a target load.
+// https://docs.kernel.org/accounting/psi.html
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <istream>
+
+struct SystemLoad {
+  SystemLoad() : load_avg(0), cpu_pressure(0), io_pressure(0) {}
+
+  // 1 minute load average (`/proc/loadavg`).
+  double load_avg;
+
+  // "some avg10" of `/proc/pressure/{cpu,io}`: % of the last 10 seconds in
+  // which at least one task was stalled on CPU (or I/O).  0 if the kernel has
+  // no PSI support.
+  double cpu_pressure;
+  double io_pressure;
+};
+
+SystemLoad GetSystemLoad();
+
+// Parses the first field of `/proc/loadavg`.  Returns 0 on error.
+double ParseLoadAvg(std::istream &is);
+
+// Parses "some avg10=" out of a `/proc/pressure/*` file.  Returns 0 on error.
+double ParsePressure(std::istream &is);
+
+// Walks the worker thread count between 1 and `max_threads`: one down while
+// the host is over the target, one up once it is comfortably under it.  The
+// load average lags by design, so it waits `hold` after each change before
+// judging the effect.  A `max_load_avg` or `max_pressure` of 0 leaves that
+// measure out.
+class LoadController {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  LoadController() = delete;
+  LoadController(size_t max_threads, double max_load_avg, double max_pressure,
+                 Clock::duration hold);
+
+  // Feeds one sample taken at `now`, and returns the new thread count.
+  size_t Update(const SystemLoad &load, Clock::time_point now);
+
+  size_t threads() const { return threads_; }
+
+private:
+  const size_t max_threads_;
+  const double max_load_avg_;
+  const double max_pressure_;
+  const Clock::duration hold_;
+
+  size_t threads_;
+  Clock::time_point last_change_;
+};
@@ -0,0 +1,89 @@
+#include <sstream>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "src/lib/util/system_load.h"
+
+using ::testing::DoubleEq;
+using ::testing::Eq;
+using ::testing::Ge;
+
+using std::chrono::seconds;
+
+TEST(ParseLoadAvg, Works) {
+  std::istringstream good("0.81 0.80 0.74 2/72 21435\n");
+  EXPECT_THAT(ParseLoadAvg(good), DoubleEq(0.81));
+
+  std::istringstream bad("");
+  EXPECT_THAT(ParseLoadAvg(bad), DoubleEq(0));
+}
+
+TEST(ParsePressure, Works) {
+  std::istringstream cpu(
+      "some avg10=1.25 avg60=6.54 avg300=5.77 total=185758722\n"
+      "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+  EXPECT_THAT(ParsePressure(cpu), DoubleEq(1.25));
+
+  std::istringstream full_first(
+      "full avg10=9.00 avg60=0.00 avg300=0.00 total=0\n"
+      "some avg10=3.50 avg60=0.01 avg300=0.00 total=4070700\n");
+  EXPECT_THAT(ParsePressure(full_first), DoubleEq(3.5));
+
+  std::istringstream bad("nonsense\n");
+  EXPECT_THAT(ParsePressure(bad), DoubleEq(0));
+}
+
+TEST(GetSystemLoad, Works) {
+  const SystemLoad load = GetSystemLoad();
+  EXPECT_THAT(load.load_avg, Ge(0));
+  EXPECT_THAT(load.cpu_pressure, Ge(0));
+  EXPECT_THAT(load.io_pressure, Ge(0));
+}
+
+static SystemLoad Load(double load_avg, double pressure) {
+  SystemLoad load;
+  load.load_avg = load_avg;
+  load.cpu_pressure = pressure;
+  load.io_pressure = pressure;
+  return load;
+}
+
+TEST(LoadController, Update) {
+  LoadController ctl(4, 8.0, 20.0, seconds(5));
+  const auto t0 = LoadController::Clock::now();
+  EXPECT_THAT(ctl.threads(), Eq(4));
+
+  // Over: one thread less, then hold.
+  EXPECT_THAT(ctl.Update(Load(9.0, 0), t0), Eq(3));
+  EXPECT_THAT(ctl.Update(Load(9.0, 0), t0 + seconds(4)), Eq(3));
+  EXPECT_THAT(ctl.Update(Load(9.0, 0), t0 + seconds(5)), Eq(2));
+
+  // Pressure alone counts as over, but never below 1 thread.
+  EXPECT_THAT(ctl.Update(Load(0, 30.0), t0 + seconds(10)), Eq(1));
+  EXPECT_THAT(ctl.Update(Load(0, 30.0), t0 + seconds(15)), Eq(1));
+
+  // In between: no change.
+  EXPECT_THAT(ctl.Update(Load(7.5, 0), t0 + seconds(20)), Eq(1));
+  EXPECT_THAT(ctl.Update(Load(0, 15.0), t0 + seconds(25)), Eq(1));
+
+  // Comfortably under: back up, to at most `max_threads`.
+  for (int i = 6; i < 12; ++i) {
+    ctl.Update(Load(1.0, 1.0), t0 + seconds(i * 5));
+  }
+  EXPECT_THAT(ctl.threads(), Eq(4));
+}
+
+TEST(LoadController, UnsetLimits) {
+  const auto t0 = LoadController::Clock::now();
+
+  // Pressure is ignored without a limit.
+  LoadController load_only(4, 8.0, 0, seconds(5));
+  EXPECT_THAT(load_only.Update(Load(1.0, 90.0), t0), Eq(4));
+  EXPECT_THAT(load_only.Update(Load(9.0, 0), t0), Eq(3));
+
+  // And so is the load average.
+  LoadController pressure_only(4, 0, 20.0, seconds(5));
+  EXPECT_THAT(pressure_only.Update(Load(50.0, 5.0), t0), Eq(4));
+  EXPECT_THAT(pressure_only.Update(Load(0, 30.0), t0), Eq(3));
+}